@@ -156,6 +156,26 @@ void sensirion_sleep_usec(uint32_t useconds) {
     delay((useconds / 1000) + 1);
 }
 
+/**
+ * Return the current time of a monotonic clock in microseconds.
+ *
+ * micros() overflows after about 70 minutes, the overflows are counted to
+ * extend it to 64 bit. This requires the function to be called at least once
+ * per overflow period, which is the case when measuring periodically.
+ *
+ * @return the current time in microseconds
+ */
+uint64_t sensirion_get_time_usec(void) {
+    static uint32_t last_usec = 0;
+    static uint32_t overflows = 0;
+    uint32_t now = micros();
+
+    if (now < last_usec)
+        ++overflows;
+    last_usec = now;
+    return (uint64_t)overflows << 32 | now;
+}
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -34,8 +34,14 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#endif
+
 // Adapted from
 // http://www.raspberry-projects.com/pi/programming-in-c/uart-serial-port/using-the-uart
 
@@ -92,6 +98,10 @@ int16_t sensirion_uart_open() {
     options.c_iflag = IGNPAR;
     options.c_oflag = 0;
     options.c_lflag = 0;
+    // Return from read() immediately if no data is available, the driver polls
+    // for responses with its own timeouts
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 0;
     tcflush(uart_fd, TCIFLUSH);
     tcsetattr(uart_fd, TCSANOW, &options);
     return 0;
@@ -117,3 +127,30 @@ int16_t sensirion_uart_rx(uint16_t max_data_len, uint8_t* data) {
 void sensirion_sleep_usec(uint32_t useconds) {
     usleep(useconds);
 }
+
+uint64_t sensirion_get_time_usec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+int16_t sensirion_uart_get_error_counters(
+    struct sensirion_uart_error_counters* counters) {
+    struct serial_icounter_struct icount;
+
+    if (uart_fd == -1)
+        return -1;
+
+    // Not all serial drivers support the interrupt counters
+    if (ioctl(uart_fd, TIOCGICOUNT, &icount) == -1)
+        return -1;
+
+    counters->frame_errors = (uint32_t)icount.frame;
+    counters->parity_errors = (uint32_t)icount.parity;
+    counters->overruns = (uint32_t)(icount.overrun + icount.buf_overrun);
+    counters->breaks = (uint32_t)icount.brk;
+    return 0;
+}
+#endif /* SENSIRION_UART_ERROR_COUNTERS */
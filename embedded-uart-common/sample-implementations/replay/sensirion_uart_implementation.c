@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sensirion_arch_config.h"
+#include "sensirion_uart.h"
+#include "sensirion_uart_replay.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Capture format as written by sps_capture
+#define REPLAY_PCAP_MAGIC 0xa1b2c3d4
+#define REPLAY_PCAP_DLT 147
+#define REPLAY_PSEUDO_HEADER_LEN 4
+#define REPLAY_DIRECTION_TX 0
+#define REPLAY_DIRECTION_RX 1
+
+#define REPLAY_MAX_FRAME_LEN (2 + (5 + 255) * 2)
+#define REPLAY_SHDLC_START 0x7e
+
+struct replay_pcap_header {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+};
+
+struct replay_pcap_record_header {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+};
+
+struct replay_record {
+    uint64_t timestamp_usec;
+    uint32_t len;      // captured length of the frame
+    uint32_t orig_len; // length of the frame on the wire
+    uint8_t direction;
+    uint8_t port;
+    uint8_t frame[REPLAY_MAX_FRAME_LEN];
+};
+
+static const char* replay_path = SENSIRION_UART_REPLAY_FILE;
+static uint32_t replay_speed = SENSIRION_UART_REPLAY_SPEED;
+static FILE* replay_file = NULL;
+static struct replay_record replay_next;
+static uint8_t replay_has_next = 0;
+static uint8_t replay_port = 0;
+static uint64_t replay_clock_usec = 0; // virtual clock if replay_speed is 0
+static struct sensirion_uart_replay_stats replay_stats;
+
+// Response currently fed back to the driver
+static uint8_t replay_rx_data[REPLAY_MAX_FRAME_LEN];
+static uint32_t replay_rx_len = 0;
+static uint32_t replay_rx_pos = 0;
+static uint64_t replay_rx_due_usec = 0;
+
+static void replay_read_next(void) {
+    struct replay_pcap_record_header header;
+    uint8_t pseudo_header[REPLAY_PSEUDO_HEADER_LEN];
+    uint32_t len;
+
+    replay_has_next = 0;
+    if (fread(&header, sizeof(header), 1, replay_file) != 1 ||
+        header.incl_len < REPLAY_PSEUDO_HEADER_LEN ||
+        header.incl_len > REPLAY_PSEUDO_HEADER_LEN + REPLAY_MAX_FRAME_LEN ||
+        header.orig_len < header.incl_len) {
+        replay_stats.finished = 1;
+        return;
+    }
+
+    len = header.incl_len - REPLAY_PSEUDO_HEADER_LEN;
+    if (fread(pseudo_header, sizeof(pseudo_header), 1, replay_file) != 1 ||
+        fread(replay_next.frame, 1, len, replay_file) != len) {
+        replay_stats.finished = 1;
+        return;
+    }
+
+    replay_next.timestamp_usec =
+        (uint64_t)header.ts_sec * 1000000 + header.ts_usec;
+    replay_next.len = len;
+    replay_next.orig_len = header.orig_len - REPLAY_PSEUDO_HEADER_LEN;
+    replay_next.direction = pseudo_header[0];
+    replay_next.port = pseudo_header[1];
+    replay_has_next = 1;
+}
+
+void sensirion_uart_replay_configure(const char* path, uint32_t speed) {
+    replay_path = path;
+    replay_speed = speed;
+}
+
+void sensirion_uart_replay_get_stats(
+    struct sensirion_uart_replay_stats* stats) {
+    *stats = replay_stats;
+}
+
+/**
+ * sensirion_uart_select_port() - select the UART port index to use
+ *                                THE IMPLEMENTATION IS OPTIONAL ON SINGLE-PORT
+ *                                SETUPS (only one SPS30)
+ *
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sensirion_uart_select_port(uint8_t port) {
+    replay_port = port;
+    return 0;
+}
+
+int16_t sensirion_uart_open() {
+    struct replay_pcap_header header;
+
+    replay_file = fopen(replay_path, "rb");
+    if (!replay_file) {
+        fprintf(stderr, "Error opening capture %s\n", replay_path);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, replay_file) != 1 ||
+        header.magic != REPLAY_PCAP_MAGIC ||
+        header.network != REPLAY_PCAP_DLT) {
+        fprintf(stderr, "%s is not an SHDLC capture\n", replay_path);
+        fclose(replay_file);
+        replay_file = NULL;
+        return -1;
+    }
+
+    memset(&replay_stats, 0, sizeof(replay_stats));
+    replay_rx_len = 0;
+    replay_rx_pos = 0;
+    replay_clock_usec = 0;
+    replay_read_next();
+    return 0;
+}
+
+int16_t sensirion_uart_close() {
+    int ret;
+
+    if (!replay_file)
+        return -1;
+    ret = fclose(replay_file);
+    replay_file = NULL;
+    return ret ? -1 : 0;
+}
+
+int16_t sensirion_uart_tx(uint16_t data_len, const uint8_t* data) {
+    uint64_t tx_timestamp_usec;
+    uint64_t delay_usec = 0;
+
+    if (!replay_file)
+        return -1;
+
+    // Only SHDLC frames are captured, e.g. the wake-up pulse is not
+    if (data_len == 0 || data[0] != REPLAY_SHDLC_START)
+        return (int16_t)data_len;
+
+    // Responses which were not read are discarded like stale bytes
+    replay_rx_len = 0;
+    replay_rx_pos = 0;
+    while (replay_has_next && replay_next.direction != REPLAY_DIRECTION_TX)
+        replay_read_next();
+
+    ++replay_stats.tx_frames;
+    if (!replay_has_next || replay_next.port != replay_port ||
+        replay_next.orig_len != data_len ||
+        memcmp(replay_next.frame, data, replay_next.len) != 0) {
+        ++replay_stats.tx_mismatches;
+        if (!replay_stats.first_mismatch)
+            replay_stats.first_mismatch = replay_stats.tx_frames;
+    }
+    if (!replay_has_next)
+        return (int16_t)data_len;
+
+    tx_timestamp_usec = replay_next.timestamp_usec;
+    replay_read_next();
+    if (!replay_has_next || replay_next.direction != REPLAY_DIRECTION_RX)
+        return (int16_t)data_len;
+
+    // Keep the recorded response delay relative to this transmission
+    if (replay_next.timestamp_usec > tx_timestamp_usec)
+        delay_usec = replay_next.timestamp_usec - tx_timestamp_usec;
+    if (replay_speed)
+        delay_usec /= replay_speed;
+    replay_rx_due_usec = sensirion_get_time_usec() + delay_usec;
+    memcpy(replay_rx_data, replay_next.frame, replay_next.len);
+    replay_rx_len = replay_next.len;
+    if (replay_rx_len)
+        ++replay_stats.rx_frames;
+    replay_read_next();
+    return (int16_t)data_len;
+}
+
+int16_t sensirion_uart_rx(uint16_t max_data_len, uint8_t* data) {
+    uint64_t now;
+    uint32_t len;
+
+    if (!replay_file)
+        return -1;
+    if (replay_rx_pos == replay_rx_len)
+        return 0;
+
+    // Like a UART, no data until the response is due
+    now = sensirion_get_time_usec();
+    if (now < replay_rx_due_usec) {
+        if (replay_speed)
+            return 0;
+        replay_clock_usec = replay_rx_due_usec;
+    }
+
+    len = replay_rx_len - replay_rx_pos;
+    if (len > max_data_len)
+        len = max_data_len;
+    memcpy(data, replay_rx_data + replay_rx_pos, len);
+    replay_rx_pos += len;
+    return (int16_t)len;
+}
+
+void sensirion_sleep_usec(uint32_t useconds) {
+    if (!replay_speed) {
+        replay_clock_usec += useconds;
+        return;
+    }
+    usleep(useconds / replay_speed);
+}
+
+uint64_t sensirion_get_time_usec(void) {
+    struct timespec ts;
+
+    if (!replay_speed)
+        return replay_clock_usec;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+int16_t sensirion_uart_get_error_counters(
+    struct sensirion_uart_error_counters* counters) {
+    // A capture does not contain UART errors
+    return -1;
+}
+#endif /* SENSIRION_UART_ERROR_COUNTERS */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SENSIRION_UART_REPLAY_H
+#define SENSIRION_UART_REPLAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+/**
+ * The replay UART implementation feeds the responses of a capture recorded
+ * with sps_capture back to the driver and verifies that the driver sends the
+ * same frames as in the capture, thus recorded traffic can be reproduced and
+ * decoders can be benchmarked without hardware.
+ *
+ * Frames are matched in order. Every frame sent by the driver is compared with
+ * the next sent frame in the capture (bytes and port) and answered with the
+ * frames received after it, delayed as recorded relative to the transmission.
+ * Bytes which are not a frame (e.g. the wake-up pulse) are not captured and
+ * thus not verified. Frames truncated in the capture are only compared up to
+ * the captured length, record with a large enough SPS_CAPTURE_MAX_FRAME_LEN.
+ */
+
+#ifndef SENSIRION_UART_REPLAY_FILE
+#define SENSIRION_UART_REPLAY_FILE "capture.pcap"
+#endif
+
+/**
+ * Replay speed factor, 1 replays with the original timing, N is N times
+ * faster. 0 replays as fast as possible with a virtual clock, which is
+ * advanced by sensirion_sleep_usec() and the recorded response delays
+ * instead of waiting.
+ */
+#ifndef SENSIRION_UART_REPLAY_SPEED
+#define SENSIRION_UART_REPLAY_SPEED 0
+#endif
+
+struct sensirion_uart_replay_stats {
+    uint32_t tx_frames;      /* frames sent by the driver */
+    uint32_t tx_mismatches;  /* frames differing from the capture */
+    uint32_t first_mismatch; /* number of the first differing frame or 0 */
+    uint32_t rx_frames;      /* recorded frames fed back to the driver */
+    uint8_t finished;        /* all records of the capture replayed */
+};
+
+/**
+ * sensirion_uart_replay_configure() - select the capture and the speed
+ *
+ * Takes effect with the next sensirion_uart_open(), defaults to
+ * SENSIRION_UART_REPLAY_FILE and SENSIRION_UART_REPLAY_SPEED.
+ *
+ * @path:   Path of the capture file, must stay valid
+ * @speed:  Speed factor, see SENSIRION_UART_REPLAY_SPEED
+ */
+void sensirion_uart_replay_configure(const char* path, uint32_t speed);
+
+/**
+ * sensirion_uart_replay_get_stats() - read the replay counters
+ *
+ * The counters are reset by sensirion_uart_open().
+ *
+ * @stats:  Memory where the counters are stored
+ */
+void sensirion_uart_replay_get_stats(struct sensirion_uart_replay_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SENSIRION_UART_REPLAY_H */
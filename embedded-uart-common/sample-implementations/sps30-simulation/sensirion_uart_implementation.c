@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sensirion_arch_config.h"
+#include "sensirion_uart.h"
+#include "sps30_simulation.h"
+#include <string.h>
+
+#define SIM_SHDLC_START 0x7e
+#define SIM_SHDLC_ESCAPE 0x7d
+#define SIM_SHDLC_ESCAPE_XOR 0x20
+#define SIM_MAX_DATA_LEN 255
+#define SIM_MAX_FRAME_LEN (2 + (5 + SIM_MAX_DATA_LEN) * 2)
+#define SIM_WAKE_UP_PULSE 0xff
+#define SIM_ADDR 0x00
+
+#define SIM_CMD_START_MEASUREMENT 0x00
+#define SIM_CMD_STOP_MEASUREMENT 0x01
+#define SIM_CMD_READ_MEASUREMENT 0x03
+#define SIM_CMD_SLEEP 0x10
+#define SIM_CMD_WAKE_UP 0x11
+#define SIM_CMD_FAN_CLEAN_INTV 0x80
+#define SIM_CMD_START_FAN_CLEANING 0x56
+#define SIM_CMD_DEV_INFO 0xd0
+#define SIM_CMD_READ_VERSION 0xd1
+#define SIM_CMD_RESET 0xd3
+
+#define SIM_DEV_INFO_PRODUCT_TYPE 0x00
+#define SIM_DEV_INFO_SERIAL 0x03
+
+// State byte of the responses
+#define SIM_STATE_OK 0x00
+#define SIM_STATE_WRONG_DATA_LEN 0x01
+#define SIM_STATE_UNKNOWN_CMD 0x02
+#define SIM_STATE_ILLEGAL_PARAM 0x04
+#define SIM_STATE_NOT_ALLOWED 0x43
+
+#define SIM_DEFAULT_CONCENTRATION 10.0f
+
+enum sim_mode {
+    SIM_MODE_IDLE,
+    SIM_MODE_MEASURING,
+    SIM_MODE_SLEEPING,
+};
+
+struct sim_sensor {
+    enum sim_mode mode;
+    uint8_t woken; // wake-up pulse received while sleeping
+    uint32_t fan_interval_seconds;
+    uint32_t reported_fan_interval_seconds; // updated on reset
+    uint64_t fan_interval_usec; // measurement time since the last cleaning
+    uint64_t measurement_start_usec;
+    uint64_t last_update_usec;
+    uint64_t last_sample; // last sample read since measurement start
+    struct sps30_simulation_stats stats;
+    uint8_t rx[SIM_MAX_FRAME_LEN];
+    uint16_t rx_len;
+    uint16_t rx_pos;
+};
+
+static struct sim_sensor sim_sensors[SPS30_SIMULATION_NUM_PORTS];
+static uint8_t sim_initialized = 0;
+static uint8_t sim_port = 0;
+static uint8_t sim_open = 0;
+static uint8_t sim_disconnected = 0;
+static uint64_t sim_clock_usec = 0;
+static sps30_simulation_profile_fn sim_profile =
+    (sps30_simulation_profile_fn)NULL;
+
+static void sim_init(void) {
+    uint8_t i;
+
+    if (sim_initialized)
+        return;
+    memset(sim_sensors, 0, sizeof(sim_sensors));
+    for (i = 0; i < SPS30_SIMULATION_NUM_PORTS; ++i) {
+        sim_sensors[i].fan_interval_seconds =
+            SPS30_SIMULATION_DEFAULT_FAN_AUTO_CLEANING_INTERVAL;
+        sim_sensors[i].reported_fan_interval_seconds =
+            SPS30_SIMULATION_DEFAULT_FAN_AUTO_CLEANING_INTERVAL;
+        sim_sensors[i].last_update_usec = sim_clock_usec;
+    }
+    sim_initialized = 1;
+}
+
+// Account the time passed since the last update of the sensor
+static void sim_update(struct sim_sensor* s) {
+    uint64_t elapsed = sim_clock_usec - s->last_update_usec;
+    uint64_t interval_usec = (uint64_t)s->fan_interval_seconds * 1000000;
+
+    s->last_update_usec = sim_clock_usec;
+    if (s->mode != SIM_MODE_MEASURING)
+        return;
+
+    s->stats.measurement_usec += elapsed;
+    if (!interval_usec)
+        return;
+    s->fan_interval_usec += elapsed;
+    while (s->fan_interval_usec >= interval_usec) {
+        s->fan_interval_usec -= interval_usec;
+        ++s->stats.fan_auto_cleanings;
+    }
+}
+
+static void sim_float_to_bytes(float value, uint8_t* bytes) {
+    uint32_t u;
+
+    memcpy(&u, &value, sizeof(u));
+    bytes[0] = (uint8_t)(u >> 24);
+    bytes[1] = (uint8_t)(u >> 16);
+    bytes[2] = (uint8_t)(u >> 8);
+    bytes[3] = (uint8_t)u;
+}
+
+static uint8_t sim_measurement(uint8_t port, uint8_t* data) {
+    // Typical ratios of the fields to the mass concentration PM2.5
+    static const float ratios[] = {0.9f, 1.0f, 1.05f, 1.1f, 6.8f,
+                                   8.0f, 8.1f, 8.12f, 8.13f};
+    float mc_2p5 = SIM_DEFAULT_CONCENTRATION;
+    uint8_t i;
+
+    if (sim_profile)
+        mc_2p5 = sim_profile(port, sim_clock_usec);
+    for (i = 0; i < sizeof(ratios) / sizeof(ratios[0]); ++i)
+        sim_float_to_bytes(mc_2p5 * ratios[i], &data[i * 4]);
+    sim_float_to_bytes(0.5f, &data[i * 4]); // typical particle size in um
+    return (i + 1) * 4;
+}
+
+static void sim_respond(struct sim_sensor* s, uint8_t cmd, uint8_t state,
+                        uint8_t data_len, const uint8_t* data) {
+    uint8_t raw[4 + SIM_MAX_DATA_LEN + 1];
+    uint16_t raw_len = 0;
+    uint16_t i;
+    uint8_t sum = 0;
+    uint8_t c;
+
+    raw[raw_len++] = SIM_ADDR;
+    raw[raw_len++] = cmd;
+    raw[raw_len++] = state;
+    raw[raw_len++] = data_len;
+    memcpy(&raw[raw_len], data, data_len);
+    raw_len += data_len;
+    for (i = 0; i < raw_len; ++i)
+        sum += raw[i];
+    raw[raw_len++] = (uint8_t)~sum;
+
+    s->rx_len = 0;
+    s->rx_pos = 0;
+    s->rx[s->rx_len++] = SIM_SHDLC_START;
+    for (i = 0; i < raw_len; ++i) {
+        c = raw[i];
+        if (c == 0x7e || c == 0x7d || c == 0x11 || c == 0x13) {
+            s->rx[s->rx_len++] = SIM_SHDLC_ESCAPE;
+            c ^= SIM_SHDLC_ESCAPE_XOR;
+        }
+        s->rx[s->rx_len++] = c;
+    }
+    s->rx[s->rx_len++] = SIM_SHDLC_START;
+}
+
+static void sim_command(struct sim_sensor* s, uint8_t port, uint8_t cmd,
+                        uint8_t len, const uint8_t* param) {
+    uint8_t data[SIM_MAX_DATA_LEN];
+    uint8_t data_len = 0;
+    uint8_t state = SIM_STATE_OK;
+    uint64_t sample;
+
+    switch (cmd) {
+        case SIM_CMD_START_MEASUREMENT:
+            if (len != 2)
+                state = SIM_STATE_WRONG_DATA_LEN;
+            else if (s->mode != SIM_MODE_IDLE)
+                state = SIM_STATE_NOT_ALLOWED;
+            else {
+                s->mode = SIM_MODE_MEASURING;
+                s->measurement_start_usec = sim_clock_usec;
+                s->last_sample = 0;
+            }
+            break;
+        case SIM_CMD_STOP_MEASUREMENT:
+            if (s->mode != SIM_MODE_MEASURING)
+                state = SIM_STATE_NOT_ALLOWED;
+            else
+                s->mode = SIM_MODE_IDLE;
+            break;
+        case SIM_CMD_READ_MEASUREMENT:
+            if (s->mode != SIM_MODE_MEASURING) {
+                state = SIM_STATE_NOT_ALLOWED;
+                break;
+            }
+            // No data if no new measurement is available
+            sample = (sim_clock_usec - s->measurement_start_usec) /
+                     SPS30_SIMULATION_SAMPLE_USEC;
+            if (sample > s->last_sample) {
+                s->last_sample = sample;
+                data_len = sim_measurement(port, data);
+                ++s->stats.measurements;
+            }
+            break;
+        case SIM_CMD_SLEEP:
+            if (s->mode != SIM_MODE_IDLE)
+                state = SIM_STATE_NOT_ALLOWED;
+            else {
+                s->mode = SIM_MODE_SLEEPING;
+                ++s->stats.sleeps;
+            }
+            break;
+        case SIM_CMD_WAKE_UP:
+            // Only allowed in sleep mode, a measuring sensor keeps measuring
+            if (s->mode != SIM_MODE_SLEEPING)
+                state = SIM_STATE_NOT_ALLOWED;
+            else
+                s->mode = SIM_MODE_IDLE;
+            break;
+        case SIM_CMD_FAN_CLEAN_INTV:
+            if (len == 1 && param[0] == 0) {
+                // A written interval is only reported after a reset
+                data[0] = (uint8_t)(s->reported_fan_interval_seconds >> 24);
+                data[1] = (uint8_t)(s->reported_fan_interval_seconds >> 16);
+                data[2] = (uint8_t)(s->reported_fan_interval_seconds >> 8);
+                data[3] = (uint8_t)s->reported_fan_interval_seconds;
+                data_len = 4;
+            } else if (len == 5 && param[0] == 0) {
+                s->fan_interval_seconds =
+                    (uint32_t)param[1] << 24 | (uint32_t)param[2] << 16 |
+                    (uint32_t)param[3] << 8 | (uint32_t)param[4];
+                s->fan_interval_usec = 0;
+            } else
+                state = SIM_STATE_WRONG_DATA_LEN;
+            break;
+        case SIM_CMD_START_FAN_CLEANING:
+            if (s->mode != SIM_MODE_MEASURING)
+                state = SIM_STATE_NOT_ALLOWED;
+            else
+                ++s->stats.fan_manual_cleanings;
+            break;
+        case SIM_CMD_DEV_INFO:
+            if (len != 1) {
+                state = SIM_STATE_WRONG_DATA_LEN;
+            } else if (param[0] == SIM_DEV_INFO_PRODUCT_TYPE) {
+                memcpy(data, "00080000", 9);
+                data_len = 9;
+            } else if (param[0] == SIM_DEV_INFO_SERIAL) {
+                memcpy(data, "SIMULATED0000000", 17);
+                data[15] = (uint8_t)('0' + port);
+                data_len = 17;
+            } else
+                state = SIM_STATE_ILLEGAL_PARAM;
+            break;
+        case SIM_CMD_READ_VERSION:
+            // Firmware 2.2, hardware revision 7, SHDLC 2.0
+            data[0] = 2;
+            data[1] = 2;
+            data[2] = 0;
+            data[3] = 7;
+            data[4] = 0;
+            data[5] = 2;
+            data[6] = 0;
+            data_len = 7;
+            break;
+        case SIM_CMD_RESET:
+            s->mode = SIM_MODE_IDLE;
+            s->fan_interval_usec = 0;
+            s->reported_fan_interval_seconds = s->fan_interval_seconds;
+            break;
+        default:
+            state = SIM_STATE_UNKNOWN_CMD;
+            break;
+    }
+    sim_respond(s, cmd, state, data_len, data);
+}
+
+void sps30_simulation_set_profile(sps30_simulation_profile_fn profile) {
+    sim_profile = profile;
+}
+
+void sps30_simulation_advance_usec(uint64_t usec) {
+    sim_clock_usec += usec;
+}
+
+void sps30_simulation_reset(void) {
+    sim_initialized = 0;
+    sim_init();
+}
+
+void sps30_simulation_set_disconnected(uint8_t disconnected) {
+    sim_disconnected = disconnected;
+}
+
+int16_t sps30_simulation_get_stats(uint8_t port,
+                                   struct sps30_simulation_stats* stats) {
+    if (port >= SPS30_SIMULATION_NUM_PORTS)
+        return -1;
+
+    sim_init();
+    sim_update(&sim_sensors[port]);
+    *stats = sim_sensors[port].stats;
+    return 0;
+}
+
+/**
+ * sensirion_uart_select_port() - select the UART port index to use
+ *                                THE IMPLEMENTATION IS OPTIONAL ON SINGLE-PORT
+ *                                SETUPS (only one SPS30)
+ *
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sensirion_uart_select_port(uint8_t port) {
+    if (port >= SPS30_SIMULATION_NUM_PORTS)
+        return -1;
+    sim_port = port;
+    return 0;
+}
+
+int16_t sensirion_uart_open() {
+    if (sim_disconnected)
+        return -1;
+    sim_init();
+    sim_open = 1;
+    return 0;
+}
+
+int16_t sensirion_uart_close() {
+    sim_open = 0;
+    return 0;
+}
+
+int16_t sensirion_uart_tx(uint16_t data_len, const uint8_t* data) {
+    struct sim_sensor* s = &sim_sensors[sim_port];
+    uint8_t frame[4 + SIM_MAX_DATA_LEN + 1];
+    uint16_t len = 0;
+    uint16_t i;
+    uint8_t sum = 0;
+    uint8_t woken;
+
+    if (!sim_open || sim_disconnected)
+        return -1;
+
+    sim_init();
+    sim_update(s);
+
+    if (data_len == 1 && data[0] == SIM_WAKE_UP_PULSE) {
+        if (s->mode == SIM_MODE_SLEEPING)
+            s->woken = 1;
+        return 1;
+    }
+
+    // A sleeping sensor only receives the frame following a wake-up pulse
+    woken = s->woken;
+    s->woken = 0;
+    if (s->mode == SIM_MODE_SLEEPING && !woken)
+        return (int16_t)data_len;
+
+    // Responses which were not read are discarded like stale bytes
+    s->rx_len = 0;
+    s->rx_pos = 0;
+
+    if (data_len < 2 || data[0] != SIM_SHDLC_START ||
+        data[data_len - 1] != SIM_SHDLC_START)
+        return (int16_t)data_len;
+    for (i = 1; i < data_len - 1 && len < sizeof(frame); ++i) {
+        if (data[i] == SIM_SHDLC_ESCAPE && i + 1 < data_len - 1)
+            frame[len++] = data[++i] ^ SIM_SHDLC_ESCAPE_XOR;
+        else
+            frame[len++] = data[i];
+    }
+    for (i = 0; i < len; ++i)
+        sum += frame[i];
+
+    // Invalid frames and frames for other addresses are ignored
+    if (len < 4 || frame[2] != len - 4 || sum != 0xff || frame[0] != SIM_ADDR)
+        return (int16_t)data_len;
+    if (s->mode == SIM_MODE_SLEEPING && frame[1] != SIM_CMD_WAKE_UP)
+        return (int16_t)data_len;
+
+    sim_command(s, sim_port, frame[1], frame[2], &frame[3]);
+    return (int16_t)data_len;
+}
+
+int16_t sensirion_uart_rx(uint16_t max_data_len, uint8_t* data) {
+    struct sim_sensor* s = &sim_sensors[sim_port];
+    uint16_t len = s->rx_len - s->rx_pos;
+
+    if (!sim_open || sim_disconnected)
+        return -1;
+    if (len > max_data_len)
+        len = max_data_len;
+    memcpy(data, &s->rx[s->rx_pos], len);
+    s->rx_pos += len;
+    return (int16_t)len;
+}
+
+void sensirion_sleep_usec(uint32_t useconds) {
+    sim_clock_usec += useconds;
+}
+
+uint64_t sensirion_get_time_usec(void) {
+    return sim_clock_usec;
+}
+
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+int16_t sensirion_uart_get_error_counters(
+    struct sensirion_uart_error_counters* counters) {
+    counters->frame_errors = 0;
+    counters->parity_errors = 0;
+    counters->overruns = 0;
+    counters->breaks = 0;
+    return 0;
+}
+#endif /* SENSIRION_UART_ERROR_COUNTERS */
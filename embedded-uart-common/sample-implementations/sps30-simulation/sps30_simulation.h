@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS30_SIMULATION_H
+#define SPS30_SIMULATION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+/**
+ * The simulation UART implementation answers the SPS30 commands with
+ * simulated sensors on a virtual clock, thus schedules running for days or
+ * weeks (e.g. duty cycles or the one week fan auto-cleaning interval) can be
+ * validated in seconds of wall time.
+ *
+ * The virtual clock is returned by sensirion_get_time_usec() and only
+ * advances with sensirion_sleep_usec() and sps30_simulation_advance_usec().
+ * Each UART port is a separate sensor which measures in 1 s intervals and
+ * runs the fan auto-cleaning after the configured measurement time, like the
+ * real sensor. Like the real sensor, a newly written auto-cleaning interval
+ * applies immediately but is only reported after a reset.
+ */
+
+#define SPS30_SIMULATION_NUM_PORTS 4
+#define SPS30_SIMULATION_SAMPLE_USEC 1000000
+#define SPS30_SIMULATION_DEFAULT_FAN_AUTO_CLEANING_INTERVAL 604800 /* 7 d */
+
+/**
+ * Mass concentration PM2.5 in ug/m^3 measured by the sensor on port at the
+ * given time, the other fields are derived from it
+ */
+typedef float (*sps30_simulation_profile_fn)(uint8_t port,
+                                             uint64_t time_usec);
+
+struct sps30_simulation_stats {
+    uint64_t measurement_usec;    /* time spent in measurement mode */
+    uint32_t measurements;        /* measurements read */
+    uint32_t fan_auto_cleanings;  /* auto-cleanings run */
+    uint32_t fan_manual_cleanings;
+    uint32_t sleeps;
+};
+
+/**
+ * sps30_simulation_set_profile() - set the simulated concentration
+ *
+ * The default is a constant concentration of 10 ug/m^3.
+ *
+ * @profile:    Concentration over time, NULL for the default
+ */
+void sps30_simulation_set_profile(sps30_simulation_profile_fn profile);
+
+/**
+ * sps30_simulation_advance_usec() - advance the virtual clock
+ *
+ * Like sensirion_sleep_usec() but without the 32 bit limit, e.g. to let days
+ * pass between two calls of the driver.
+ *
+ * @usec:   Time to advance in microseconds
+ */
+void sps30_simulation_advance_usec(uint64_t usec);
+
+/**
+ * sps30_simulation_reset() - power-cycle all simulated sensors
+ *
+ * Restores the default auto-cleaning interval and clears the statistics. The
+ * virtual clock keeps running.
+ */
+void sps30_simulation_reset(void);
+
+/**
+ * sps30_simulation_set_disconnected() - disconnect the simulated UART
+ *
+ * While disconnected, like an unplugged USB adapter, sensirion_uart_open(),
+ * sensirion_uart_tx() and sensirion_uart_rx() fail. The latter two also fail
+ * while the UART is closed. The sensors keep their state.
+ *
+ * @disconnected:   1 to disconnect, 0 to reconnect
+ */
+void sps30_simulation_set_disconnected(uint8_t disconnected);
+
+/**
+ * sps30_simulation_get_stats() - read the statistics of a simulated sensor
+ *
+ * @port:   UART port of the sensor
+ * @stats:  Memory where the statistics are stored
+ * Return:  0 on success, -1 if the port does not exist
+ */
+int16_t sps30_simulation_get_stats(uint8_t port,
+                                   struct sps30_simulation_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_SIMULATION_H */
@@ -32,6 +32,21 @@
 #include "sensirion_shdlc.h"
 #include "sensirion_arch_config.h"
 #include "sensirion_uart.h"
+#include <string.h>
+
+#ifndef SENSIRION_NO_SIMD
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define SENSIRION_SIMD_SSSE3
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SENSIRION_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define SENSIRION_SIMD_NEON
+#endif
+#endif /* SENSIRION_NO_SIMD */
 
 #define SHDLC_START 0x7e
 #define SHDLC_STOP 0x7e
@@ -44,6 +59,173 @@
 #define SHDLC_FRAME_MAX_RX_FRAME_SIZE (2 + (5 + 255) * 2)
 
 #define RX_DELAY_US 20000
+#define RX_POLL_US 1000
+
+static uint8_t shdlc_port = 0;
+
+void sensirion_shdlc_set_port(uint8_t port) {
+    shdlc_port = port;
+}
+
+#ifdef SENSIRION_SHDLC_CAPTURE
+static sensirion_shdlc_capture_fn shdlc_capture =
+    (sensirion_shdlc_capture_fn)NULL;
+static void* shdlc_capture_user_data = NULL;
+
+void sensirion_shdlc_set_capture(sensirion_shdlc_capture_fn capture,
+                                 void* user_data) {
+    /* The callback is published last, a transaction which sees it also sees
+     * its user_data */
+    __atomic_store_n(&shdlc_capture, (sensirion_shdlc_capture_fn)NULL,
+                     __ATOMIC_RELEASE);
+    __atomic_store_n(&shdlc_capture_user_data, user_data, __ATOMIC_RELAXED);
+    __atomic_store_n(&shdlc_capture, capture, __ATOMIC_RELEASE);
+}
+
+static void sensirion_shdlc_capture_frame(uint8_t direction, int16_t result,
+                                          const uint8_t* frame,
+                                          uint16_t len) {
+    sensirion_shdlc_capture_fn capture =
+        __atomic_load_n(&shdlc_capture, __ATOMIC_ACQUIRE);
+
+    if (capture)
+        capture(__atomic_load_n(&shdlc_capture_user_data, __ATOMIC_RELAXED),
+                direction, shdlc_port, sensirion_get_time_usec(), result,
+                frame, len);
+}
+#endif /* SENSIRION_SHDLC_CAPTURE */
+
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+static struct sensirion_shdlc_stats shdlc_stats;
+
+static void sensirion_shdlc_count_error(uint32_t* errors, int16_t error) {
+    if (error < 0 && error > -SENSIRION_SHDLC_NUM_ERROR_CODES)
+        ++errors[-error];
+    else
+        ++errors[0];
+}
+
+/* State of a transceived command for the instrumentation */
+struct sensirion_shdlc_transaction {
+    uint64_t start_usec;
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+    struct sensirion_uart_error_counters uart_errors;
+    int16_t uart_errors_ret;
+#endif
+};
+
+static void
+sensirion_shdlc_transaction_begin(struct sensirion_shdlc_transaction* t) {
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+    t->uart_errors_ret = sensirion_uart_get_error_counters(&t->uart_errors);
+#endif
+    t->start_usec = sensirion_get_time_usec();
+}
+
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+static void
+sensirion_shdlc_add_uart_errors(struct sensirion_uart_error_counters* sum,
+                                const struct sensirion_uart_error_counters* a,
+                                const struct sensirion_uart_error_counters* b) {
+    sum->frame_errors += b->frame_errors - a->frame_errors;
+    sum->parity_errors += b->parity_errors - a->parity_errors;
+    sum->overruns += b->overruns - a->overruns;
+    sum->breaks += b->breaks - a->breaks;
+}
+#endif
+
+static void
+sensirion_shdlc_transaction_end(const struct sensirion_shdlc_transaction* t,
+                                uint8_t addr, uint8_t cmd, int16_t ret) {
+    struct sensirion_shdlc_command_stats* c =
+        (struct sensirion_shdlc_command_stats*)NULL;
+    uint64_t latency_usec = sensirion_get_time_usec() - t->start_usec;
+    uint8_t i;
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+    struct sensirion_uart_error_counters uart_errors;
+    uint8_t have_uart_errors =
+        t->uart_errors_ret == 0 &&
+        sensirion_uart_get_error_counters(&uart_errors) == 0;
+
+    if (have_uart_errors)
+        sensirion_shdlc_add_uart_errors(&shdlc_stats.uart_errors,
+                                        &t->uart_errors, &uart_errors);
+#endif
+
+    for (i = 0; i < shdlc_stats.num_commands; ++i) {
+        c = &shdlc_stats.commands[i];
+        if (c->port == shdlc_port && c->addr == addr && c->cmd == cmd)
+            break;
+    }
+    if (i == shdlc_stats.num_commands) {
+        if (i == SENSIRION_SHDLC_STATS_MAX_COMMANDS) {
+            ++shdlc_stats.untracked_transactions;
+            return;
+        }
+        ++shdlc_stats.num_commands;
+        c = &shdlc_stats.commands[i];
+        c->port = shdlc_port;
+        c->addr = addr;
+        c->cmd = cmd;
+    }
+
+    ++c->transactions;
+    if (ret)
+        sensirion_shdlc_count_error(c->errors, ret);
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+    if (have_uart_errors)
+        sensirion_shdlc_add_uart_errors(&c->uart_errors, &t->uart_errors,
+                                        &uart_errors);
+#endif
+
+    if (latency_usec > 0xffffffff)
+        latency_usec = 0xffffffff;
+    for (i = 0; i < SENSIRION_SHDLC_LATENCY_BUCKETS - 1; ++i) {
+        if (latency_usec < (uint32_t)SENSIRION_SHDLC_LATENCY_BUCKET_USEC << i)
+            break;
+    }
+    ++c->latency_buckets[i];
+    if (latency_usec > c->max_latency_usec)
+        c->max_latency_usec = (uint32_t)latency_usec;
+    c->sum_latency_usec += latency_usec;
+}
+
+void sensirion_shdlc_get_stats(struct sensirion_shdlc_stats* stats) {
+    *stats = shdlc_stats;
+}
+
+void sensirion_shdlc_reset_stats(void) {
+    memset(&shdlc_stats, 0, sizeof(shdlc_stats));
+}
+
+uint32_t sensirion_shdlc_latency_percentile(
+    const struct sensirion_shdlc_command_stats* stats, uint8_t percentile) {
+    uint64_t total = 0;
+    uint64_t rank;
+    uint64_t count = 0;
+    uint32_t bound;
+    uint8_t i;
+
+    for (i = 0; i < SENSIRION_SHDLC_LATENCY_BUCKETS; ++i)
+        total += stats->latency_buckets[i];
+    if (!total)
+        return 0;
+
+    rank = (total * percentile + 99) / 100;
+    if (!rank)
+        rank = 1;
+    for (i = 0; i < SENSIRION_SHDLC_LATENCY_BUCKETS - 1; ++i) {
+        count += stats->latency_buckets[i];
+        if (count >= rank)
+            break;
+    }
+    bound = (uint32_t)SENSIRION_SHDLC_LATENCY_BUCKET_USEC << i;
+    if (i == SENSIRION_SHDLC_LATENCY_BUCKETS - 1 ||
+        bound > stats->max_latency_usec)
+        bound = stats->max_latency_usec;
+    return bound;
+}
+#endif /* SENSIRION_SHDLC_INSTRUMENTATION */
 
 uint16_t sensirion_bytes_to_uint16_t(const uint8_t* bytes) {
     return (uint16_t)bytes[0] << 8 | (uint16_t)bytes[1];
@@ -72,6 +254,42 @@ float sensirion_bytes_to_float(const uint8_t* bytes) {
     return tmp.float32;
 }
 
+void sensirion_bytes_to_float_array(const uint8_t* bytes, float* values,
+                                    uint16_t num_values) {
+    uint16_t i = 0;
+
+#if defined(SENSIRION_SIMD_SSSE3)
+    const __m128i swap =
+        _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m128i v;
+
+    for (; i + 4 <= num_values; i += 4) {
+        v = _mm_loadu_si128((const __m128i*)(bytes + 4 * i));
+        _mm_storeu_ps(values + i, _mm_castsi128_ps(_mm_shuffle_epi8(v, swap)));
+    }
+#elif defined(SENSIRION_SIMD_SSE2)
+    const __m128i mask = _mm_set1_epi32(0x00ff00ff);
+    __m128i v;
+
+    for (; i + 4 <= num_values; i += 4) {
+        v = _mm_loadu_si128((const __m128i*)(bytes + 4 * i));
+        /* swap the bytes within each 16 bit half, then the halves */
+        v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 8), mask),
+                         _mm_slli_epi16(v, 8));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+        _mm_storeu_ps(values + i, _mm_castsi128_ps(v));
+    }
+#elif defined(SENSIRION_SIMD_NEON)
+    for (; i + 4 <= num_values; i += 4) {
+        vst1q_f32(values + i, vreinterpretq_f32_u8(
+                                  vrev32q_u8(vld1q_u8(bytes + 4 * i))));
+    }
+#endif
+
+    for (; i < num_values; ++i)
+        values[i] = sensirion_bytes_to_float(bytes + 4 * i);
+}
+
 void sensirion_uint32_t_to_bytes(const uint32_t value, uint8_t* bytes) {
     bytes[0] = value >> 24;
     bytes[1] = value >> 16;
@@ -165,13 +383,44 @@ int16_t sensirion_shdlc_xcv(uint8_t addr, uint8_t cmd, uint8_t tx_data_len,
                             struct sensirion_shdlc_rx_header* rx_header,
                             uint8_t* rx_data) {
     int16_t ret;
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+    struct sensirion_shdlc_transaction transaction;
+
+    sensirion_shdlc_transaction_begin(&transaction);
+#endif
 
     ret = sensirion_shdlc_tx(addr, cmd, tx_data_len, tx_data);
-    if (ret != 0)
-        return ret;
+    if (ret == 0) {
+        sensirion_sleep_usec(RX_DELAY_US);
+        ret = sensirion_shdlc_rx(max_rx_data_len, rx_header, rx_data);
+    }
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+    sensirion_shdlc_transaction_end(&transaction, addr, cmd, ret);
+#endif
+    return ret;
+}
+
+int16_t
+sensirion_shdlc_xcv_ts(uint8_t addr, uint8_t cmd, uint8_t tx_data_len,
+                       const uint8_t* tx_data, uint8_t max_rx_data_len,
+                       struct sensirion_shdlc_rx_header* rx_header,
+                       uint8_t* rx_data,
+                       struct sensirion_shdlc_rx_timestamps* timestamps) {
+    int16_t ret;
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+    struct sensirion_shdlc_transaction transaction;
+
+    sensirion_shdlc_transaction_begin(&transaction);
+#endif
 
-    sensirion_sleep_usec(RX_DELAY_US);
-    return sensirion_shdlc_rx(max_rx_data_len, rx_header, rx_data);
+    ret = sensirion_shdlc_tx(addr, cmd, tx_data_len, tx_data);
+    if (ret == 0)
+        ret = sensirion_shdlc_rx_ts(max_rx_data_len, rx_header, rx_data,
+                                    timestamps);
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+    sensirion_shdlc_transaction_end(&transaction, addr, cmd, ret);
+#endif
+    return ret;
 }
 
 int16_t sensirion_shdlc_tx(uint8_t addr, uint8_t cmd, uint8_t data_len,
@@ -191,26 +440,94 @@ int16_t sensirion_shdlc_tx(uint8_t addr, uint8_t cmd, uint8_t data_len,
     len += sensirion_shdlc_stuff_data(1, &crc, tx_frame_buf + len);
     tx_frame_buf[len++] = SHDLC_STOP;
 
+    /* UART errors are reported like incomplete frames, as on the receiving
+     * side, thus they are never mistaken for driver specific error codes */
     ret = sensirion_uart_tx(len, tx_frame_buf);
+    if (ret != len)
+        ret = SENSIRION_SHDLC_ERR_TX_INCOMPLETE;
+#ifdef SENSIRION_SHDLC_CAPTURE
+    sensirion_shdlc_capture_frame(SENSIRION_SHDLC_CAPTURE_TX,
+                                  ret < 0 ? ret : 0, tx_frame_buf, len);
+#endif
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+    if (ret < 0) {
+        sensirion_shdlc_count_error(shdlc_stats.errors, ret);
+    } else {
+        ++shdlc_stats.frames_tx;
+        shdlc_stats.bytes_tx += len;
+        shdlc_stats.stuffed_bytes_tx +=
+            len - ((uint32_t)data_len + SHDLC_MIN_TX_FRAME_SIZE);
+    }
+#endif
     if (ret < 0)
         return ret;
-    if (ret != len)
-        return SENSIRION_SHDLC_ERR_TX_INCOMPLETE;
     return 0;
 }
 
-int16_t sensirion_shdlc_rx(uint8_t max_data_len,
-                           struct sensirion_shdlc_rx_header* rxh,
-                           uint8_t* data) {
-    int16_t len;
+/**
+ * sensirion_shdlc_rx_frame() - read a raw frame from the UART
+ *
+ * Reading continues until the stop byte arrived, the buffer is full or no more
+ * data is returned. With a non-zero timeout, the UART is polled for data until
+ * the timeout elapsed instead of returning as soon as no data is available.
+ *
+ * Return:      The number of bytes read or a negative error code
+ */
+static int16_t
+sensirion_shdlc_rx_frame(uint16_t max_len, uint8_t* rx_frame,
+                         uint32_t timeout_usec,
+                         struct sensirion_shdlc_rx_timestamps* timestamps) {
+    uint64_t deadline = 0;
+    uint64_t now;
+    uint16_t len = 0;
+    uint16_t i;
+    int16_t ret;
+
+    if (timeout_usec)
+        deadline = sensirion_get_time_usec() + timeout_usec;
+
+    while (len < max_len) {
+        ret = sensirion_uart_rx(max_len - len, rx_frame + len);
+        if (ret < 0)
+            return len ? (int16_t)len : ret;
+
+        if (ret > 0) {
+            if (timestamps) {
+                now = sensirion_get_time_usec();
+                if (!len)
+                    timestamps->first_byte_usec = now;
+                timestamps->last_byte_usec = now;
+            }
+            i = len ? len : 1;
+            len += (uint16_t)ret;
+
+            if (rx_frame[0] != SHDLC_START)
+                break;
+            while (i < len && rx_frame[i] != SHDLC_STOP)
+                ++i;
+            if (i < len)
+                break;
+            continue;
+        }
+
+        if (!timeout_usec || sensirion_get_time_usec() >= deadline)
+            break;
+        sensirion_sleep_usec(RX_POLL_US);
+    }
+    return (int16_t)len;
+}
+
+static int16_t
+sensirion_shdlc_rx_decode(const uint8_t* rx_frame, int16_t len,
+                          uint8_t max_data_len,
+                          struct sensirion_shdlc_rx_header* rxh,
+                          uint8_t* data) {
     uint16_t i;
-    uint8_t rx_frame[SHDLC_FRAME_MAX_RX_FRAME_SIZE];
     uint8_t* rx_header = (uint8_t*)rxh;
     uint8_t j;
     uint8_t crc;
     uint8_t unstuff_next;
 
-    len = sensirion_uart_rx(2 + (5 + (uint16_t)max_data_len) * 2, rx_frame);
     if (len < 1 || rx_frame[0] != SHDLC_START)
         return SENSIRION_SHDLC_ERR_MISSING_START;
 
@@ -258,5 +575,59 @@ int16_t sensirion_shdlc_rx(uint8_t max_data_len,
     if (i >= len || rx_frame[i] != SHDLC_STOP)
         return SENSIRION_SHDLC_ERR_MISSING_STOP;
 
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+    ++shdlc_stats.frames_rx;
+    shdlc_stats.bytes_rx += (uint16_t)len;
+    shdlc_stats.stuffed_bytes_rx += (uint16_t)len - (rxh->data_len + 7u);
+#endif
     return 0;
 }
+
+static int16_t
+sensirion_shdlc_rx_internal(uint8_t max_data_len,
+                            struct sensirion_shdlc_rx_header* rxh,
+                            uint8_t* data, uint32_t timeout_usec,
+                            struct sensirion_shdlc_rx_timestamps* timestamps) {
+    uint8_t rx_frame[SHDLC_FRAME_MAX_RX_FRAME_SIZE];
+    int16_t len;
+    int16_t ret;
+
+    len = sensirion_shdlc_rx_frame(2 + (5 + (uint16_t)max_data_len) * 2,
+                                   rx_frame, timeout_usec, timestamps);
+    ret = sensirion_shdlc_rx_decode(rx_frame, len, max_data_len, rxh, data);
+#ifdef SENSIRION_SHDLC_CAPTURE
+    sensirion_shdlc_capture_frame(SENSIRION_SHDLC_CAPTURE_RX, ret, rx_frame,
+                                  len < 0 ? 0 : (uint16_t)len);
+#endif
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+    if (ret)
+        sensirion_shdlc_count_error(shdlc_stats.errors, ret);
+#endif
+    return ret;
+}
+
+int16_t sensirion_shdlc_rx(uint8_t max_data_len,
+                           struct sensirion_shdlc_rx_header* rxh,
+                           uint8_t* data) {
+    return sensirion_shdlc_rx_internal(
+        max_data_len, rxh, data, SENSIRION_SHDLC_RX_TIMEOUT_USEC,
+        (struct sensirion_shdlc_rx_timestamps*)NULL);
+}
+
+int16_t
+sensirion_shdlc_rx_ts(uint8_t max_data_len,
+                      struct sensirion_shdlc_rx_header* rxh, uint8_t* data,
+                      struct sensirion_shdlc_rx_timestamps* timestamps) {
+    return sensirion_shdlc_rx_internal(max_data_len, rxh, data,
+                                       SENSIRION_SHDLC_RX_TIMEOUT_USEC,
+                                       timestamps);
+}
+
+int16_t
+sensirion_shdlc_rx_timeout(uint8_t max_data_len,
+                           struct sensirion_shdlc_rx_header* rxh,
+                           uint8_t* data, uint32_t timeout_usec,
+                           struct sensirion_shdlc_rx_timestamps* timestamps) {
+    return sensirion_shdlc_rx_internal(max_data_len, rxh, data, timeout_usec,
+                                       timestamps);
+}
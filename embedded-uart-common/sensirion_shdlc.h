@@ -46,6 +46,165 @@ extern "C" {
 #define SENSIRION_SHDLC_ERR_TX_INCOMPLETE -6
 #define SENSIRION_SHDLC_ERR_FRAME_TOO_LONG -7
 
+/**
+ * Maximum time the receive functions wait for a complete response frame
+ * before giving up.
+ */
+#ifndef SENSIRION_SHDLC_RX_TIMEOUT_USEC
+#define SENSIRION_SHDLC_RX_TIMEOUT_USEC 100000
+#endif
+
+/**
+ * sensirion_shdlc_set_port() - tell the SHDLC layer the selected UART port
+ *
+ * Called by the drivers when the UART port is selected, so that the
+ * instrumentation and the capture keep sensors with the same SHDLC address on
+ * different ports apart.
+ *
+ * @port:   UART port index
+ */
+void sensirion_shdlc_set_port(uint8_t port);
+
+#ifdef SENSIRION_SHDLC_CAPTURE
+
+#define SENSIRION_SHDLC_CAPTURE_TX 0
+#define SENSIRION_SHDLC_CAPTURE_RX 1
+
+/**
+ * Capture callback, called with every raw (stuffed) frame sent or received
+ *
+ * @user_data:      Pointer passed to sensirion_shdlc_set_capture()
+ * @direction:      SENSIRION_SHDLC_CAPTURE_TX or SENSIRION_SHDLC_CAPTURE_RX
+ * @port:           Port set with sensirion_shdlc_set_port()
+ * @timestamp_usec: Time of the transmission or the end of the reception from
+ *                  sensirion_get_time_usec()
+ * @result:         0 or the error code of the transmission or reception
+ * @frame:          Raw frame as sent or received, possibly incomplete on
+ *                  errors
+ * @len:            Length of the frame in bytes
+ */
+typedef void (*sensirion_shdlc_capture_fn)(void* user_data, uint8_t direction,
+                                           uint8_t port,
+                                           uint64_t timestamp_usec,
+                                           int16_t result,
+                                           const uint8_t* frame, uint16_t len);
+
+/**
+ * sensirion_shdlc_set_capture() - install or remove the capture callback
+ *
+ * The callback runs synchronously in sensirion_shdlc_tx() and the receive
+ * functions and must return quickly.
+ *
+ * The callback and user_data are published atomically, thus capturing can be
+ * started and stopped while another thread runs transactions. A transaction
+ * in progress may still call the previous callback, possibly with the new
+ * user_data: replace one capture by another and release the user_data of a
+ * stopped capture only while no transaction runs.
+ *
+ * @capture:    Callback, NULL to stop capturing
+ * @user_data:  Pointer passed to the callback
+ */
+void sensirion_shdlc_set_capture(sensirion_shdlc_capture_fn capture,
+                                 void* user_data);
+
+#endif /* SENSIRION_SHDLC_CAPTURE */
+
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+#include "sensirion_uart.h"
+#endif
+
+/**
+ * Number of distinct (port, addr, cmd) combinations for which transactions
+ * are recorded. Transactions of further commands are only counted in
+ * untracked_transactions.
+ */
+#ifndef SENSIRION_SHDLC_STATS_MAX_COMMANDS
+#define SENSIRION_SHDLC_STATS_MAX_COMMANDS 16
+#endif
+
+/**
+ * Latency histogram: bucket i counts transactions which took less than
+ * SENSIRION_SHDLC_LATENCY_BUCKET_USEC << i, the last bucket all slower ones.
+ */
+#define SENSIRION_SHDLC_LATENCY_BUCKET_USEC 1024
+#define SENSIRION_SHDLC_LATENCY_BUCKETS 12
+
+/* Errors are counted at index -error, other error codes at index 0 */
+#define SENSIRION_SHDLC_NUM_ERROR_CODES 8
+
+struct sensirion_shdlc_command_stats {
+    uint8_t port;
+    uint8_t addr;
+    uint8_t cmd;
+    uint32_t transactions;
+    uint32_t errors[SENSIRION_SHDLC_NUM_ERROR_CODES];
+    uint32_t latency_buckets[SENSIRION_SHDLC_LATENCY_BUCKETS];
+    uint32_t max_latency_usec;
+    uint64_t sum_latency_usec;
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+    /* UART errors which occurred during the transactions */
+    struct sensirion_uart_error_counters uart_errors;
+#endif
+};
+
+struct sensirion_shdlc_stats {
+    uint32_t frames_tx;
+    uint32_t bytes_tx;
+    uint32_t stuffed_bytes_tx; /* bytes added by byte stuffing */
+    uint32_t frames_rx;        /* valid frames received */
+    uint32_t bytes_rx;
+    uint32_t stuffed_bytes_rx;
+    uint32_t errors[SENSIRION_SHDLC_NUM_ERROR_CODES]; /* tx and rx errors */
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+    /* UART errors which occurred during transactions */
+    struct sensirion_uart_error_counters uart_errors;
+#endif
+    uint32_t untracked_transactions;
+    uint8_t num_commands;
+    struct sensirion_shdlc_command_stats
+        commands[SENSIRION_SHDLC_STATS_MAX_COMMANDS];
+};
+
+/**
+ * sensirion_shdlc_get_stats() - take a snapshot of the instrumentation
+ *
+ * Frames and bytes are counted for all transmissions and receptions, the
+ * per command statistics with latency for transceived frames
+ * (sensirion_shdlc_xcv() and sensirion_shdlc_xcv_ts()). The latency includes
+ * transmission, response delay and reception.
+ *
+ * If SENSIRION_UART_ERROR_COUNTERS is defined, the UART error counters are
+ * read before and after each transceived command and the differences are
+ * attributed to the command, e.g. to tell overruns (CPU load) from framing
+ * errors (wiring) behind CRC and encoding errors.
+ *
+ * The statistics are not synchronized, call this function from the thread
+ * which talks to the sensors.
+ *
+ * @stats:  Memory where the statistics are stored
+ */
+void sensirion_shdlc_get_stats(struct sensirion_shdlc_stats* stats);
+
+/**
+ * sensirion_shdlc_reset_stats() - clear all instrumentation counters
+ */
+void sensirion_shdlc_reset_stats(void);
+
+/**
+ * sensirion_shdlc_latency_percentile() - estimate a latency percentile
+ *
+ * @stats:      Statistics of a command
+ * @percentile: Percentile in percent, e.g. 99
+ * Return:      Upper bound of the histogram bucket containing the percentile,
+ *              capped at the maximum latency, 0 if there are no transactions
+ */
+uint32_t sensirion_shdlc_latency_percentile(
+    const struct sensirion_shdlc_command_stats* stats, uint8_t percentile);
+
+#endif /* SENSIRION_SHDLC_INSTRUMENTATION */
+
 /**
  * sensirion_bytes_to_int16_t() - Convert an array of bytes to an int16_t
  *
@@ -101,6 +260,23 @@ uint32_t sensirion_bytes_to_uint32_t(const uint8_t* bytes);
  */
 float sensirion_bytes_to_float(const uint8_t* bytes);
 
+/**
+ * sensirion_bytes_to_float_array() - Convert an array of bytes to an array of
+ * floats
+ *
+ * Convert consecutive big-endian/MSB-first 32 bit floats, e.g. the data of a
+ * measurement response or of logged raw frames, in one batch. Four values at
+ * a time are byte-swapped with SSE2/SSSE3 or NEON instructions when the
+ * compiler targets them (e.g. -mssse3), unless SENSIRION_NO_SIMD is defined.
+ * Otherwise each value is converted with sensirion_bytes_to_float().
+ *
+ * @param bytes         An array of at least 4 * num_values bytes (MSB first)
+ * @param values        An array of at least num_values floats
+ * @param num_values    Number of values to convert
+ */
+void sensirion_bytes_to_float_array(const uint8_t* bytes, float* values,
+                                    uint16_t num_values);
+
 /**
  * sensirion_uint32_t_to_bytes() - Convert an uint32_t to an array of bytes
  *
@@ -163,6 +339,15 @@ struct sensirion_shdlc_rx_header {
     uint8_t data_len;
 };
 
+/**
+ * Arrival times of a received SHDLC frame as reported by
+ * sensirion_get_time_usec()
+ */
+struct sensirion_shdlc_rx_timestamps {
+    uint64_t first_byte_usec;
+    uint64_t last_byte_usec;
+};
+
 /**
  * sensirion_shdlc_tx() - transmit an SHDLC frame
  *
@@ -170,7 +355,8 @@ struct sensirion_shdlc_rx_header {
  * @cmd:        command parameter
  * @data_len:   data length to send
  * @data:       data to send
- * Return:      0 on success, an error code otherwise
+ * Return:      0 on success, SENSIRION_SHDLC_ERR_TX_INCOMPLETE if the UART
+ *              failed to send the whole frame
  */
 int16_t sensirion_shdlc_tx(uint8_t addr, uint8_t cmd, uint8_t data_len,
                            const uint8_t* data);
@@ -178,6 +364,9 @@ int16_t sensirion_shdlc_tx(uint8_t addr, uint8_t cmd, uint8_t data_len,
 /**
  * sensirion_shdlc_rx() - receive an SHDLC frame
  *
+ * The UART is polled until the frame is complete or
+ * SENSIRION_SHDLC_RX_TIMEOUT_USEC elapsed.
+ *
  * Note that the header and data must be discarded on failure
  *
  * @data_len:   max data length to receive
@@ -190,6 +379,52 @@ int16_t sensirion_shdlc_rx(uint8_t max_data_len,
                            struct sensirion_shdlc_rx_header* header,
                            uint8_t* data);
 
+/**
+ * sensirion_shdlc_rx_ts() - receive an SHDLC frame and timestamp its arrival
+ *
+ * Same as sensirion_shdlc_rx() but the arrival times of the frame are stored.
+ * Like sensirion_shdlc_rx(), it can be called immediately after the request
+ * was sent.
+ *
+ * Note that the header, data and timestamps must be discarded on failure
+ *
+ * @data_len:   max data length to receive
+ * @header:     Memory where the SHDLC header containing the sender address,
+ *              command, sensor state and data length is stored
+ * @data:       Memory where received data is stored
+ * @timestamps: Memory where the arrival times of the first and the last byte
+ *              of the frame are stored
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t
+sensirion_shdlc_rx_ts(uint8_t max_data_len,
+                      struct sensirion_shdlc_rx_header* header, uint8_t* data,
+                      struct sensirion_shdlc_rx_timestamps* timestamps);
+
+/**
+ * sensirion_shdlc_rx_timeout() - receive an SHDLC frame with a custom timeout
+ *
+ * Same as sensirion_shdlc_rx_ts() but the UART is polled for at most
+ * timeout_usec, e.g. to probe for a response at short intervals.
+ *
+ * Note that the header, data and timestamps must be discarded on failure
+ *
+ * @data_len:       max data length to receive
+ * @header:         Memory where the SHDLC header containing the sender
+ *                  address, command, sensor state and data length is stored
+ * @data:           Memory where received data is stored
+ * @timeout_usec:   Maximum time to wait for a complete frame, 0 to only read
+ *                  the data already available
+ * @timestamps:     Optional memory where the arrival times of the first and
+ *                  the last byte of the frame are stored
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t
+sensirion_shdlc_rx_timeout(uint8_t max_data_len,
+                           struct sensirion_shdlc_rx_header* header,
+                           uint8_t* data, uint32_t timeout_usec,
+                           struct sensirion_shdlc_rx_timestamps* timestamps);
+
 /**
  * sensirion_shdlc_xcv() - transceive (transmit then receive) an SHDLC frame
  *
@@ -209,6 +444,33 @@ int16_t sensirion_shdlc_xcv(uint8_t addr, uint8_t cmd, uint8_t tx_data_len,
                             struct sensirion_shdlc_rx_header* rx_header,
                             uint8_t* rx_data);
 
+/**
+ * sensirion_shdlc_xcv_ts() - transceive an SHDLC frame and timestamp the
+ * arrival of the response
+ *
+ * Instead of sleeping for a fixed delay between transmission and reception,
+ * the response is polled for, see sensirion_shdlc_rx_ts().
+ *
+ * Note that rx_header, rx_data and timestamps must be discarded on failure
+ *
+ * @addr:           recipient address
+ * @cmd:            parameter
+ * @tx_data_len:    data length to send
+ * @tx_data:        data to send
+ * @rx_header:      Memory where the SHDLC header containing the sender address,
+ *                  command, sensor state and data length is stored
+ * @rx_data:        Memory where the received data is stored
+ * @timestamps:     Memory where the arrival times of the first and the last
+ *                  byte of the response are stored
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t
+sensirion_shdlc_xcv_ts(uint8_t addr, uint8_t cmd, uint8_t tx_data_len,
+                       const uint8_t* tx_data, uint8_t max_rx_data_len,
+                       struct sensirion_shdlc_rx_header* rx_header,
+                       uint8_t* rx_data,
+                       struct sensirion_shdlc_rx_timestamps* timestamps);
+
 #ifdef __cplusplus
 }
 #endif
@@ -73,6 +73,10 @@ int16_t sensirion_uart_tx(uint16_t data_len, const uint8_t* data);
 /**
  * sensirion_uart_rx() - receive data over UART
  *
+ * The function must not block: if no data is available it should return 0
+ * immediately. The SHDLC layer polls it until a frame is complete or its
+ * timeout elapsed, any time spent blocking delays these timeouts.
+ *
  * @data_len:   max number of bytes to receive
  * @data:       Memory where received data is stored
  * Return:      Number of bytes received or a negative error code
@@ -89,6 +93,50 @@ int16_t sensirion_uart_rx(uint16_t max_data_len, uint8_t* data);
  */
 void sensirion_sleep_usec(uint32_t useconds);
 
+/**
+ * Return the current time of a monotonic clock in microseconds.
+ *
+ * The clock must never jump backwards. Its epoch is arbitrary (e.g. boot
+ * time), thus only differences between two values are meaningful. It
+ * timestamps received frames and drives every timeout and deadline: the
+ * receive timeout of sensirion_shdlc_rx(), sps30_wait_ready(), the
+ * sps30_read_measurement_ts() scheduling, the supervisor backoff and the
+ * reader service period. A real clock is required, a constant value lets
+ * these timeouts never expire.
+ *
+ * @return the current time in microseconds
+ */
+uint64_t sensirion_get_time_usec(void);
+
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+
+/**
+ * Cumulative error counters of the UART hardware
+ */
+struct sensirion_uart_error_counters {
+    uint32_t frame_errors;  /* wrong stop bit, e.g. noise or wrong baud rate */
+    uint32_t parity_errors;
+    uint32_t overruns;      /* received data lost, e.g. due to CPU load */
+    uint32_t breaks;
+};
+
+/**
+ * sensirion_uart_get_error_counters() - read the UART error counters
+ *                                       THE IMPLEMENTATION IS OPTIONAL, only
+ *                                       used if SENSIRION_UART_ERROR_COUNTERS
+ *                                       is defined
+ *
+ * The counters are cumulative and only differences between two reads are
+ * evaluated.
+ *
+ * @counters:   Memory where the counters are stored
+ * Return:      0 on success, an error code if the counters are not available
+ */
+int16_t sensirion_uart_get_error_counters(
+    struct sensirion_uart_error_counters* counters);
+
+#endif /* SENSIRION_UART_ERROR_COUNTERS */
+
 #ifdef __cplusplus
 }
 #endif
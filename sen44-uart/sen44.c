@@ -95,16 +95,24 @@ int16_t sen44_stop_measurement(void) {
                                (uint8_t*)NULL, 0, &header, (uint8_t*)NULL);
 }
 
-int16_t sen44_read_measurement(struct sen44_measurement* measurement) {
+static int16_t
+sen44_read_measurement_internal(struct sen44_measurement* measurement,
+                                struct sensirion_shdlc_rx_timestamps* ts) {
     struct sensirion_shdlc_rx_header header;
     uint8_t param_buf[] = SEN44_SUBCMD_READ_MEASUREMENT;
     int16_t error;
     uint16_t idx;
     uint16_t data[sizeof(struct sen44_measurement) / sizeof(int16_t)];
 
-    error = sensirion_shdlc_xcv(SEN44_ADDR, SEN44_CMD_READ_MEASUREMENT,
-                                sizeof(param_buf), param_buf, sizeof(data),
-                                &header, (uint8_t*)data);
+    if (ts) {
+        error = sensirion_shdlc_xcv_ts(
+            SEN44_ADDR, SEN44_CMD_READ_MEASUREMENT, sizeof(param_buf),
+            param_buf, sizeof(data), &header, (uint8_t*)data, ts);
+    } else {
+        error = sensirion_shdlc_xcv(SEN44_ADDR, SEN44_CMD_READ_MEASUREMENT,
+                                    sizeof(param_buf), param_buf, sizeof(data),
+                                    &header, (uint8_t*)data);
+    }
     if (error) {
         return error;
     }
@@ -138,6 +146,133 @@ int16_t sen44_read_measurement(struct sen44_measurement* measurement) {
     return 0;
 }
 
+int16_t sen44_read_measurement(struct sen44_measurement* measurement) {
+    return sen44_read_measurement_internal(
+        measurement, (struct sensirion_shdlc_rx_timestamps*)NULL);
+}
+
+int16_t
+sen44_read_measurement_ts(struct sen44_measurement* measurement,
+                          struct sensirion_shdlc_rx_timestamps* timestamps) {
+    return sen44_read_measurement_internal(measurement, timestamps);
+}
+
+float sen44_get_measurement_field(const struct sen44_measurement* measurement,
+                                  enum sen44_measurement_field field) {
+    switch (field) {
+        case SEN44_FIELD_MC_1P0:
+            return measurement->mc_1p0;
+        case SEN44_FIELD_MC_2P5:
+            return measurement->mc_2p5;
+        case SEN44_FIELD_MC_4P0:
+            return measurement->mc_4p0;
+        case SEN44_FIELD_MC_10P0:
+            return measurement->mc_10p0;
+        case SEN44_FIELD_VOC_INDEX:
+            return measurement->voc_index / 10.0f;
+        case SEN44_FIELD_AMBIENT_TEMPERATURE:
+            return measurement->ambient_temperature / 200.0f;
+        case SEN44_FIELD_AMBIENT_HUMIDITY:
+            return measurement->ambient_humidity / 100.0f;
+        default:
+            return 0;
+    }
+}
+
+static const char* const sen44_field_names[SEN44_NUM_FIELDS] = {
+    "mc_1p0",
+    "mc_2p5",
+    "mc_4p0",
+    "mc_10p0",
+    "voc_index",
+    "ambient_temperature",
+    "ambient_humidity",
+};
+
+const char*
+sen44_get_measurement_field_name(enum sen44_measurement_field field) {
+    if ((unsigned)field >= SEN44_NUM_FIELDS)
+        return (const char*)NULL;
+    return sen44_field_names[field];
+}
+
+int16_t sen44_format_measurement(char* buf, uint16_t size,
+                                enum sps_format_style style,
+                                const struct sen44_measurement* measurement) {
+    static const uint8_t decimals[SEN44_NUM_FIELDS] = {0, 0, 0, 0, 1, 2, 2};
+    float values[SEN44_NUM_FIELDS];
+    uint8_t i;
+
+    if (style != SPS_FORMAT_CSV_HEADER) {
+        for (i = 0; i < SEN44_NUM_FIELDS; ++i)
+            values[i] = sen44_get_measurement_field(
+                measurement, (enum sen44_measurement_field)i);
+    }
+    return sps_format_line(buf, size, style, sen44_field_names, values,
+                           decimals, SEN44_NUM_FIELDS);
+}
+
+int16_t sen44_cbor_encode_measurement(
+    struct sps_cbor_writer* writer, uint64_t timestamp_usec,
+    const struct sen44_measurement* measurement) {
+    sps_cbor_write_array(writer, 1 + SEN44_NUM_FIELDS);
+    sps_cbor_write_uint(writer, timestamp_usec);
+    sps_cbor_write_uint(writer, measurement->mc_1p0);
+    sps_cbor_write_uint(writer, measurement->mc_2p5);
+    sps_cbor_write_uint(writer, measurement->mc_4p0);
+    sps_cbor_write_uint(writer, measurement->mc_10p0);
+    sps_cbor_write_int(writer, measurement->voc_index);
+    sps_cbor_write_int(writer, measurement->ambient_temperature);
+    sps_cbor_write_int(writer, measurement->ambient_humidity);
+    return sps_cbor_writer_commit(writer);
+}
+
+int16_t sen44_cbor_decode_measurement(struct sps_cbor_reader* reader,
+                                      uint64_t* timestamp_usec,
+                                      struct sen44_measurement* measurement) {
+    struct sps_cbor_reader r = *reader;
+    int64_t values[SEN44_NUM_FIELDS];
+    int32_t min;
+    int32_t max;
+    uint16_t count;
+    int16_t ret;
+    uint8_t i;
+
+    ret = sps_cbor_read_array(&r, &count);
+    if (ret)
+        return ret;
+    if (count != 1 + SEN44_NUM_FIELDS)
+        return SPS_CBOR_ERR_TYPE;
+    ret = sps_cbor_read_uint(&r, timestamp_usec);
+    for (i = 0; i < SEN44_NUM_FIELDS && !ret; ++i) {
+        ret = sps_cbor_read_int(&r, &values[i]);
+        /* mass concentrations are unsigned, the other fields signed */
+        if (i < SEN44_FIELD_VOC_INDEX) {
+            min = 0;
+            max = 0xffff;
+        } else {
+            min = -0x8000;
+            max = 0x7fff;
+        }
+        if (!ret && (values[i] < min || values[i] > max))
+            ret = SPS_CBOR_ERR_TYPE;
+    }
+    if (ret)
+        return ret;
+
+    measurement->mc_1p0 = (uint16_t)values[SEN44_FIELD_MC_1P0];
+    measurement->mc_2p5 = (uint16_t)values[SEN44_FIELD_MC_2P5];
+    measurement->mc_4p0 = (uint16_t)values[SEN44_FIELD_MC_4P0];
+    measurement->mc_10p0 = (uint16_t)values[SEN44_FIELD_MC_10P0];
+    measurement->voc_index = (int16_t)values[SEN44_FIELD_VOC_INDEX];
+    measurement->ambient_temperature =
+        (int16_t)values[SEN44_FIELD_AMBIENT_TEMPERATURE];
+    measurement->ambient_humidity =
+        (int16_t)values[SEN44_FIELD_AMBIENT_HUMIDITY];
+    *reader = r;
+    return 0;
+}
+
 int16_t
 sen44_read_version(struct sen44_version_information* version_information) {
     struct sensirion_shdlc_rx_header header;
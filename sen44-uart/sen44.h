@@ -37,6 +37,9 @@ extern "C" {
 #endif
 
 #include "sensirion_arch_config.h"
+#include "sensirion_shdlc.h"
+#include "sps_cbor.h"
+#include "sps_format.h"
 
 #define SEN44_MAX_SERIAL_LEN 32
 #define SEN44_ERR_NOT_ENOUGH_DATA (-1)
@@ -54,6 +57,24 @@ struct sen44_measurement {
     int16_t ambient_humidity;
 };
 
+/**
+ * Fields of struct sen44_measurement, e.g. to process them generically with
+ * sen44_get_measurement_field()
+ */
+enum sen44_measurement_field {
+    SEN44_FIELD_MC_1P0,
+    SEN44_FIELD_MC_2P5,
+    SEN44_FIELD_MC_4P0,
+    SEN44_FIELD_MC_10P0,
+    SEN44_FIELD_VOC_INDEX,
+    SEN44_FIELD_AMBIENT_TEMPERATURE,
+    SEN44_FIELD_AMBIENT_HUMIDITY,
+    SEN44_NUM_FIELDS,
+};
+
+/* Buffer size to fit any measurement formatted by sen44_format_measurement() */
+#define SEN44_FORMAT_MAX_LEN 256
+
 struct sen44_version_information {
     uint8_t firmware_major;
     uint8_t firmware_minor;
@@ -115,6 +136,100 @@ int16_t sen44_stop_measurement(void);
  */
 int16_t sen44_read_measurement(struct sen44_measurement* measurement);
 
+/**
+ * sen44_read_measurement_ts() - read a measurement and timestamp its arrival
+ *
+ * Read the last measurement. In contrast to sen44_read_measurement(), the
+ * response is polled for instead of waiting a fixed delay and the arrival
+ * times of the first and last byte of the response are recorded with
+ * sensirion_get_time_usec().
+ *
+ * Note that measurement and timestamps must be discarded when the return code
+ * is negative.
+ *
+ * @param measurement Memory where the measurement is stored
+ * @param timestamps Memory where the arrival times are stored
+ * @return 0 on success, an error code otherwise
+ */
+int16_t
+sen44_read_measurement_ts(struct sen44_measurement* measurement,
+                          struct sensirion_shdlc_rx_timestamps* timestamps);
+
+/**
+ * sen44_get_measurement_field() - get a field of a measurement by index
+ *
+ * In contrast to struct sen44_measurement, the value is not scaled, i.e. the
+ * VOC index, degree Celsius and %RH are returned.
+ *
+ * @param measurement Measurement to read the field from
+ * @param field Field to read
+ * @return The value of the field, 0 if field is invalid
+ */
+float sen44_get_measurement_field(const struct sen44_measurement* measurement,
+                                  enum sen44_measurement_field field);
+
+/**
+ * sen44_get_measurement_field_name() - get the name of a measurement field
+ *
+ * @param field Field to get the name of
+ * @return      The name of the field, e.g. "mc_2p5", NULL if field is invalid
+ */
+const char*
+sen44_get_measurement_field_name(enum sen44_measurement_field field);
+
+/**
+ * sen44_format_measurement() - format a measurement as CSV or JSON line
+ *
+ * Mass concentrations are formatted without decimals, the VOC index with one
+ * and temperature and humidity with two decimals, e.g.
+ * {"mc_1p0":3,...,"ambient_temperature":23.50,"ambient_humidity":45.20}
+ *
+ * @param buf           Buffer to write the zero terminated line to, at least
+ *                      SEN44_FORMAT_MAX_LEN bytes long to fit any measurement
+ * @param size          Size of buf
+ * @param style         Output format, see sps_format_line()
+ * @param measurement   Measurement to format, unused for
+ *                      SPS_FORMAT_CSV_HEADER
+ * @return              Length of the line on success, an error code otherwise
+ */
+int16_t sen44_format_measurement(char* buf, uint16_t size,
+                                enum sps_format_style style,
+                                const struct sen44_measurement* measurement);
+
+/**
+ * sen44_cbor_encode_measurement() - append a timestamped measurement as CBOR
+ *
+ * The record is an array of the timestamp followed by the fields of struct
+ * sen44_measurement as integers, in the order of enum
+ * sen44_measurement_field and with the scaling of struct sen44_measurement.
+ * If the record does not fit, the writer is left unchanged, e.g. to flush the
+ * buffer and retry.
+ *
+ * @param writer            Writer to append to
+ * @param timestamp_usec    Timestamp of the measurement
+ * @param measurement       Measurement to append
+ * @return                  0 on success, SPS_CBOR_ERR_BUFFER_FULL if the
+ *                          record does not fit
+ */
+int16_t sen44_cbor_encode_measurement(
+    struct sps_cbor_writer* writer, uint64_t timestamp_usec,
+    const struct sen44_measurement* measurement);
+
+/**
+ * sen44_cbor_decode_measurement() - read a record written by
+ * sen44_cbor_encode_measurement()
+ *
+ * The reader is only advanced if the record was read successfully.
+ *
+ * @param reader            Reader to read from
+ * @param timestamp_usec    Memory where the timestamp is stored
+ * @param measurement       Memory where the measurement is stored
+ * @return                  0 on success, an error code otherwise
+ */
+int16_t sen44_cbor_decode_measurement(struct sps_cbor_reader* reader,
+                                      uint64_t* timestamp_usec,
+                                      struct sen44_measurement* measurement);
+
 /**
  * sen44_read_version() - Read version information.
  *
@@ -44,6 +44,7 @@ int main(void) {
     struct sen44_measurement m;
     struct sen44_version_information version_information;
     char serial[SEN44_MAX_SERIAL_LEN];
+    char line[SEN44_FORMAT_MAX_LEN];
     uint32_t device_register;
     int16_t error;
 
@@ -102,16 +103,8 @@ int main(void) {
                        SEN44_GET_ERR_STATE(error));
             }
 
-            printf("measured values:\n"
-                   "\t%i pm1.0\n"
-                   "\t%i pm2.5\n"
-                   "\t%i pm4.0\n"
-                   "\t%i pm10.0\n"
-                   "\t%.1f VOC Index\n"
-                   "\t%.2f degree Celsius\n"
-                   "\t%.2f %%RH\n",
-                   m.mc_1p0, m.mc_2p5, m.mc_4p0, m.mc_10p0, m.voc_index / 10.0,
-                   m.ambient_temperature / 200.0, m.ambient_humidity / 100.0);
+            sen44_format_measurement(line, sizeof(line), SPS_FORMAT_JSON, &m);
+            printf("measured values: %s", line);
         }
 
         sensirion_sleep_usec(1000000); /* sleep for 1s */
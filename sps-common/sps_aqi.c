@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_aqi.h"
+
+#define SPS_AQI_HOUR_USEC 3600000000ULL
+#define SPS_AQI_NO_DATA 0xffffffff
+
+static const struct sps_aqi_breakpoint sps_aqi_epa_pm2p5_breakpoints[] = {
+    SPS_AQI_BREAKPOINT(0, 90, 0, 50),
+    SPS_AQI_BREAKPOINT(91, 354, 51, 100),
+    SPS_AQI_BREAKPOINT(355, 554, 101, 150),
+    SPS_AQI_BREAKPOINT(555, 1254, 151, 200),
+    SPS_AQI_BREAKPOINT(1255, 2254, 201, 300),
+    SPS_AQI_BREAKPOINT(2255, 3254, 301, 500),
+};
+
+static const struct sps_aqi_breakpoint sps_aqi_epa_pm10_breakpoints[] = {
+    SPS_AQI_BREAKPOINT(0, 540, 0, 50),
+    SPS_AQI_BREAKPOINT(550, 1540, 51, 100),
+    SPS_AQI_BREAKPOINT(1550, 2540, 101, 150),
+    SPS_AQI_BREAKPOINT(2550, 3540, 151, 200),
+    SPS_AQI_BREAKPOINT(3550, 4240, 201, 300),
+    SPS_AQI_BREAKPOINT(4250, 6040, 301, 500),
+};
+
+const struct sps_aqi_table sps_aqi_epa_pm2p5 = {
+    sps_aqi_epa_pm2p5_breakpoints,
+    sizeof(sps_aqi_epa_pm2p5_breakpoints) /
+        sizeof(sps_aqi_epa_pm2p5_breakpoints[0]),
+    1};
+
+const struct sps_aqi_table sps_aqi_epa_pm10 = {
+    sps_aqi_epa_pm10_breakpoints,
+    sizeof(sps_aqi_epa_pm10_breakpoints) /
+        sizeof(sps_aqi_epa_pm10_breakpoints[0]),
+    10};
+
+uint32_t sps_aqi_float_to_tenths(float value) {
+    union {
+        uint32_t u32_value;
+        float float32;
+    } tmp;
+    uint32_t hundredths;
+    int16_t shift;
+
+    tmp.float32 = value;
+    /* Negative, zero, subnormal or NaN */
+    if ((tmp.u32_value >> 31) || (tmp.u32_value >> 23) == 0 ||
+        ((tmp.u32_value >> 23) == 0xff && (tmp.u32_value & 0x7fffff)))
+        return 0;
+
+    /* value * 100 = mantissa * 100 * 2^shift, mantissa * 100 < 2^31 */
+    shift = (int16_t)((tmp.u32_value >> 23) - 150);
+    hundredths = ((tmp.u32_value & 0x7fffff) | 0x800000) * 100;
+    if (shift > 0)
+        return 0xffffffff;
+    if (shift <= -32)
+        return 0;
+    if (shift < 0)
+        hundredths = (hundredths + (1UL << (-shift - 1))) >> -shift;
+    return hundredths / 10;
+}
+
+uint16_t sps_aqi_sub_index(const struct sps_aqi_table* table,
+                           uint32_t concentration_tenths) {
+    const struct sps_aqi_breakpoint* bp = table->breakpoints;
+    uint32_t c = concentration_tenths;
+    uint8_t i;
+
+    if (table->resolution_tenths > 1)
+        c -= c % table->resolution_tenths;
+
+    for (i = 0; i < table->num_breakpoints; ++i, ++bp) {
+        /* Concentrations between two breakpoints belong to the upper one */
+        if (c <= bp->c_hi) {
+            if (c < bp->c_lo)
+                c = bp->c_lo;
+            return (uint16_t)(bp->i_lo +
+                              (((c - bp->c_lo) * bp->slope_q24 + 0x800000) >>
+                               24));
+        }
+    }
+    return table->breakpoints[table->num_breakpoints - 1].i_hi;
+}
+
+void sps_aqi_nowcast_init(struct sps_aqi_nowcast* nowcast) {
+    uint8_t i;
+
+    nowcast->hour_end_usec = 0;
+    nowcast->hour_sum = 0;
+    nowcast->hour_count = 0;
+    nowcast->newest = 0;
+    nowcast->started = 0;
+    nowcast->valid = 0;
+    nowcast->value = 0;
+    for (i = 0; i < SPS_AQI_NOWCAST_HOURS; ++i)
+        nowcast->hourly[i] = SPS_AQI_NO_DATA;
+}
+
+/* Hourly average of i hours ago, 0 being the most recent completed hour */
+static uint32_t sps_aqi_nowcast_hour(const struct sps_aqi_nowcast* nowcast,
+                                     uint8_t i) {
+    return nowcast->hourly[(nowcast->newest + SPS_AQI_NOWCAST_HOURS - i) %
+                           SPS_AQI_NOWCAST_HOURS];
+}
+
+static void sps_aqi_nowcast_update(struct sps_aqi_nowcast* nowcast) {
+    uint32_t c;
+    uint32_t c_min = SPS_AQI_NO_DATA;
+    uint32_t c_max = 0;
+    uint32_t w_q16;
+    uint32_t weight = 65536;
+    uint64_t sum = 0;
+    uint64_t weights = 0;
+    uint8_t recent = 0;
+    uint8_t i;
+
+    for (i = 0; i < SPS_AQI_NOWCAST_HOURS; ++i) {
+        c = sps_aqi_nowcast_hour(nowcast, i);
+        if (c == SPS_AQI_NO_DATA)
+            continue;
+        if (i < 3)
+            ++recent;
+        if (c < c_min)
+            c_min = c;
+        if (c > c_max)
+            c_max = c;
+    }
+    nowcast->valid = recent >= 2;
+    if (!nowcast->valid)
+        return;
+
+    w_q16 = c_max ? (uint32_t)(((uint64_t)c_min << 16) / c_max) : 65536;
+    if (w_q16 < 32768)
+        w_q16 = 32768;
+
+    for (i = 0; i < SPS_AQI_NOWCAST_HOURS; ++i) {
+        c = sps_aqi_nowcast_hour(nowcast, i);
+        if (c != SPS_AQI_NO_DATA) {
+            sum += (uint64_t)weight * c;
+            weights += weight;
+        }
+        weight = (uint32_t)(((uint64_t)weight * w_q16) >> 16);
+    }
+    nowcast->value = (uint32_t)(sum / weights);
+}
+
+/* Complete the current hour and start the next one */
+static void sps_aqi_nowcast_next_hour(struct sps_aqi_nowcast* nowcast) {
+    nowcast->newest = (nowcast->newest + 1) % SPS_AQI_NOWCAST_HOURS;
+    nowcast->hourly[nowcast->newest] =
+        nowcast->hour_count ? nowcast->hour_sum / nowcast->hour_count
+                            : SPS_AQI_NO_DATA;
+    nowcast->hour_sum = 0;
+    nowcast->hour_count = 0;
+    nowcast->hour_end_usec += SPS_AQI_HOUR_USEC;
+}
+
+void sps_aqi_nowcast_add(struct sps_aqi_nowcast* nowcast,
+                         uint64_t timestamp_usec,
+                         uint32_t concentration_tenths) {
+    uint8_t hours = 0;
+
+    if (!nowcast->started) {
+        nowcast->started = 1;
+        nowcast->hour_end_usec = timestamp_usec + SPS_AQI_HOUR_USEC;
+    }
+
+    if (timestamp_usec >= nowcast->hour_end_usec) {
+        while (timestamp_usec >= nowcast->hour_end_usec &&
+               hours <= SPS_AQI_NOWCAST_HOURS) {
+            sps_aqi_nowcast_next_hour(nowcast);
+            ++hours;
+        }
+        /* After a long gap, restart the hours at this sample */
+        if (timestamp_usec >= nowcast->hour_end_usec)
+            nowcast->hour_end_usec = timestamp_usec + SPS_AQI_HOUR_USEC;
+        sps_aqi_nowcast_update(nowcast);
+    }
+
+    nowcast->hour_sum += concentration_tenths;
+    ++nowcast->hour_count;
+}
+
+int16_t sps_aqi_nowcast_get(const struct sps_aqi_nowcast* nowcast,
+                            uint32_t* concentration_tenths) {
+    if (!nowcast->valid)
+        return SPS_AQI_ERR_NO_DATA;
+    *concentration_tenths = nowcast->value;
+    return 0;
+}
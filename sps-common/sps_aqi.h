@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_AQI_H
+#define SPS_AQI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_AQI_ERR_NO_DATA (-1)
+
+#define SPS_AQI_NOWCAST_HOURS 12
+
+/**
+ * One segment of a piecewise linear AQI breakpoint table. Concentrations are
+ * in tenths of the unit, e.g. 0.1 ug/m^3. The slope is precomputed in Q24
+ * fixed-point, use SPS_AQI_BREAKPOINT() to initialize a breakpoint. To fit
+ * the computation into 32 bit, i_hi - i_lo must be less than 256.
+ */
+struct sps_aqi_breakpoint {
+    uint32_t c_lo;
+    uint32_t c_hi;
+    uint16_t i_lo;
+    uint16_t i_hi;
+    uint32_t slope_q24;
+};
+
+#define SPS_AQI_BREAKPOINT(c_lo, c_hi, i_lo, i_hi)                            \
+    {                                                                         \
+        (c_lo), (c_hi), (i_lo), (i_hi),                                       \
+            (uint32_t)((((uint32_t)(i_hi) - (i_lo)) * 16777216UL +            \
+                        ((c_hi) - (c_lo)) / 2) /                              \
+                       ((c_hi) - (c_lo)))                                     \
+    }
+
+/**
+ * AQI breakpoint table of a pollutant
+ */
+struct sps_aqi_table {
+    const struct sps_aqi_breakpoint* breakpoints;
+    uint8_t num_breakpoints;
+    uint8_t resolution_tenths; /* concentrations are truncated to multiples */
+};
+
+/**
+ * US-EPA PM2.5 (24 h, 2024 revision) and PM10 (24 h) tables. Concentrations
+ * above the last breakpoint map to the highest index.
+ */
+extern const struct sps_aqi_table sps_aqi_epa_pm2p5;
+extern const struct sps_aqi_table sps_aqi_epa_pm10;
+
+/**
+ * Incremental NowCast over the last SPS_AQI_NOWCAST_HOURS hourly averages.
+ *
+ * The members are private, use the sps_aqi_nowcast_* functions.
+ */
+struct sps_aqi_nowcast {
+    uint64_t hour_end_usec;
+    uint32_t hour_sum;
+    uint16_t hour_count;
+    uint8_t newest;
+    uint8_t started;
+    uint8_t valid;
+    uint32_t value;
+    uint32_t hourly[SPS_AQI_NOWCAST_HOURS];
+};
+
+/**
+ * sps_aqi_float_to_tenths() - convert a concentration to tenths
+ *
+ * Converts e.g. the mc_2p5 field of struct sps30_measurement with integer
+ * operations only, rounding to the nearest hundredth before truncating to
+ * tenths. Negative values and NaN are converted to 0.
+ *
+ * @value:  Concentration
+ * Return:  Concentration in tenths, truncated
+ */
+uint32_t sps_aqi_float_to_tenths(float value);
+
+/**
+ * sps_aqi_sub_index() - compute the AQI sub-index of a concentration
+ *
+ * @table:                  Breakpoint table of the pollutant
+ * @concentration_tenths:   Concentration in tenths of the table's unit
+ * Return:                  The sub-index
+ */
+uint16_t sps_aqi_sub_index(const struct sps_aqi_table* table,
+                           uint32_t concentration_tenths);
+
+/**
+ * sps_aqi_nowcast_init() - initialize a NowCast without data
+ *
+ * @nowcast:    NowCast to initialize
+ */
+void sps_aqi_nowcast_init(struct sps_aqi_nowcast* nowcast);
+
+/**
+ * sps_aqi_nowcast_add() - add a sample
+ *
+ * Samples are averaged per hour, hours start at the timestamp of the first
+ * sample. Hours without samples are treated as missing. The NowCast is
+ * recomputed when an hour completes, thus adding a sample is O(1) apart from
+ * once per hour.
+ *
+ * @nowcast:                NowCast to add the sample to
+ * @timestamp_usec:         Monotonic time of the sample
+ * @concentration_tenths:   Concentration of the sample in tenths
+ */
+void sps_aqi_nowcast_add(struct sps_aqi_nowcast* nowcast,
+                         uint64_t timestamp_usec,
+                         uint32_t concentration_tenths);
+
+/**
+ * sps_aqi_nowcast_get() - get the NowCast concentration of the completed
+ * hours
+ *
+ * The NowCast weights hour i (0 being the most recent) by w^i with
+ * w = max(min / max, 0.5) over the hourly averages and requires two of the
+ * three most recent hours.
+ *
+ * @nowcast:                NowCast to query
+ * @concentration_tenths:   Memory where the NowCast concentration in tenths
+ *                          is stored, to be passed to sps_aqi_sub_index()
+ * Return:                  0 on success, SPS_AQI_ERR_NO_DATA if there is not
+ *                          enough data
+ */
+int16_t sps_aqi_nowcast_get(const struct sps_aqi_nowcast* nowcast,
+                            uint32_t* concentration_tenths);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_AQI_H */
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_capture.h"
+#include "sensirion_uart.h"
+#include <string.h>
+#include <time.h>
+
+#ifdef SENSIRION_SHDLC_CAPTURE
+
+#define SPS_CAPTURE_PCAP_MAGIC 0xa1b2c3d4
+#define SPS_CAPTURE_PSEUDO_HEADER_LEN 4
+#define SPS_CAPTURE_POLL_USEC 10000
+
+struct sps_capture_pcap_header {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+};
+
+struct sps_capture_pcap_record_header {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+};
+
+/* Runs in the thread using the SHDLC layer, must not block */
+static void sps_capture_frame(void* user_data, uint8_t direction, uint8_t port,
+                              uint64_t timestamp_usec, int16_t result,
+                              const uint8_t* frame, uint16_t len) {
+    struct sps_capture* capture = (struct sps_capture*)user_data;
+    struct sps_capture_record record;
+    uint16_t copy_len = len;
+
+    __atomic_add_fetch(&capture->stats.frames, 1, __ATOMIC_RELAXED);
+    if (copy_len > SPS_CAPTURE_MAX_FRAME_LEN) {
+        copy_len = SPS_CAPTURE_MAX_FRAME_LEN;
+        __atomic_add_fetch(&capture->stats.truncated, 1, __ATOMIC_RELAXED);
+    }
+
+    record.timestamp_usec = timestamp_usec;
+    record.len = len;
+    record.result = result;
+    record.direction = direction;
+    record.port = port;
+    record.reserved = 0;
+    memcpy(record.frame, frame, copy_len);
+
+    if (sps_ring_push(capture->ring, &record))
+        __atomic_add_fetch(&capture->stats.dropped, 1, __ATOMIC_RELAXED);
+}
+
+static int16_t sps_capture_write(struct sps_capture* capture,
+                                 const struct sps_capture_record* record) {
+    struct sps_capture_pcap_record_header header;
+    uint8_t pseudo_header[SPS_CAPTURE_PSEUDO_HEADER_LEN];
+    uint64_t timestamp;
+    uint16_t len = record->len;
+
+    if (len > SPS_CAPTURE_MAX_FRAME_LEN)
+        len = SPS_CAPTURE_MAX_FRAME_LEN;
+
+    timestamp =
+        record->timestamp_usec + (uint64_t)capture->realtime_offset_usec;
+    header.ts_sec = (uint32_t)(timestamp / 1000000);
+    header.ts_usec = (uint32_t)(timestamp % 1000000);
+    header.incl_len = SPS_CAPTURE_PSEUDO_HEADER_LEN + (uint32_t)len;
+    header.orig_len = SPS_CAPTURE_PSEUDO_HEADER_LEN + (uint32_t)record->len;
+
+    pseudo_header[0] = record->direction;
+    pseudo_header[1] = record->port;
+    pseudo_header[2] = (uint8_t)((uint16_t)record->result >> 8);
+    pseudo_header[3] = (uint8_t)record->result;
+
+    if (fwrite(&header, sizeof(header), 1, capture->file) != 1 ||
+        fwrite(pseudo_header, sizeof(pseudo_header), 1, capture->file) != 1 ||
+        fwrite(record->frame, 1, len, capture->file) != len)
+        return SPS_CAPTURE_ERR_SYSTEM;
+    return 0;
+}
+
+static void sps_capture_drain(struct sps_capture* capture) {
+    struct sps_capture_record record;
+
+    while (sps_ring_pop(capture->ring, &record) == 0) {
+        if (sps_capture_write(capture, &record)) {
+            __atomic_store_n(&capture->stats.last_error,
+                             (int16_t)SPS_CAPTURE_ERR_SYSTEM,
+                             __ATOMIC_RELAXED);
+            continue;
+        }
+        __atomic_add_fetch(&capture->stats.written, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void* sps_capture_thread(void* arg) {
+    struct sps_capture* capture = (struct sps_capture*)arg;
+
+    while (__atomic_load_n(&capture->running, __ATOMIC_ACQUIRE)) {
+        if (sps_ring_count(capture->ring) == 0) {
+            /* Flush while idle rather than per record */
+            fflush(capture->file);
+            sensirion_sleep_usec(SPS_CAPTURE_POLL_USEC);
+            continue;
+        }
+        sps_capture_drain(capture);
+    }
+    return NULL;
+}
+
+int16_t sps_capture_start(struct sps_capture* capture, const char* path,
+                          struct sps_ring* ring) {
+    struct sps_capture_pcap_header header;
+    struct timespec ts;
+    uint64_t realtime_usec;
+
+    if (!ring || ring->element_size != sizeof(struct sps_capture_record))
+        return SPS_CAPTURE_ERR_INVALID_CONFIG;
+
+    capture->file = fopen(path, "wb");
+    if (!capture->file)
+        return SPS_CAPTURE_ERR_SYSTEM;
+
+    header.magic = SPS_CAPTURE_PCAP_MAGIC;
+    header.version_major = 2;
+    header.version_minor = 4;
+    header.thiszone = 0;
+    header.sigfigs = 0;
+    header.snaplen = SPS_CAPTURE_PSEUDO_HEADER_LEN + SPS_CAPTURE_MAX_FRAME_LEN;
+    header.network = SPS_CAPTURE_DLT;
+    if (fwrite(&header, sizeof(header), 1, capture->file) != 1) {
+        fclose(capture->file);
+        return SPS_CAPTURE_ERR_SYSTEM;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    realtime_usec = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+    capture->realtime_offset_usec =
+        (int64_t)(realtime_usec - sensirion_get_time_usec());
+    capture->ring = ring;
+    memset(&capture->stats, 0, sizeof(capture->stats));
+    capture->running = 1;
+
+    if (pthread_create(&capture->thread, NULL, sps_capture_thread, capture)) {
+        capture->running = 0;
+        fclose(capture->file);
+        return SPS_CAPTURE_ERR_THREAD;
+    }
+    sensirion_shdlc_set_capture(sps_capture_frame, capture);
+    return 0;
+}
+
+int16_t sps_capture_stop(struct sps_capture* capture) {
+    int16_t ret = 0;
+
+    if (!capture->running)
+        return 0;
+
+    sensirion_shdlc_set_capture((sensirion_shdlc_capture_fn)NULL, NULL);
+    __atomic_store_n(&capture->running, 0, __ATOMIC_RELEASE);
+    if (pthread_join(capture->thread, NULL))
+        ret = SPS_CAPTURE_ERR_THREAD;
+
+    /* Records pushed after the thread's last poll */
+    sps_capture_drain(capture);
+    if (fclose(capture->file))
+        ret = SPS_CAPTURE_ERR_SYSTEM;
+    return ret;
+}
+
+void sps_capture_get_stats(struct sps_capture* capture,
+                           struct sps_capture_stats* stats) {
+    stats->frames = __atomic_load_n(&capture->stats.frames, __ATOMIC_RELAXED);
+    stats->truncated =
+        __atomic_load_n(&capture->stats.truncated, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&capture->stats.dropped, __ATOMIC_RELAXED);
+    stats->written = __atomic_load_n(&capture->stats.written, __ATOMIC_RELAXED);
+    stats->last_error =
+        __atomic_load_n(&capture->stats.last_error, __ATOMIC_RELAXED);
+}
+
+#endif /* SENSIRION_SHDLC_CAPTURE */
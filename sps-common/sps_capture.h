@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_CAPTURE_H
+#define SPS_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "sensirion_arch_config.h"
+#include "sensirion_shdlc.h"
+#include "sps_ring.h"
+
+#ifdef SENSIRION_SHDLC_CAPTURE
+
+#define SPS_CAPTURE_ERR_SYSTEM (-1)
+#define SPS_CAPTURE_ERR_INVALID_CONFIG (-2)
+#define SPS_CAPTURE_ERR_THREAD (-3)
+
+/** pcap link type of the capture file (LINKTYPE_USER0) */
+#define SPS_CAPTURE_DLT 147
+
+/** Frames longer than this are truncated, the original length is kept */
+#ifndef SPS_CAPTURE_MAX_FRAME_LEN
+#define SPS_CAPTURE_MAX_FRAME_LEN 112
+#endif
+
+/**
+ * Element of the capture ring. The ring must be initialized with an element
+ * size of sizeof(struct sps_capture_record).
+ */
+struct sps_capture_record {
+    uint64_t timestamp_usec; /* sensirion_get_time_usec() */
+    uint16_t len;            /* original length of the frame */
+    int16_t result;          /* result of the transmission or decoding */
+    uint8_t direction;       /* SENSIRION_SHDLC_CAPTURE_TX or _RX */
+    uint8_t port;
+    uint16_t reserved;
+    uint8_t frame[SPS_CAPTURE_MAX_FRAME_LEN];
+};
+
+struct sps_capture_stats {
+    uint32_t frames;    /* frames passed to the capture */
+    uint32_t truncated; /* frames longer than SPS_CAPTURE_MAX_FRAME_LEN */
+    uint32_t dropped;   /* frames not captured since the ring was full */
+    uint32_t written;   /* records written to the file */
+    int16_t last_error;
+};
+
+/**
+ * Capture of the raw SHDLC frames into a pcap file, available if the SHDLC
+ * layer is built with SENSIRION_SHDLC_CAPTURE.
+ *
+ * The frames are passed from the SHDLC layer (sensirion_shdlc_set_capture())
+ * through a lock-free ring to a writer thread, thus the driver never blocks
+ * on file I/O. When the ring is full, frames are dropped and counted.
+ *
+ * Every pcap record carries a 4 byte pseudo header followed by the raw,
+ * stuffed frame:
+ *
+ *   uint8_t direction; SENSIRION_SHDLC_CAPTURE_TX (0) or _RX (1)
+ *   uint8_t port;      port set with sensirion_shdlc_set_port()
+ *   int16_t result;    big-endian, 0 or the SHDLC error code
+ *
+ * The record timestamps are the monotonic timestamps of the frames, shifted
+ * to wall clock time when the capture is started.
+ *
+ * The ring is single-producer, thus only one thread may use the SHDLC layer
+ * while the capture is running, e.g. the sps_reader thread.
+ *
+ * The members are private.
+ */
+struct sps_capture {
+    struct sps_ring* ring;
+    FILE* file;
+    int64_t realtime_offset_usec;
+    struct sps_capture_stats stats;
+    pthread_t thread;
+    uint8_t running;
+};
+
+/**
+ * sps_capture_start() - create the capture file and start capturing
+ *
+ * Installs the capture callback with sensirion_shdlc_set_capture() and starts
+ * the writer thread.
+ *
+ * @capture:    Capture to start
+ * @path:       Path of the pcap file, truncated if it exists
+ * @ring:       Initialized ring with sizeof(struct sps_capture_record)
+ *              elements, which must stay valid until the capture is stopped
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sps_capture_start(struct sps_capture* capture, const char* path,
+                          struct sps_ring* ring);
+
+/**
+ * sps_capture_stop() - stop capturing and close the capture file
+ *
+ * Removes the capture callback, writes the remaining records and waits for the
+ * writer thread to terminate. No SHDLC transaction may be in progress.
+ *
+ * @capture:    Capture to stop
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sps_capture_stop(struct sps_capture* capture);
+
+/**
+ * sps_capture_get_stats() - read the capture counters
+ *
+ * @capture:    Capture to query
+ * @stats:      Memory where the counters are stored
+ */
+void sps_capture_get_stats(struct sps_capture* capture,
+                           struct sps_capture_stats* stats);
+
+#endif /* SENSIRION_SHDLC_CAPTURE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_CAPTURE_H */
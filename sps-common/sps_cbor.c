@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_cbor.h"
+
+#define SPS_CBOR_MAJOR_UINT 0
+#define SPS_CBOR_MAJOR_NINT 1
+#define SPS_CBOR_MAJOR_TEXT 3
+#define SPS_CBOR_MAJOR_ARRAY 4
+#define SPS_CBOR_MAJOR_MAP 5
+#define SPS_CBOR_MAJOR_SIMPLE 7
+
+#define SPS_CBOR_HALF 0xf9
+#define SPS_CBOR_SINGLE 0xfa
+#define SPS_CBOR_DOUBLE 0xfb
+
+union sps_cbor_float {
+    uint32_t u32_value;
+    float float32;
+};
+
+void sps_cbor_writer_init(struct sps_cbor_writer* writer, uint8_t* buf,
+                          uint16_t size) {
+    writer->buf = buf;
+    writer->size = size;
+    writer->len = 0;
+    writer->committed = 0;
+    writer->overflow = 0;
+}
+
+int16_t sps_cbor_writer_commit(struct sps_cbor_writer* writer) {
+    if (writer->overflow) {
+        writer->len = writer->committed;
+        writer->overflow = 0;
+        return SPS_CBOR_ERR_BUFFER_FULL;
+    }
+    writer->committed = writer->len;
+    return 0;
+}
+
+uint16_t sps_cbor_writer_get_length(const struct sps_cbor_writer* writer) {
+    return writer->committed;
+}
+
+static int16_t sps_cbor_put(struct sps_cbor_writer* writer,
+                            const uint8_t* data, uint16_t len) {
+    uint16_t i;
+
+    if (writer->overflow || len > writer->size - writer->len) {
+        writer->overflow = 1;
+        return SPS_CBOR_ERR_BUFFER_FULL;
+    }
+    for (i = 0; i < len; ++i)
+        writer->buf[writer->len++] = data[i];
+    return 0;
+}
+
+/* Write the initial byte and the argument in its shortest form */
+static int16_t sps_cbor_write_head(struct sps_cbor_writer* writer,
+                                   uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    uint8_t n;
+    uint8_t i;
+
+    if (value < 24) {
+        head[0] = (uint8_t)(major << 5 | value);
+        return sps_cbor_put(writer, head, 1);
+    }
+    if (value <= 0xff) {
+        head[0] = (uint8_t)(major << 5 | 24);
+        n = 1;
+    } else if (value <= 0xffff) {
+        head[0] = (uint8_t)(major << 5 | 25);
+        n = 2;
+    } else if (value <= 0xffffffff) {
+        head[0] = (uint8_t)(major << 5 | 26);
+        n = 4;
+    } else {
+        head[0] = (uint8_t)(major << 5 | 27);
+        n = 8;
+    }
+    for (i = 0; i < n; ++i)
+        head[n - i] = (uint8_t)(value >> (8 * i));
+    return sps_cbor_put(writer, head, (uint16_t)(n + 1));
+}
+
+int16_t sps_cbor_write_uint(struct sps_cbor_writer* writer, uint64_t value) {
+    return sps_cbor_write_head(writer, SPS_CBOR_MAJOR_UINT, value);
+}
+
+int16_t sps_cbor_write_int(struct sps_cbor_writer* writer, int64_t value) {
+    if (value < 0)
+        return sps_cbor_write_head(writer, SPS_CBOR_MAJOR_NINT,
+                                   (uint64_t)(-(value + 1)));
+    return sps_cbor_write_head(writer, SPS_CBOR_MAJOR_UINT, (uint64_t)value);
+}
+
+int16_t sps_cbor_write_text(struct sps_cbor_writer* writer, const char* text) {
+    uint16_t len = 0;
+    int16_t ret;
+
+    while (text[len])
+        ++len;
+    ret = sps_cbor_write_head(writer, SPS_CBOR_MAJOR_TEXT, len);
+    if (ret)
+        return ret;
+    return sps_cbor_put(writer, (const uint8_t*)text, len);
+}
+
+int16_t sps_cbor_write_array(struct sps_cbor_writer* writer, uint16_t count) {
+    return sps_cbor_write_head(writer, SPS_CBOR_MAJOR_ARRAY, count);
+}
+
+int16_t sps_cbor_write_map(struct sps_cbor_writer* writer, uint16_t count) {
+    return sps_cbor_write_head(writer, SPS_CBOR_MAJOR_MAP, count);
+}
+
+/* Return 1 and the half-precision bits if the conversion is lossless */
+static uint8_t sps_cbor_float_to_half(uint32_t bits, uint16_t* half) {
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    uint32_t shift;
+
+    if (exponent == 0xff) {
+        /* Infinity or the canonical quiet NaN */
+        if (mantissa != 0 && mantissa != 0x400000)
+            return 0;
+        *half = (uint16_t)(sign | 0x7c00 | (mantissa >> 13));
+        return 1;
+    }
+    if (exponent == 0) {
+        if (mantissa)
+            return 0; /* subnormal floats are too small */
+        *half = sign;
+        return 1;
+    }
+    if (exponent > 127 + 15)
+        return 0;
+    if (exponent >= 127 - 14) {
+        if (mantissa & 0x1fff)
+            return 0;
+        *half = (uint16_t)(sign | (exponent - 127 + 15) << 10 |
+                           mantissa >> 13);
+        return 1;
+    }
+
+    /* Subnormal half: value = m * 2^-24 */
+    shift = 126 - exponent;
+    mantissa |= 0x800000;
+    if (shift > 24 || (mantissa & ((1UL << shift) - 1)))
+        return 0;
+    *half = (uint16_t)(sign | mantissa >> shift);
+    return 1;
+}
+
+static uint32_t sps_cbor_half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0x1f)
+        return sign | 0x7f800000 | mantissa << 13;
+    if (exponent)
+        return sign | (exponent + 127 - 15) << 23 | mantissa << 13;
+    if (mantissa == 0)
+        return sign;
+
+    /* Normalize the subnormal half */
+    exponent = 127 - 14;
+    while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        --exponent;
+    }
+    return sign | exponent << 23 | (mantissa & 0x3ff) << 13;
+}
+
+int16_t sps_cbor_write_float(struct sps_cbor_writer* writer, float value) {
+    union sps_cbor_float tmp;
+    uint8_t data[5];
+    uint16_t half;
+
+    tmp.float32 = value;
+    if (sps_cbor_float_to_half(tmp.u32_value, &half)) {
+        data[0] = SPS_CBOR_HALF;
+        data[1] = (uint8_t)(half >> 8);
+        data[2] = (uint8_t)half;
+        return sps_cbor_put(writer, data, 3);
+    }
+    data[0] = SPS_CBOR_SINGLE;
+    data[1] = (uint8_t)(tmp.u32_value >> 24);
+    data[2] = (uint8_t)(tmp.u32_value >> 16);
+    data[3] = (uint8_t)(tmp.u32_value >> 8);
+    data[4] = (uint8_t)tmp.u32_value;
+    return sps_cbor_put(writer, data, 5);
+}
+
+void sps_cbor_reader_init(struct sps_cbor_reader* reader, const uint8_t* buf,
+                          uint16_t size) {
+    reader->buf = buf;
+    reader->size = size;
+    reader->pos = 0;
+}
+
+uint8_t sps_cbor_reader_at_end(const struct sps_cbor_reader* reader) {
+    return reader->pos >= reader->size;
+}
+
+/*
+ * Decode the head of the next item without advancing the reader. Return the
+ * size of the head, or a negative error code.
+ */
+static int16_t sps_cbor_read_head(const struct sps_cbor_reader* reader,
+                                  uint8_t* major, uint64_t* value) {
+    const uint8_t* p = reader->buf + reader->pos;
+    uint16_t avail = (uint16_t)(reader->size - reader->pos);
+    uint8_t info;
+    uint8_t n;
+    uint8_t i;
+
+    if (reader->pos >= reader->size)
+        return SPS_CBOR_ERR_END;
+    *major = p[0] >> 5;
+    info = p[0] & 0x1f;
+    if (info < 24) {
+        *value = info;
+        return 1;
+    }
+    if (info > 27)
+        return SPS_CBOR_ERR_INVALID;
+    n = (uint8_t)(1 << (info - 24));
+    if (avail < n + 1)
+        return SPS_CBOR_ERR_END;
+    *value = 0;
+    for (i = 1; i <= n; ++i)
+        *value = *value << 8 | p[i];
+    return (int16_t)(n + 1);
+}
+
+/* Read the head of an item of the expected major type with a 16 bit count */
+static int16_t sps_cbor_read_count(struct sps_cbor_reader* reader,
+                                   uint8_t expected, uint16_t* count) {
+    uint64_t value;
+    uint8_t major;
+    int16_t ret;
+
+    ret = sps_cbor_read_head(reader, &major, &value);
+    if (ret < 0)
+        return ret;
+    if (major != expected || value > 0xffff)
+        return SPS_CBOR_ERR_TYPE;
+    reader->pos = (uint16_t)(reader->pos + ret);
+    *count = (uint16_t)value;
+    return 0;
+}
+
+int16_t sps_cbor_read_uint(struct sps_cbor_reader* reader, uint64_t* value) {
+    uint8_t major;
+    int16_t ret;
+
+    ret = sps_cbor_read_head(reader, &major, value);
+    if (ret < 0)
+        return ret;
+    if (major != SPS_CBOR_MAJOR_UINT)
+        return SPS_CBOR_ERR_TYPE;
+    reader->pos = (uint16_t)(reader->pos + ret);
+    return 0;
+}
+
+int16_t sps_cbor_read_int(struct sps_cbor_reader* reader, int64_t* value) {
+    uint64_t arg;
+    uint8_t major;
+    int16_t ret;
+
+    ret = sps_cbor_read_head(reader, &major, &arg);
+    if (ret < 0)
+        return ret;
+    if ((major != SPS_CBOR_MAJOR_UINT && major != SPS_CBOR_MAJOR_NINT) ||
+        arg > 0x7fffffffffffffff)
+        return SPS_CBOR_ERR_TYPE;
+    reader->pos = (uint16_t)(reader->pos + ret);
+    *value = major == SPS_CBOR_MAJOR_UINT ? (int64_t)arg : -1 - (int64_t)arg;
+    return 0;
+}
+
+int16_t sps_cbor_read_text(struct sps_cbor_reader* reader, const char** text,
+                           uint16_t* len) {
+    uint64_t value;
+    uint8_t major;
+    int16_t ret;
+
+    ret = sps_cbor_read_head(reader, &major, &value);
+    if (ret < 0)
+        return ret;
+    if (major != SPS_CBOR_MAJOR_TEXT)
+        return SPS_CBOR_ERR_TYPE;
+    if (value > (uint16_t)(reader->size - reader->pos - ret))
+        return SPS_CBOR_ERR_END;
+    *text = (const char*)(reader->buf + reader->pos + ret);
+    *len = (uint16_t)value;
+    reader->pos = (uint16_t)(reader->pos + ret + *len);
+    return 0;
+}
+
+int16_t sps_cbor_read_array(struct sps_cbor_reader* reader, uint16_t* count) {
+    return sps_cbor_read_count(reader, SPS_CBOR_MAJOR_ARRAY, count);
+}
+
+int16_t sps_cbor_read_map(struct sps_cbor_reader* reader, uint16_t* count) {
+    return sps_cbor_read_count(reader, SPS_CBOR_MAJOR_MAP, count);
+}
+
+int16_t sps_cbor_read_float(struct sps_cbor_reader* reader, float* value) {
+    union sps_cbor_float tmp;
+    union {
+        uint64_t u64_value;
+        double float64;
+    } tmp64;
+    uint64_t arg;
+    uint8_t major;
+    int16_t ret;
+
+    ret = sps_cbor_read_head(reader, &major, &arg);
+    if (ret < 0)
+        return ret;
+    if (major != SPS_CBOR_MAJOR_SIMPLE)
+        return SPS_CBOR_ERR_TYPE;
+
+    switch (reader->buf[reader->pos]) {
+        case SPS_CBOR_HALF:
+            tmp.u32_value = sps_cbor_half_to_float((uint16_t)arg);
+            *value = tmp.float32;
+            break;
+        case SPS_CBOR_SINGLE:
+            tmp.u32_value = (uint32_t)arg;
+            *value = tmp.float32;
+            break;
+        case SPS_CBOR_DOUBLE:
+            tmp64.u64_value = arg;
+            *value = (float)tmp64.float64;
+            break;
+        default:
+            return SPS_CBOR_ERR_TYPE;
+    }
+    reader->pos = (uint16_t)(reader->pos + ret);
+    return 0;
+}
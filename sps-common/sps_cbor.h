@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_CBOR_H
+#define SPS_CBOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_CBOR_ERR_BUFFER_FULL (-1)
+#define SPS_CBOR_ERR_END (-2)
+#define SPS_CBOR_ERR_TYPE (-3)
+#define SPS_CBOR_ERR_INVALID (-4)
+
+/**
+ * Streaming CBOR (RFC 8949) encoder into a bounded buffer. Once a write does
+ * not fit, the writer stays in the overflow state and all further writes
+ * fail, see sps_cbor_writer_commit().
+ *
+ * The members are private.
+ */
+struct sps_cbor_writer {
+    uint8_t* buf;
+    uint16_t size;
+    uint16_t len;
+    uint16_t committed;
+    uint8_t overflow;
+};
+
+/**
+ * CBOR decoder over a buffer. Strings are returned without copying.
+ *
+ * The members are private.
+ */
+struct sps_cbor_reader {
+    const uint8_t* buf;
+    uint16_t size;
+    uint16_t pos;
+};
+
+/**
+ * sps_cbor_writer_init() - initialize a writer on an empty buffer
+ *
+ * @writer: Writer to initialize
+ * @buf:    Buffer to write to
+ * @size:   Size of buf
+ */
+void sps_cbor_writer_init(struct sps_cbor_writer* writer, uint8_t* buf,
+                          uint16_t size);
+
+/**
+ * sps_cbor_writer_commit() - complete a record
+ *
+ * If all writes since the last commit fit into the buffer, they are kept.
+ * Otherwise they are discarded, so the buffer only contains complete records
+ * and can be flushed before writing the record again.
+ *
+ * @writer: Writer
+ * Return:  0 on success, SPS_CBOR_ERR_BUFFER_FULL if the record was discarded
+ */
+int16_t sps_cbor_writer_commit(struct sps_cbor_writer* writer);
+
+/**
+ * sps_cbor_writer_get_length() - number of bytes of committed records
+ *
+ * @writer: Writer
+ * Return:  Number of bytes
+ */
+uint16_t sps_cbor_writer_get_length(const struct sps_cbor_writer* writer);
+
+/*
+ * The write functions return 0 on success, SPS_CBOR_ERR_BUFFER_FULL if the
+ * item does not fit. Arrays and maps are followed by count items,
+ * respectively count key/value pairs.
+ */
+int16_t sps_cbor_write_uint(struct sps_cbor_writer* writer, uint64_t value);
+int16_t sps_cbor_write_int(struct sps_cbor_writer* writer, int64_t value);
+int16_t sps_cbor_write_text(struct sps_cbor_writer* writer, const char* text);
+int16_t sps_cbor_write_array(struct sps_cbor_writer* writer, uint16_t count);
+int16_t sps_cbor_write_map(struct sps_cbor_writer* writer, uint16_t count);
+
+/**
+ * sps_cbor_write_float() - write a float in its shortest lossless encoding
+ *
+ * Values which are exactly representable as half-precision float (including
+ * infinity and the canonical NaN) are written in 3 bytes, others in 5 bytes.
+ *
+ * @writer: Writer
+ * @value:  Value to write
+ * Return:  0 on success, SPS_CBOR_ERR_BUFFER_FULL otherwise
+ */
+int16_t sps_cbor_write_float(struct sps_cbor_writer* writer, float value);
+
+/**
+ * sps_cbor_reader_init() - initialize a reader
+ *
+ * @reader: Reader to initialize
+ * @buf:    CBOR data, e.g. a sequence of records
+ * @size:   Size of buf
+ */
+void sps_cbor_reader_init(struct sps_cbor_reader* reader, const uint8_t* buf,
+                          uint16_t size);
+
+/**
+ * sps_cbor_reader_at_end() - check if all data was read
+ *
+ * @reader: Reader
+ * Return:  1 if there is no more data, 0 otherwise
+ */
+uint8_t sps_cbor_reader_at_end(const struct sps_cbor_reader* reader);
+
+/*
+ * The read functions return 0 on success, SPS_CBOR_ERR_END if the data ends
+ * prematurely, SPS_CBOR_ERR_TYPE if the next item has a different type or
+ * does not fit, SPS_CBOR_ERR_INVALID if it uses unsupported encodings (e.g.
+ * indefinite lengths). The reader is not advanced on errors.
+ */
+int16_t sps_cbor_read_uint(struct sps_cbor_reader* reader, uint64_t* value);
+int16_t sps_cbor_read_int(struct sps_cbor_reader* reader, int64_t* value);
+int16_t sps_cbor_read_text(struct sps_cbor_reader* reader, const char** text,
+                           uint16_t* len);
+int16_t sps_cbor_read_array(struct sps_cbor_reader* reader, uint16_t* count);
+int16_t sps_cbor_read_map(struct sps_cbor_reader* reader, uint16_t* count);
+
+/**
+ * sps_cbor_read_float() - read a half, single or double precision float
+ *
+ * @reader: Reader
+ * @value:  Memory where the value is stored
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_cbor_read_float(struct sps_cbor_reader* reader, float* value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_CBOR_H */
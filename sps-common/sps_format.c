@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_format.h"
+
+static const uint32_t sps_format_pow10[SPS_FORMAT_MAX_DECIMALS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000};
+
+struct sps_format_writer {
+    char* buf;
+    uint16_t size;
+    uint16_t len;
+    uint8_t overflow;
+};
+
+static void sps_format_putc(struct sps_format_writer* w, char c) {
+    /* Always keep space for the terminating zero */
+    if (w->len + 1 >= w->size) {
+        w->overflow = 1;
+        return;
+    }
+    w->buf[w->len++] = c;
+}
+
+static void sps_format_puts(struct sps_format_writer* w, const char* s) {
+    while (*s)
+        sps_format_putc(w, *s++);
+}
+
+static void sps_format_uint(struct sps_format_writer* w, uint32_t value,
+                            uint8_t min_digits) {
+    char digits[10];
+    uint8_t n = 0;
+
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value || n < min_digits);
+    while (n)
+        sps_format_putc(w, digits[--n]);
+}
+
+/*
+ * Compute value * 10^decimals rounded to nearest (ties to even) from the
+ * binary representation of value, which is exact in contrast to a float
+ * multiplication. Return 0 if the result does not fit into 32 bit.
+ */
+static uint8_t sps_format_scale(uint32_t bits, uint8_t decimals,
+                                uint32_t* scaled) {
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint64_t product;
+    uint64_t half;
+    uint64_t rest;
+    uint8_t shift;
+
+    if (exponent == 0xff)
+        return 0;
+    if (exponent == 0) {
+        /* zero or subnormal */
+        *scaled = 0;
+        return 1;
+    }
+
+    /* value = mantissa * 2^(exponent - 150), product < 2^44 */
+    product = (uint64_t)((bits & 0x7fffff) | 0x800000) *
+              sps_format_pow10[decimals];
+    if (exponent >= 150) {
+        shift = (uint8_t)(exponent - 150);
+        if (shift >= 32 || product >> (32 - shift))
+            return 0;
+        *scaled = (uint32_t)(product << shift);
+        return 1;
+    }
+
+    shift = (uint8_t)(150 - exponent);
+    if (shift > 45) {
+        *scaled = 0;
+        return 1;
+    }
+    half = (uint64_t)1 << (shift - 1);
+    rest = product & ((half << 1) - 1);
+    product >>= shift;
+    if (rest > half || (rest == half && (product & 1)))
+        ++product;
+    if (product >> 32)
+        return 0;
+    *scaled = (uint32_t)product;
+    return 1;
+}
+
+/* Return 0 if the value is not representable and was written as "nan" */
+static uint8_t sps_format_value(struct sps_format_writer* w, float value,
+                                uint8_t decimals) {
+    union {
+        uint32_t u32_value;
+        float float32;
+    } tmp;
+    uint32_t u;
+
+    tmp.float32 = value;
+    if (!sps_format_scale(tmp.u32_value, decimals, &u)) {
+        sps_format_puts(w, "nan");
+        return 0;
+    }
+
+    if ((tmp.u32_value >> 31) && u)
+        sps_format_putc(w, '-');
+    sps_format_uint(w, u / sps_format_pow10[decimals], 1);
+    if (decimals) {
+        sps_format_putc(w, '.');
+        sps_format_uint(w, u % sps_format_pow10[decimals], decimals);
+    }
+    return 1;
+}
+
+static int16_t sps_format_finish(struct sps_format_writer* w) {
+    if (w->size)
+        w->buf[w->len] = '\0';
+    if (w->overflow)
+        return SPS_FORMAT_ERR_BUFFER_TOO_SMALL;
+    return (int16_t)w->len;
+}
+
+int16_t sps_format_float(char* buf, uint16_t size, float value,
+                         uint8_t decimals) {
+    struct sps_format_writer w = {buf, size, 0, 0};
+
+    if (decimals > SPS_FORMAT_MAX_DECIMALS)
+        return SPS_FORMAT_ERR_INVALID_ARGUMENT;
+    sps_format_value(&w, value, decimals);
+    return sps_format_finish(&w);
+}
+
+int16_t sps_format_line(char* buf, uint16_t size, enum sps_format_style style,
+                        const char* const* names, const float* values,
+                        const uint8_t* decimals, uint8_t num_fields) {
+    struct sps_format_writer w = {buf, size, 0, 0};
+    uint16_t start;
+    uint8_t i;
+
+    for (i = 0; i < num_fields; ++i) {
+        if (style != SPS_FORMAT_CSV_HEADER &&
+            decimals[i] > SPS_FORMAT_MAX_DECIMALS)
+            return SPS_FORMAT_ERR_INVALID_ARGUMENT;
+    }
+
+    if (style == SPS_FORMAT_JSON)
+        sps_format_putc(&w, '{');
+    for (i = 0; i < num_fields; ++i) {
+        if (i)
+            sps_format_putc(&w, ',');
+        switch (style) {
+            case SPS_FORMAT_CSV:
+                sps_format_value(&w, values[i], decimals[i]);
+                break;
+            case SPS_FORMAT_CSV_HEADER:
+                sps_format_puts(&w, names[i]);
+                break;
+            case SPS_FORMAT_JSON:
+                sps_format_putc(&w, '"');
+                sps_format_puts(&w, names[i]);
+                sps_format_puts(&w, "\":");
+                start = w.len;
+                if (!sps_format_value(&w, values[i], decimals[i])) {
+                    w.len = start;
+                    sps_format_puts(&w, "null");
+                }
+                break;
+            default:
+                return SPS_FORMAT_ERR_INVALID_ARGUMENT;
+        }
+    }
+    if (style == SPS_FORMAT_JSON)
+        sps_format_putc(&w, '}');
+    sps_format_putc(&w, '\n');
+    return sps_format_finish(&w);
+}
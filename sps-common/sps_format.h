@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_FORMAT_H
+#define SPS_FORMAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_FORMAT_ERR_BUFFER_TOO_SMALL (-1)
+#define SPS_FORMAT_ERR_INVALID_ARGUMENT (-2)
+
+/* Maximum number of decimals of sps_format_float() */
+#define SPS_FORMAT_MAX_DECIMALS 6
+
+enum sps_format_style {
+    SPS_FORMAT_CSV,        /* values separated by commas */
+    SPS_FORMAT_CSV_HEADER, /* field names separated by commas */
+    SPS_FORMAT_JSON,       /* object with one member per field */
+};
+
+/**
+ * sps_format_float() - format a float with a fixed number of decimals
+ *
+ * Equivalent to snprintf("%.*f") for values whose scaled magnitude
+ * value * 10^decimals is below 2^32, but uses integer arithmetic on the
+ * binary representation instead of printf's float support. Other values,
+ * infinity and NaN are written as "nan". Negative values which round to zero
+ * are written without sign.
+ *
+ * @buf:        Buffer to write the zero terminated string to
+ * @size:       Size of buf, less than 32768
+ * @value:      Value to format
+ * @decimals:   Number of decimals, at most SPS_FORMAT_MAX_DECIMALS
+ * Return:      Length of the string on success, an error code otherwise
+ */
+int16_t sps_format_float(char* buf, uint16_t size, float value,
+                         uint8_t decimals);
+
+/**
+ * sps_format_line() - format a record as CSV or JSON line
+ *
+ * Writes e.g. "1.00,2.50\n" or "{\"mc_1p0\":1.00,\"mc_2p5\":2.50}\n" without
+ * using the heap. Values which sps_format_float() formats as "nan" are
+ * written as null in JSON.
+ *
+ * @buf:        Buffer to write the zero terminated line to
+ * @size:       Size of buf, less than 32768
+ * @style:      Output format
+ * @names:      Field names, used for SPS_FORMAT_CSV_HEADER and SPS_FORMAT_JSON
+ * @values:     Field values, unused for SPS_FORMAT_CSV_HEADER
+ * @decimals:   Number of decimals per field
+ * @num_fields: Number of fields
+ * Return:      Length of the line on success, an error code otherwise
+ */
+int16_t sps_format_line(char* buf, uint16_t size, enum sps_format_style style,
+                        const char* const* names, const float* values,
+                        const uint8_t* decimals, uint8_t num_fields);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_FORMAT_H */
@@ -0,0 +1,3 @@
+/* THIS FILE IS AUTOGENERATED */
+#include "sps_git_version.h"
+const char * SPS_DRV_VERSION_STR = "80e5392-dirty";
@@ -0,0 +1,528 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_mlog.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SPS_MLOG_MAGIC 0x474c5053       /* "SPLG" */
+#define SPS_MLOG_BLOCK_MAGIC 0x4b4c4253 /* "SBLK" */
+#define SPS_MLOG_VERSION 2
+#define SPS_MLOG_CRC_INIT 0xffffffff
+
+struct sps_mlog_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t records_per_block;
+    uint32_t num_blocks;
+    uint32_t block_size;
+    uint32_t header_size;
+    uint32_t sequence; /* sequence number of the block being written */
+};
+
+struct sps_mlog_index_entry {
+    uint64_t first_timestamp_usec;
+    uint32_t sequence;
+    uint32_t reserved;
+};
+
+/*
+ * Every record is followed by a CRC-32 over the sequence number of its block
+ * and the record. On recovery, count is recomputed as the number of leading
+ * records with a valid CRC, thus a block which was interrupted while being
+ * written, or whose pages reached the disk in any order, is consistent up to
+ * the first missing record. Stale records of the previous use of the block
+ * don't match since their CRC covers an older sequence number.
+ */
+struct sps_mlog_block_header {
+    uint32_t magic;
+    uint32_t sequence; /* 0 if the block was never written */
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t first_timestamp_usec;
+    uint64_t last_timestamp_usec;
+};
+
+static uint32_t sps_mlog_crc_update(uint32_t crc, const uint8_t* data,
+                                    uint32_t len) {
+    uint32_t i;
+    uint8_t bit;
+
+    /* CRC-32 (IEEE 802.3), reflected, without final inversion */
+    for (i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return crc;
+}
+
+static uint32_t sps_mlog_round_up(uint32_t size, uint32_t page_size) {
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+static struct sps_mlog_file_header*
+sps_mlog_header(const struct sps_mlog* log) {
+    return (struct sps_mlog_file_header*)log->base;
+}
+
+static struct sps_mlog_index_entry* sps_mlog_index(const struct sps_mlog* log,
+                                                   uint32_t sequence) {
+    return (struct sps_mlog_index_entry*)(log->base +
+                                          sizeof(struct sps_mlog_file_header)) +
+           sequence % log->num_blocks;
+}
+
+static struct sps_mlog_block_header* sps_mlog_block(const struct sps_mlog* log,
+                                                    uint32_t sequence) {
+    return (struct sps_mlog_block_header*)(log->base + log->header_size +
+                                           (size_t)(sequence %
+                                                    log->num_blocks) *
+                                               log->block_size);
+}
+
+static uint8_t* sps_mlog_record(const struct sps_mlog* log,
+                                const struct sps_mlog_block_header* block,
+                                uint32_t index) {
+    return (uint8_t*)block + sizeof(*block) + (size_t)index * log->slot_size;
+}
+
+static uint32_t sps_mlog_record_crc(const struct sps_mlog* log,
+                                    uint32_t sequence, const uint8_t* record) {
+    uint32_t crc;
+
+    crc = sps_mlog_crc_update(SPS_MLOG_CRC_INIT, (const uint8_t*)&sequence,
+                              sizeof(sequence));
+    return sps_mlog_crc_update(crc, record, log->record_size);
+}
+
+/* Check the CRC of a copy of a slot (record followed by its CRC) */
+static uint8_t sps_mlog_slot_valid(const struct sps_mlog* log,
+                                   uint32_t sequence, const uint8_t* slot) {
+    uint32_t crc;
+
+    memcpy(&crc, slot + log->record_size, sizeof(crc));
+    return crc == sps_mlog_record_crc(log, sequence, slot);
+}
+
+static uint64_t sps_mlog_record_timestamp(const uint8_t* record) {
+    uint64_t timestamp;
+
+    memcpy(&timestamp, record, sizeof(timestamp));
+    return timestamp;
+}
+
+static int16_t sps_mlog_map(struct sps_mlog* log, int fd, int prot) {
+    void* base;
+
+    base = mmap(NULL, (size_t)log->size, prot, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return SPS_MLOG_ERR_SYSTEM;
+    log->base = (uint8_t*)base;
+    return 0;
+}
+
+static uint8_t sps_mlog_header_matches(const struct sps_mlog* log) {
+    const struct sps_mlog_file_header* header = sps_mlog_header(log);
+
+    return header->magic == SPS_MLOG_MAGIC &&
+           header->version == SPS_MLOG_VERSION &&
+           header->record_size == log->record_size &&
+           header->records_per_block == log->records_per_block &&
+           header->num_blocks == log->num_blocks &&
+           header->block_size == log->block_size &&
+           header->header_size == log->header_size;
+}
+
+/*
+ * Recover the valid records of every block, find the newest block and rebuild
+ * the index from the block headers, since the index is flushed lazily.
+ */
+static void sps_mlog_recover(struct sps_mlog* log) {
+    struct sps_mlog_block_header* block;
+    struct sps_mlog_index_entry* entry;
+    uint32_t newest = 0;
+    uint32_t count;
+    uint32_t i;
+
+    for (i = 0; i < log->num_blocks; ++i) {
+        block = sps_mlog_block(log, i);
+        entry = sps_mlog_index(log, i);
+        count = 0;
+        if (block->magic == SPS_MLOG_BLOCK_MAGIC && block->sequence != 0 &&
+            block->sequence % log->num_blocks == i) {
+            while (count < log->records_per_block &&
+                   sps_mlog_slot_valid(log, block->sequence,
+                                       sps_mlog_record(log, block, count)))
+                ++count;
+        }
+        if (count == 0) {
+            block->sequence = 0;
+            entry->sequence = 0;
+            continue;
+        }
+        block->count = count;
+        block->first_timestamp_usec =
+            sps_mlog_record_timestamp(sps_mlog_record(log, block, 0));
+        block->last_timestamp_usec =
+            sps_mlog_record_timestamp(sps_mlog_record(log, block, count - 1));
+        entry->first_timestamp_usec = block->first_timestamp_usec;
+        entry->sequence = block->sequence;
+        if (block->sequence > newest)
+            newest = block->sequence;
+    }
+    log->sequence = newest;
+    sps_mlog_header(log)->sequence = newest;
+}
+
+int16_t sps_mlog_open_writer(struct sps_mlog* log, const char* path,
+                             uint32_t record_size, uint32_t records_per_block,
+                             uint32_t num_blocks) {
+    struct sps_mlog_file_header* header;
+    struct stat st;
+    uint32_t page_size;
+    int16_t ret;
+    int fd;
+
+    if (record_size < sizeof(uint64_t) || records_per_block == 0 ||
+        num_blocks < 2 ||
+        ((uint64_t)record_size + sizeof(uint32_t)) * records_per_block >
+            0x7fffffff)
+        return SPS_MLOG_ERR_INVALID_CONFIG;
+
+    page_size = (uint32_t)sysconf(_SC_PAGESIZE);
+    log->record_size = record_size;
+    log->slot_size = record_size + (uint32_t)sizeof(uint32_t);
+    log->records_per_block = records_per_block;
+    log->num_blocks = num_blocks;
+    log->header_size = sps_mlog_round_up(
+        (uint32_t)(sizeof(struct sps_mlog_file_header) +
+                   num_blocks * sizeof(struct sps_mlog_index_entry)),
+        page_size);
+    log->block_size = sps_mlog_round_up(
+        (uint32_t)sizeof(struct sps_mlog_block_header) +
+            log->slot_size * records_per_block,
+        page_size);
+    log->size = log->header_size + (uint64_t)num_blocks * log->block_size;
+    log->writable = 1;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return SPS_MLOG_ERR_SYSTEM;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return SPS_MLOG_ERR_SYSTEM;
+    }
+
+    if ((uint64_t)st.st_size == log->size) {
+        ret = sps_mlog_map(log, fd, PROT_READ | PROT_WRITE);
+        if (ret)
+            return ret;
+        if (sps_mlog_header_matches(log)) {
+            sps_mlog_recover(log);
+            return 0;
+        }
+        munmap(log->base, (size_t)log->size);
+        fd = open(path, O_RDWR);
+        if (fd < 0)
+            return SPS_MLOG_ERR_SYSTEM;
+    }
+
+    /* Preallocate a fresh, zeroed file */
+    if (ftruncate(fd, 0) || ftruncate(fd, (off_t)log->size)) {
+        close(fd);
+        return SPS_MLOG_ERR_SYSTEM;
+    }
+    ret = sps_mlog_map(log, fd, PROT_READ | PROT_WRITE);
+    if (ret)
+        return ret;
+
+    header = sps_mlog_header(log);
+    header->version = SPS_MLOG_VERSION;
+    header->record_size = record_size;
+    header->records_per_block = records_per_block;
+    header->num_blocks = num_blocks;
+    header->block_size = log->block_size;
+    header->header_size = log->header_size;
+    header->sequence = 0;
+    header->magic = SPS_MLOG_MAGIC;
+    log->sequence = 0;
+    if (msync(log->base, log->header_size, MS_SYNC))
+        return SPS_MLOG_ERR_SYSTEM;
+    return 0;
+}
+
+static void sps_mlog_start_block(struct sps_mlog* log, uint64_t timestamp) {
+    uint32_t sequence = log->sequence + 1;
+    struct sps_mlog_block_header* block = sps_mlog_block(log, sequence);
+    struct sps_mlog_index_entry* entry = sps_mlog_index(log, sequence);
+
+    /* Invalidate the block first so readers notice that it is reused */
+    __atomic_store_n(&block->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    block->magic = SPS_MLOG_BLOCK_MAGIC;
+    block->count = 0;
+    block->reserved = 0;
+    block->first_timestamp_usec = timestamp;
+    block->last_timestamp_usec = timestamp;
+    entry->first_timestamp_usec = timestamp;
+    __atomic_store_n(&block->sequence, sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->sequence, sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&sps_mlog_header(log)->sequence, sequence,
+                     __ATOMIC_RELEASE);
+    log->sequence = sequence;
+}
+
+int16_t sps_mlog_append(struct sps_mlog* log, const void* record) {
+    struct sps_mlog_block_header* block = sps_mlog_block(log, log->sequence);
+    uint64_t timestamp = sps_mlog_record_timestamp((const uint8_t*)record);
+    uint8_t* slot;
+    uint32_t count;
+    uint32_t crc;
+
+    if (!log->writable)
+        return SPS_MLOG_ERR_INVALID_CONFIG;
+
+    if (log->sequence == 0 || block->count == log->records_per_block) {
+        sps_mlog_start_block(log, timestamp);
+        block = sps_mlog_block(log, log->sequence);
+    }
+
+    count = block->count;
+    slot = sps_mlog_record(log, block, count);
+    crc = sps_mlog_record_crc(log, log->sequence, (const uint8_t*)record);
+    memcpy(slot, record, log->record_size);
+    memcpy(slot + log->record_size, &crc, sizeof(crc));
+    block->last_timestamp_usec = timestamp;
+    __atomic_store_n(&block->count, count + 1, __ATOMIC_RELEASE);
+
+    if (count + 1 < log->records_per_block)
+        return 0;
+
+    /* The index can be rebuilt from the block headers on recovery */
+    if (msync(block, log->block_size, MS_SYNC) ||
+        msync(log->base, log->header_size, MS_ASYNC))
+        return SPS_MLOG_ERR_SYSTEM;
+    return 0;
+}
+
+int16_t sps_mlog_sync(struct sps_mlog* log) {
+    if (!log->writable)
+        return SPS_MLOG_ERR_INVALID_CONFIG;
+    if (log->sequence == 0)
+        return 0;
+    if (msync(sps_mlog_block(log, log->sequence), log->block_size, MS_SYNC))
+        return SPS_MLOG_ERR_SYSTEM;
+    return 0;
+}
+
+int16_t sps_mlog_open_reader(struct sps_mlog* log, const char* path) {
+    struct sps_mlog_file_header header;
+    struct stat st;
+    int16_t ret;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return SPS_MLOG_ERR_SYSTEM;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(header)) {
+        close(fd);
+        return SPS_MLOG_ERR_INVALID_FILE;
+    }
+    log->size = (uint64_t)st.st_size;
+    ret = sps_mlog_map(log, fd, PROT_READ);
+    if (ret)
+        return ret;
+
+    memcpy(&header, log->base, sizeof(header));
+    if (header.magic != SPS_MLOG_MAGIC || header.version != SPS_MLOG_VERSION ||
+        header.num_blocks < 2 || header.record_size < sizeof(uint64_t) ||
+        header.records_per_block == 0 ||
+        header.header_size <
+            sizeof(header) + (uint64_t)header.num_blocks *
+                                 sizeof(struct sps_mlog_index_entry) ||
+        header.block_size <
+            sizeof(struct sps_mlog_block_header) +
+                ((uint64_t)header.record_size + sizeof(uint32_t)) *
+                    header.records_per_block ||
+        header.header_size + (uint64_t)header.num_blocks * header.block_size !=
+            log->size) {
+        munmap(log->base, (size_t)log->size);
+        return SPS_MLOG_ERR_INVALID_FILE;
+    }
+
+    log->record_size = header.record_size;
+    log->slot_size = header.record_size + (uint32_t)sizeof(uint32_t);
+    log->records_per_block = header.records_per_block;
+    log->num_blocks = header.num_blocks;
+    log->block_size = header.block_size;
+    log->header_size = header.header_size;
+    log->sequence = 0;
+    log->writable = 0;
+    return 0;
+}
+
+static uint64_t sps_mlog_first_timestamp(const struct sps_mlog* log,
+                                         uint32_t sequence) {
+    const struct sps_mlog_index_entry* entry = sps_mlog_index(log, sequence);
+    const struct sps_mlog_block_header* block = sps_mlog_block(log, sequence);
+
+    if (__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) == sequence)
+        return entry->first_timestamp_usec;
+    if (__atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE) == sequence)
+        return block->first_timestamp_usec;
+    /* Overwritten meanwhile, thus older than everything else */
+    return 0;
+}
+
+int16_t sps_mlog_seek(struct sps_mlog* log, uint64_t timestamp_usec,
+                      struct sps_mlog_cursor* cursor) {
+    const struct sps_mlog_block_header* block;
+    uint32_t newest;
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t mid;
+    uint32_t count;
+
+    newest = __atomic_load_n(&sps_mlog_header(log)->sequence,
+                             __ATOMIC_ACQUIRE);
+    if (newest == 0)
+        return SPS_MLOG_ERR_NOT_FOUND;
+    lo = newest >= log->num_blocks ? newest - log->num_blocks + 1 : 1;
+    hi = newest;
+
+    /* Find the last block starting at or before the timestamp */
+    if (sps_mlog_first_timestamp(log, lo) > timestamp_usec) {
+        cursor->sequence = lo;
+        cursor->index = 0;
+        return 0;
+    }
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (sps_mlog_first_timestamp(log, mid) <= timestamp_usec)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    /* Find the first record at or after the timestamp within the block */
+    block = sps_mlog_block(log, lo);
+    count = __atomic_load_n(&block->count, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE) != lo)
+        count = 0;
+    cursor->sequence = lo;
+    cursor->index = 0;
+    hi = count;
+    while (cursor->index < hi) {
+        mid = cursor->index + (hi - cursor->index) / 2;
+        if (sps_mlog_record_timestamp(sps_mlog_record(log, block, mid)) <
+            timestamp_usec)
+            cursor->index = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (cursor->index < count)
+        return 0;
+    if (lo == newest)
+        return SPS_MLOG_ERR_NOT_FOUND;
+    cursor->sequence = lo + 1;
+    cursor->index = 0;
+    return 0;
+}
+
+int16_t sps_mlog_read(struct sps_mlog* log, struct sps_mlog_cursor* cursor,
+                      void* record) {
+    const struct sps_mlog_block_header* block;
+    const uint8_t* slot;
+    uint32_t newest;
+    uint32_t count;
+    uint32_t crc;
+
+    for (;;) {
+        newest = __atomic_load_n(&sps_mlog_header(log)->sequence,
+                                 __ATOMIC_ACQUIRE);
+        if (cursor->sequence > newest)
+            return SPS_MLOG_ERR_END;
+        if (newest - cursor->sequence >= log->num_blocks)
+            return SPS_MLOG_ERR_NOT_FOUND;
+
+        block = sps_mlog_block(log, cursor->sequence);
+        if (__atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE) !=
+            cursor->sequence)
+            return SPS_MLOG_ERR_NOT_FOUND;
+        count = __atomic_load_n(&block->count, __ATOMIC_ACQUIRE);
+
+        /* Skip to the next block if this one is done */
+        if (cursor->index >= count) {
+            if (count < log->records_per_block && cursor->sequence == newest)
+                return SPS_MLOG_ERR_END;
+            ++cursor->sequence;
+            cursor->index = 0;
+            continue;
+        }
+
+        slot = sps_mlog_record(log, block, cursor->index);
+        memcpy(record, slot, log->record_size);
+        memcpy(&crc, slot + log->record_size, sizeof(crc));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&block->sequence, __ATOMIC_RELAXED) !=
+            cursor->sequence)
+            return SPS_MLOG_ERR_NOT_FOUND;
+
+        /* Skip the rest of a block which was corrupted on disk */
+        if (crc != sps_mlog_record_crc(log, cursor->sequence,
+                                       (const uint8_t*)record)) {
+            cursor->index = count;
+            continue;
+        }
+        ++cursor->index;
+        return 0;
+    }
+}
+
+int16_t sps_mlog_close(struct sps_mlog* log) {
+    int16_t ret = 0;
+
+    if (log->writable && msync(log->base, (size_t)log->size, MS_SYNC))
+        ret = SPS_MLOG_ERR_SYSTEM;
+    if (munmap(log->base, (size_t)log->size))
+        ret = SPS_MLOG_ERR_SYSTEM;
+    log->base = (uint8_t*)NULL;
+    return ret;
+}
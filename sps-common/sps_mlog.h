@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_MLOG_H
+#define SPS_MLOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_MLOG_ERR_SYSTEM (-1)
+#define SPS_MLOG_ERR_INVALID_CONFIG (-2)
+#define SPS_MLOG_ERR_INVALID_FILE (-3)
+#define SPS_MLOG_ERR_NOT_FOUND (-4)
+#define SPS_MLOG_ERR_END (-5)
+
+/**
+ * Position of a record in the log
+ */
+struct sps_mlog_cursor {
+    uint32_t sequence; /* sequence number of the block */
+    uint32_t index;    /* index of the record within the block */
+};
+
+/**
+ * Crash-safe log of fixed-size records in a preallocated, memory-mapped file.
+ *
+ * The file is a ring of blocks, each holding a sequence number and
+ * records_per_block records, each followed by its own CRC-32. After a crash
+ * every block is recovered up to the first record which did not make it to
+ * the file. Each completed block is flushed with a single msync(). The file
+ * header contains an index of the first timestamp of every block, which
+ * allows to seek to a timestamp in O(log n).
+ *
+ * Every record must start with its uint64_t timestamp in microseconds (e.g.
+ * struct sps_reader_record) and records must be appended in non-decreasing
+ * timestamp order. The file uses native byte order.
+ *
+ * The members are private.
+ */
+struct sps_mlog {
+    uint8_t* base;
+    uint64_t size;
+    uint32_t record_size;
+    uint32_t slot_size; /* record_size plus its CRC */
+    uint32_t records_per_block;
+    uint32_t num_blocks;
+    uint32_t block_size;
+    uint32_t header_size;
+    uint32_t sequence; /* sequence number of the block being written */
+    uint8_t writable;
+};
+
+/**
+ * sps_mlog_open_writer() - open or create a log for appending
+ *
+ * An existing file with the same geometry is recovered and appended to,
+ * otherwise the file is (re)created.
+ *
+ * @log:                Log handle to initialize
+ * @path:               Path of the log file
+ * @record_size:        Size of a record in bytes, at least 8
+ * @records_per_block:  Number of records per block
+ * @num_blocks:         Number of blocks in the file, at least 2
+ * Return:              0 on success, an error code otherwise
+ */
+int16_t sps_mlog_open_writer(struct sps_mlog* log, const char* path,
+                             uint32_t record_size, uint32_t records_per_block,
+                             uint32_t num_blocks);
+
+/**
+ * sps_mlog_append() - append a record
+ *
+ * When the append completes a block, the block is flushed to disk and the
+ * oldest block is reused for the next record.
+ *
+ * @log:    Log opened with sps_mlog_open_writer()
+ * @record: Record of record_size bytes, starting with its timestamp
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_mlog_append(struct sps_mlog* log, const void* record);
+
+/**
+ * sps_mlog_sync() - flush the block currently being written to disk
+ *
+ * @log:    Log opened with sps_mlog_open_writer()
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_mlog_sync(struct sps_mlog* log);
+
+/**
+ * sps_mlog_open_reader() - open an existing log read-only
+ *
+ * The log may be written concurrently by another process.
+ *
+ * @log:    Log handle to initialize
+ * @path:   Path of the log file
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_mlog_open_reader(struct sps_mlog* log, const char* path);
+
+/**
+ * sps_mlog_seek() - find the first record with a timestamp >= timestamp_usec
+ *
+ * @log:            Opened log
+ * @timestamp_usec: Timestamp to search for
+ * @cursor:         Memory where the position of the record is stored
+ * Return:          0 on success, SPS_MLOG_ERR_NOT_FOUND if there is no such
+ *                  record, an error code otherwise
+ */
+int16_t sps_mlog_seek(struct sps_mlog* log, uint64_t timestamp_usec,
+                      struct sps_mlog_cursor* cursor);
+
+/**
+ * sps_mlog_read() - read the record at the cursor and advance the cursor
+ *
+ * @log:    Opened log
+ * @cursor: Position of the record, e.g. from sps_mlog_seek()
+ * @record: Memory of record_size bytes where the record is copied to
+ * Return:  0 on success, SPS_MLOG_ERR_END if there are no more records,
+ *          SPS_MLOG_ERR_NOT_FOUND if the block was overwritten meanwhile
+ */
+int16_t sps_mlog_read(struct sps_mlog* log, struct sps_mlog_cursor* cursor,
+                      void* record);
+
+/**
+ * sps_mlog_close() - flush (if writable) and unmap the log
+ *
+ * @log:    Opened log
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_mlog_close(struct sps_mlog* log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_MLOG_H */
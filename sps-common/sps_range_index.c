@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_range_index.h"
+#include <float.h>
+#include <string.h>
+
+static const struct sps_range_node sps_range_node_empty = {FLT_MAX, -FLT_MAX,
+                                                           0.0f};
+
+/*
+ * Each field uses an iterative segment tree of 2 * capacity nodes: the
+ * samples are stored in the leaves [capacity, 2 * capacity) at their ring
+ * position, node i aggregates nodes 2i and 2i + 1.
+ */
+static struct sps_range_node*
+sps_range_index_tree(const struct sps_range_index* index, uint8_t field) {
+    return index->nodes + (size_t)field * 2 * index->capacity;
+}
+
+static void sps_range_node_merge(struct sps_range_node* node,
+                                 const struct sps_range_node* a,
+                                 const struct sps_range_node* b) {
+    node->min = a->min < b->min ? a->min : b->min;
+    node->max = a->max > b->max ? a->max : b->max;
+    node->sum = a->sum + b->sum;
+}
+
+int16_t sps_range_index_init(struct sps_range_index* index, uint32_t capacity,
+                             uint8_t num_fields, void* storage,
+                             uint32_t storage_size) {
+    uint8_t* mem = (uint8_t*)storage;
+    uint32_t i;
+
+    if (capacity == 0 || num_fields == 0)
+        return SPS_RANGE_INDEX_ERR_INVALID_CONFIG;
+    if (storage_size <
+        SPS_RANGE_INDEX_STORAGE_SIZE((uint64_t)capacity, num_fields))
+        return SPS_RANGE_INDEX_ERR_STORAGE_TOO_SMALL;
+
+    index->timestamps = (uint64_t*)mem;
+    mem += sizeof(uint64_t) * capacity;
+    index->nodes = (struct sps_range_node*)mem;
+    index->capacity = capacity;
+    index->num_fields = num_fields;
+    index->count = 0;
+    index->head = 0;
+
+    memset(index->timestamps, 0, sizeof(uint64_t) * capacity);
+    for (i = 0; i < 2 * capacity * num_fields; ++i)
+        index->nodes[i] = sps_range_node_empty;
+    return 0;
+}
+
+void sps_range_index_add(struct sps_range_index* index,
+                         uint64_t timestamp_usec, const float* values) {
+    struct sps_range_node* tree;
+    uint32_t i;
+    uint8_t field;
+
+    index->timestamps[index->head] = timestamp_usec;
+    for (field = 0; field < index->num_fields; ++field) {
+        tree = sps_range_index_tree(index, field);
+        i = index->head + index->capacity;
+        tree[i].min = values[field];
+        tree[i].max = values[field];
+        tree[i].sum = values[field];
+        for (i >>= 1; i > 0; i >>= 1)
+            sps_range_node_merge(&tree[i], &tree[2 * i], &tree[2 * i + 1]);
+    }
+
+    index->head = index->head + 1 == index->capacity ? 0 : index->head + 1;
+    if (index->count < index->capacity)
+        ++index->count;
+}
+
+/* Timestamp of the i-th oldest sample */
+static uint64_t sps_range_index_timestamp(const struct sps_range_index* index,
+                                          uint32_t i) {
+    uint32_t pos = index->head + index->capacity - index->count + i;
+
+    return index->timestamps[pos % index->capacity];
+}
+
+/* Number of samples with a timestamp less than (or equal to) timestamp_usec */
+static uint32_t sps_range_index_rank(const struct sps_range_index* index,
+                                     uint64_t timestamp_usec,
+                                     uint8_t inclusive) {
+    uint32_t lo = 0;
+    uint32_t hi = index->count;
+    uint32_t mid;
+    uint64_t t;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        t = sps_range_index_timestamp(index, mid);
+        if (t < timestamp_usec || (inclusive && t == timestamp_usec))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Aggregate the leaves [from, to) of a tree */
+static void sps_range_index_aggregate(const struct sps_range_index* index,
+                                      const struct sps_range_node* tree,
+                                      uint32_t from, uint32_t to,
+                                      struct sps_range_node* result,
+                                      double* sum) {
+    from += index->capacity;
+    to += index->capacity;
+    while (from < to) {
+        if (from & 1) {
+            sps_range_node_merge(result, result, &tree[from]);
+            *sum += tree[from++].sum;
+        }
+        if (to & 1) {
+            sps_range_node_merge(result, result, &tree[--to]);
+            *sum += tree[to].sum;
+        }
+        from >>= 1;
+        to >>= 1;
+    }
+}
+
+int16_t sps_range_index_query(const struct sps_range_index* index,
+                              uint8_t field, uint64_t from_usec,
+                              uint64_t to_usec,
+                              struct sps_stats_summary* summary, double* sum) {
+    const struct sps_range_node* tree;
+    struct sps_range_node result = sps_range_node_empty;
+    double range_sum = 0.0;
+    uint32_t first;
+    uint32_t last;
+    uint32_t start;
+
+    if (field >= index->num_fields)
+        return SPS_RANGE_INDEX_ERR_INVALID_CONFIG;
+
+    first = sps_range_index_rank(index, from_usec, 0);
+    last = sps_range_index_rank(index, to_usec, 1);
+    summary->count = last > first ? last - first : 0;
+    if (summary->count == 0) {
+        summary->mean = 0.0f;
+        summary->min = 0.0f;
+        summary->max = 0.0f;
+        if (sum)
+            *sum = 0.0;
+        return 0;
+    }
+
+    /* The range may wrap around the end of the ring */
+    tree = sps_range_index_tree(index, field);
+    start = (index->head + index->capacity - index->count + first) %
+            index->capacity;
+    if (start + summary->count <= index->capacity) {
+        sps_range_index_aggregate(index, tree, start, start + summary->count,
+                                  &result, &range_sum);
+    } else {
+        sps_range_index_aggregate(index, tree, start, index->capacity, &result,
+                                  &range_sum);
+        sps_range_index_aggregate(index, tree, 0,
+                                  start + summary->count - index->capacity,
+                                  &result, &range_sum);
+    }
+
+    summary->mean = (float)(range_sum / summary->count);
+    summary->min = result.min;
+    summary->max = result.max;
+    if (sum)
+        *sum = range_sum;
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_RANGE_INDEX_H
+#define SPS_RANGE_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+#include "sps_stats.h"
+
+#define SPS_RANGE_INDEX_ERR_INVALID_CONFIG (-1)
+#define SPS_RANGE_INDEX_ERR_STORAGE_TOO_SMALL (-2)
+
+/**
+ * Size in bytes of the storage required by an index over the given number of
+ * samples and fields: 8 bytes per sample for the timestamp and 24 bytes per
+ * sample and field for the segment tree.
+ *
+ * E.g. 24 h of samples at 1 Hz (86400 samples) require 2.8 MB per sensor for
+ * a single field and 21.4 MB for all 10 fields of struct sps30_measurement.
+ */
+#define SPS_RANGE_INDEX_STORAGE_SIZE(capacity, num_fields) \
+    ((capacity)*8 + (capacity) * (num_fields)*24)
+
+struct sps_range_node {
+    float min;
+    float max;
+    float sum;
+};
+
+/**
+ * Ring over the most recent samples of one sensor with a segment tree per
+ * field, to answer minimum, maximum, sum and mean over any time range in
+ * O(log n), e.g. the maximum of mc_2p5 over the last 10 minutes.
+ *
+ * Adding a sample overwrites the oldest one once the ring is full and costs
+ * O(log n) per field. The memory is provided by the caller, see
+ * SPS_RANGE_INDEX_STORAGE_SIZE.
+ *
+ * The members are private, use the sps_range_index_* functions.
+ */
+struct sps_range_index {
+    uint64_t* timestamps;
+    struct sps_range_node* nodes;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t head; /* position of the next sample */
+    uint8_t num_fields;
+};
+
+/**
+ * sps_range_index_init() - initialize an empty index
+ *
+ * @index:          Index to initialize
+ * @capacity:       Number of samples kept
+ * @num_fields:     Number of values per sample
+ * @storage:        64 bit aligned memory which must stay valid as long as the
+ *                  index is used
+ * @storage_size:   Size of storage, at least SPS_RANGE_INDEX_STORAGE_SIZE()
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t sps_range_index_init(struct sps_range_index* index, uint32_t capacity,
+                             uint8_t num_fields, void* storage,
+                             uint32_t storage_size);
+
+/**
+ * sps_range_index_add() - add a sample
+ *
+ * Timestamps are expected to be monotonic, e.g. from
+ * sps30_read_measurement_ts().
+ *
+ * @index:          Index to add the sample to
+ * @timestamp_usec: Time of the sample
+ * @values:         num_fields values of the sample, e.g. filled with
+ *                  sps30_get_measurement_field()
+ */
+void sps_range_index_add(struct sps_range_index* index,
+                         uint64_t timestamp_usec, const float* values);
+
+/**
+ * sps_range_index_query() - compute count, sum, mean, minimum and maximum
+ *                           of a field over a time range
+ *
+ * Note that sum, mean, min and max are 0 if the range contains no samples.
+ *
+ * @index:      Index to query
+ * @field:      Index of the field, less than num_fields
+ * @from_usec:  Start of the range (inclusive)
+ * @to_usec:    End of the range (inclusive)
+ * @summary:    Memory where the summary is stored
+ * @sum:        Memory where the sum is stored, may be NULL
+ * Return:      0 on success, SPS_RANGE_INDEX_ERR_INVALID_CONFIG if the field
+ *              does not exist
+ */
+int16_t sps_range_index_query(const struct sps_range_index* index,
+                              uint8_t field, uint64_t from_usec,
+                              uint64_t to_usec,
+                              struct sps_stats_summary* summary, double* sum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_RANGE_INDEX_H */
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_reader.h"
+#include "sensirion_uart.h"
+#include <string.h>
+
+static void sps_reader_read_port(struct sps_reader* reader, uint8_t port,
+                                 uint8_t* record) {
+    struct sensirion_shdlc_rx_timestamps ts;
+    struct sps_reader_record header;
+    int16_t ret;
+
+    if (reader->config.select_port)
+        ret = reader->config.select_port(port);
+    else
+        ret = sensirion_uart_select_port(port);
+    if (ret == 0) {
+        sensirion_shdlc_set_port(port);
+        ret = reader->config.read(record + sizeof(header), &ts);
+    }
+    __atomic_add_fetch(&reader->stats.reads, 1, __ATOMIC_RELAXED);
+    if (ret == SPS_READER_NO_DATA) {
+        __atomic_add_fetch(&reader->stats.no_data, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (ret) {
+        __atomic_add_fetch(&reader->stats.read_errors, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&reader->stats.last_error, ret, __ATOMIC_RELAXED);
+        return;
+    }
+
+    header.timestamp_usec = ts.first_byte_usec;
+    header.sequence = reader->sequence++;
+    header.status = ret;
+    header.port = port;
+    header.reserved = 0;
+    memcpy(record, &header, sizeof(header));
+
+    /* drops are accounted for by the ring */
+    (void)sps_ring_push(reader->config.ring, record);
+}
+
+static void* sps_reader_thread(void* arg) {
+    struct sps_reader* reader = (struct sps_reader*)arg;
+    /* uint64_t for the alignment of the measurement structs */
+    uint64_t
+        record[SPS_READER_RECORD_SIZE(SPS_READER_MAX_MEASUREMENT_SIZE) / 8];
+    uint64_t next_sweep = sensirion_get_time_usec();
+    uint64_t now;
+    uint8_t i;
+
+    while (__atomic_load_n(&reader->running, __ATOMIC_ACQUIRE)) {
+        for (i = 0; i < reader->config.num_ports; ++i)
+            sps_reader_read_port(reader, reader->config.ports[i],
+                                 (uint8_t*)record);
+        __atomic_add_fetch(&reader->stats.sweeps, 1, __ATOMIC_RELAXED);
+
+        next_sweep += reader->config.interval_usec;
+        now = sensirion_get_time_usec();
+        if (next_sweep > now)
+            sensirion_sleep_usec((uint32_t)(next_sweep - now));
+        else
+            next_sweep = now; /* overrun, don't try to catch up */
+    }
+    return NULL;
+}
+
+int16_t sps_reader_start(struct sps_reader* reader,
+                         const struct sps_reader_config* config) {
+    if (!config->read || !config->ring || !config->ports ||
+        config->num_ports == 0 ||
+        config->measurement_size > SPS_READER_MAX_MEASUREMENT_SIZE ||
+        config->ring->element_size !=
+            SPS_READER_RECORD_SIZE(config->measurement_size))
+        return SPS_READER_ERR_INVALID_CONFIG;
+
+    reader->config = *config;
+    memset(&reader->stats, 0, sizeof(reader->stats));
+    reader->sequence = 0;
+    reader->running = 1;
+
+    if (pthread_create(&reader->thread, NULL, sps_reader_thread, reader)) {
+        reader->running = 0;
+        return SPS_READER_ERR_THREAD;
+    }
+    return 0;
+}
+
+int16_t sps_reader_stop(struct sps_reader* reader) {
+    if (!reader->running)
+        return 0;
+
+    __atomic_store_n(&reader->running, 0, __ATOMIC_RELEASE);
+    if (pthread_join(reader->thread, NULL))
+        return SPS_READER_ERR_THREAD;
+    return 0;
+}
+
+void sps_reader_get_stats(struct sps_reader* reader,
+                          struct sps_reader_stats* stats) {
+    stats->sweeps = __atomic_load_n(&reader->stats.sweeps, __ATOMIC_RELAXED);
+    stats->reads = __atomic_load_n(&reader->stats.reads, __ATOMIC_RELAXED);
+    stats->no_data = __atomic_load_n(&reader->stats.no_data, __ATOMIC_RELAXED);
+    stats->read_errors =
+        __atomic_load_n(&reader->stats.read_errors, __ATOMIC_RELAXED);
+    stats->last_error =
+        __atomic_load_n(&reader->stats.last_error, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_READER_H
+#define SPS_READER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+
+#include "sensirion_arch_config.h"
+#include "sensirion_shdlc.h"
+#include "sps_ring.h"
+
+#define SPS_READER_ERR_INVALID_CONFIG (-1)
+#define SPS_READER_ERR_THREAD (-2)
+
+/** Returned by the read function if no new measurement is available yet */
+#define SPS_READER_NO_DATA 1
+
+/**
+ * Read function of the driver, e.g. a wrapper around
+ * sps30_read_measurement_ts():
+ *
+ *   static int16_t read_sps30(void* measurement,
+ *                             struct sensirion_shdlc_rx_timestamps* ts) {
+ *       int16_t ret = sps30_read_measurement_ts(
+ *           (struct sps30_measurement*)measurement, ts);
+ *       return ret == SPS30_ERR_NOT_ENOUGH_DATA ? SPS_READER_NO_DATA : ret;
+ *   }
+ *
+ * Return 0 if a measurement was read, SPS_READER_NO_DATA if no new
+ * measurement is available yet and an error code otherwise.
+ */
+typedef int16_t (*sps_reader_read_fn)(void* measurement,
+                                      struct sensirion_shdlc_rx_timestamps* ts);
+
+/**
+ * Port selection of the driver, e.g. sps30_select_port() to keep the port of
+ * the SPS30 driver and its metadata cache in sync
+ */
+typedef int16_t (*sps_reader_select_port_fn)(uint8_t port);
+
+/**
+ * Header of each record published by the reader service. The measurement
+ * (measurement_size bytes) immediately follows the header, thus records can
+ * be declared as
+ *
+ *   struct sps30_record {
+ *       struct sps_reader_record header;
+ *       struct sps30_measurement measurement;
+ *   };
+ */
+struct sps_reader_record {
+    uint64_t timestamp_usec; /* arrival of the first byte of the response */
+    uint32_t sequence;       /* incremented for every published record */
+    int16_t status;          /* 0, reads which failed are not published */
+    uint8_t port;            /* UART port the measurement was read from */
+    uint8_t reserved;
+};
+
+/**
+ * Size of a ring element holding a record with the given measurement size,
+ * padded like the record struct above
+ */
+#define SPS_READER_RECORD_SIZE(measurement_size) \
+    ((sizeof(struct sps_reader_record) + (measurement_size) + 7) / 8 * 8)
+
+/** Largest supported measurement */
+#define SPS_READER_MAX_MEASUREMENT_SIZE 64
+
+struct sps_reader_config {
+    sps_reader_read_fn read;
+    /* NULL to select the ports with sensirion_uart_select_port() */
+    sps_reader_select_port_fn select_port;
+    uint16_t measurement_size;
+    const uint8_t* ports;   /* ports passed to select_port */
+    uint8_t num_ports;
+    uint32_t interval_usec; /* time between two sweeps over all ports */
+    struct sps_ring* ring;  /* element size: SPS_READER_RECORD_SIZE() */
+};
+
+struct sps_reader_stats {
+    uint32_t sweeps;
+    uint32_t reads;
+    uint32_t no_data;       /* reads without a new measurement */
+    uint32_t read_errors;
+    int16_t last_error;
+};
+
+/**
+ * Reader service which owns the UART ports in its own thread and publishes
+ * timestamped measurements into a ring. The members are private.
+ */
+struct sps_reader {
+    struct sps_reader_config config;
+    struct sps_reader_stats stats;
+    pthread_t thread;
+    uint32_t sequence;
+    uint8_t running;
+};
+
+/**
+ * sps_reader_start() - start the reader thread
+ *
+ * The sensors must be probed and measuring already. While the service is
+ * running, no other thread may access the UART or the drivers.
+ *
+ * @reader: Reader service to start
+ * @config: Configuration, copied into reader. ports must stay valid.
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_reader_start(struct sps_reader* reader,
+                         const struct sps_reader_config* config);
+
+/**
+ * sps_reader_stop() - stop the reader thread and wait for it to terminate
+ *
+ * @reader: Reader service to stop
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_reader_stop(struct sps_reader* reader);
+
+/**
+ * sps_reader_get_stats() - read the read and error counters
+ *
+ * @reader: Reader service to query
+ * @stats:  Memory where the counters are stored
+ */
+void sps_reader_get_stats(struct sps_reader* reader,
+                          struct sps_reader_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_READER_H */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_report_filter.h"
+
+int16_t sps_report_filter_init(struct sps_report_filter* filter,
+                               const struct sps_report_filter_config* config) {
+    if (config->num_fields == 0 ||
+        config->num_fields > SPS_REPORT_FILTER_MAX_FIELDS ||
+        !config->abs_threshold || !config->rel_threshold)
+        return SPS_REPORT_FILTER_ERR_INVALID_CONFIG;
+
+    filter->config = *config;
+    filter->last_report_usec = 0;
+    filter->has_report = 0;
+    filter->stats.reported = 0;
+    filter->stats.suppressed = 0;
+    return 0;
+}
+
+static uint8_t sps_report_filter_deviates(const struct sps_report_filter* f,
+                                          const float* values) {
+    float last;
+    float diff;
+    float band;
+    uint8_t i;
+
+    for (i = 0; i < f->config.num_fields; ++i) {
+        last = f->last[i];
+        /* A change from or to NaN always deviates */
+        if ((values[i] != values[i]) != (last != last))
+            return 1;
+        if (values[i] != values[i])
+            continue;
+
+        diff = values[i] > last ? values[i] - last : last - values[i];
+        band = f->config.rel_threshold[i] * (last < 0 ? -last : last);
+        if (band < f->config.abs_threshold[i])
+            band = f->config.abs_threshold[i];
+        if (diff > band)
+            return 1;
+    }
+    return 0;
+}
+
+uint8_t sps_report_filter_check(struct sps_report_filter* filter,
+                                uint64_t timestamp_usec, const float* values) {
+    uint8_t i;
+
+    if (filter->has_report &&
+        (filter->config.max_silence_usec == 0 ||
+         timestamp_usec - filter->last_report_usec <
+             filter->config.max_silence_usec) &&
+        !sps_report_filter_deviates(filter, values)) {
+        ++filter->stats.suppressed;
+        return 0;
+    }
+
+    for (i = 0; i < filter->config.num_fields; ++i)
+        filter->last[i] = values[i];
+    filter->last_report_usec = timestamp_usec;
+    filter->has_report = 1;
+    ++filter->stats.reported;
+    return 1;
+}
+
+void sps_report_filter_reset(struct sps_report_filter* filter) {
+    filter->has_report = 0;
+}
+
+void sps_report_filter_get_stats(const struct sps_report_filter* filter,
+                                 struct sps_report_filter_stats* stats) {
+    *stats = filter->stats;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_REPORT_FILTER_H
+#define SPS_REPORT_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_REPORT_FILTER_ERR_INVALID_CONFIG (-1)
+
+/** Maximum number of float fields per sample */
+#define SPS_REPORT_FILTER_MAX_FIELDS 16
+
+/**
+ * Thresholds of the dead-band filter. A field deviates if it differs from its
+ * last reported value by more than max(abs, rel * |last reported value|).
+ *
+ * The threshold arrays are not copied and may be shared by the filters of
+ * several sensors.
+ */
+struct sps_report_filter_config {
+    uint8_t num_fields;          /* float fields per sample */
+    const float* abs_threshold;  /* num_fields absolute thresholds */
+    const float* rel_threshold;  /* num_fields relative thresholds, e.g. 0.05 */
+    uint64_t max_silence_usec;   /* heartbeat, 0 to disable */
+};
+
+struct sps_report_filter_stats {
+    uint32_t reported;
+    uint32_t suppressed;
+};
+
+/**
+ * Per-sensor dead-band filter which passes a sample only if any field
+ * deviates from the last reported sample, or the last report is older than
+ * the heartbeat interval.
+ *
+ * Every suppressed sample is within the thresholds of the last reported
+ * sample, thus consumers which hold the last reported sample never see an
+ * error larger than the thresholds, for at most max_silence_usec.
+ *
+ * The members are private.
+ */
+struct sps_report_filter {
+    struct sps_report_filter_config config;
+    float last[SPS_REPORT_FILTER_MAX_FIELDS];
+    uint64_t last_report_usec;
+    uint8_t has_report;
+    struct sps_report_filter_stats stats;
+};
+
+/**
+ * sps_report_filter_init() - initialize a filter, the next sample is always
+ *                            reported
+ *
+ * @filter: Filter to initialize
+ * @config: Configuration, copied into filter
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_report_filter_init(struct sps_report_filter* filter,
+                               const struct sps_report_filter_config* config);
+
+/**
+ * sps_report_filter_check() - decide whether a sample must be reported
+ *
+ * If the sample is reported, it becomes the new reference for the dead-band.
+ *
+ * @filter:         Filter of the sensor
+ * @timestamp_usec: Monotonic time of the sample
+ * @values:         num_fields values of the sample, e.g. filled with
+ *                  sps30_get_measurement_field()
+ * Return:          1 if the sample must be reported, 0 if it is suppressed
+ */
+uint8_t sps_report_filter_check(struct sps_report_filter* filter,
+                                uint64_t timestamp_usec, const float* values);
+
+/**
+ * sps_report_filter_reset() - report the next sample unconditionally, e.g.
+ *                             after a read error or reconnect of a consumer
+ *
+ * @filter: Filter to reset
+ */
+void sps_report_filter_reset(struct sps_report_filter* filter);
+
+/**
+ * sps_report_filter_get_stats() - read the number of reported and suppressed
+ *                                 samples
+ *
+ * @filter: Filter to query
+ * @stats:  Memory where the statistics are stored
+ */
+void sps_report_filter_get_stats(const struct sps_report_filter* filter,
+                                 struct sps_report_filter_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_REPORT_FILTER_H */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_ring.h"
+#include <string.h>
+
+/*
+ * head and tail are free running indices, the slot of an index is obtained by
+ * masking it with capacity - 1.
+ *
+ * The consumer copies an element before it advances tail with a
+ * compare-and-swap. When the ring is full and the policy is to overwrite, the
+ * producer advances tail itself before reusing the oldest slot. A consumer
+ * which copied that slot concurrently then fails its compare-and-swap,
+ * discards the (possibly torn) copy and retries with the next element.
+ */
+
+static uint8_t* sps_ring_slot(struct sps_ring* ring, uint32_t index) {
+    return ring->buffer + (index & ring->mask) * ring->element_size;
+}
+
+static void sps_ring_inc_stat(uint32_t* counter) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELAXED);
+}
+
+int16_t sps_ring_init(struct sps_ring* ring, void* buffer,
+                      uint32_t element_size, uint32_t capacity,
+                      enum sps_ring_policy policy) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return SPS_RING_ERR_INVALID_CAPACITY;
+
+    ring->buffer = (uint8_t*)buffer;
+    ring->element_size = element_size;
+    ring->mask = capacity - 1;
+    ring->policy = policy;
+    ring->head = 0;
+    ring->tail = 0;
+    memset(&ring->stats, 0, sizeof(ring->stats));
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return 0;
+}
+
+int16_t sps_ring_push(struct sps_ring* ring, const void* element) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail > ring->mask) {
+        if (ring->policy == SPS_RING_BACKPRESSURE) {
+            sps_ring_inc_stat(&ring->stats.rejected);
+            return SPS_RING_ERR_FULL;
+        }
+        /* On failure the consumer just freed a slot, which is fine as well */
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            sps_ring_inc_stat(&ring->stats.overwritten);
+    }
+
+    memcpy(sps_ring_slot(ring, head), element, ring->element_size);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    sps_ring_inc_stat(&ring->stats.pushed);
+    return 0;
+}
+
+int16_t sps_ring_pop(struct sps_ring* ring, void* element) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t head;
+
+    do {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (tail == head)
+            return SPS_RING_ERR_EMPTY;
+
+        memcpy(element, sps_ring_slot(ring, tail), ring->element_size);
+    } while (!__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return 0;
+}
+
+uint32_t sps_ring_count(struct sps_ring* ring) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    return head - tail;
+}
+
+void sps_ring_get_stats(struct sps_ring* ring, struct sps_ring_stats* stats) {
+    stats->pushed = __atomic_load_n(&ring->stats.pushed, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&ring->stats.rejected, __ATOMIC_RELAXED);
+    stats->overwritten =
+        __atomic_load_n(&ring->stats.overwritten, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_RING_H
+#define SPS_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_RING_ERR_EMPTY (-1)
+#define SPS_RING_ERR_FULL (-2)
+#define SPS_RING_ERR_INVALID_CAPACITY (-3)
+
+/**
+ * Behavior of sps_ring_push() when the ring is full
+ */
+enum sps_ring_policy {
+    /** Discard the oldest element to make room for the new one */
+    SPS_RING_OVERWRITE_OLDEST,
+    /** Reject the new element, the producer has to retry or drop it */
+    SPS_RING_BACKPRESSURE,
+};
+
+struct sps_ring_stats {
+    uint32_t pushed;      /* elements stored */
+    uint32_t rejected;    /* elements not stored due to backpressure */
+    uint32_t overwritten; /* elements discarded before they were popped */
+};
+
+/**
+ * Lock-free single-producer/single-consumer ring buffer of fixed-size
+ * elements.
+ *
+ * Exactly one thread may call sps_ring_push() and exactly one (other) thread
+ * may call sps_ring_pop(). Neither of them ever blocks. The storage is
+ * provided by the caller, no memory is allocated.
+ *
+ * The members are private, use the sps_ring_* functions to access the ring.
+ * The implementation relies on the __atomic builtins of GCC and Clang.
+ */
+struct sps_ring {
+    uint8_t* buffer;
+    uint32_t element_size;
+    uint32_t mask;
+    enum sps_ring_policy policy;
+    uint32_t head;
+    uint32_t tail;
+    struct sps_ring_stats stats;
+};
+
+/**
+ * sps_ring_init() - initialize an empty ring
+ *
+ * @ring:           Ring to initialize
+ * @buffer:         Storage of at least element_size * capacity bytes which
+ *                  must stay valid as long as the ring is used
+ * @element_size:   Size of one element in bytes
+ * @capacity:       Number of elements, must be a power of two
+ * @policy:         Behavior when pushing to a full ring
+ * Return:          0 on success, SPS_RING_ERR_INVALID_CAPACITY if capacity is
+ *                  not a power of two
+ */
+int16_t sps_ring_init(struct sps_ring* ring, void* buffer,
+                      uint32_t element_size, uint32_t capacity,
+                      enum sps_ring_policy policy);
+
+/**
+ * sps_ring_push() - append an element (producer only)
+ *
+ * @ring:       Ring to append to
+ * @element:    Element of element_size bytes to copy into the ring
+ * Return:      0 on success, SPS_RING_ERR_FULL if the ring is full and the
+ *              policy is SPS_RING_BACKPRESSURE
+ */
+int16_t sps_ring_push(struct sps_ring* ring, const void* element);
+
+/**
+ * sps_ring_pop() - remove the oldest element (consumer only)
+ *
+ * @ring:       Ring to remove the element from
+ * @element:    Memory of element_size bytes where the element is copied to
+ * Return:      0 on success, SPS_RING_ERR_EMPTY if there is no element
+ */
+int16_t sps_ring_pop(struct sps_ring* ring, void* element);
+
+/**
+ * sps_ring_count() - number of elements currently stored
+ *
+ * The value is only a snapshot when called concurrently to push or pop.
+ *
+ * @ring:   Ring to query
+ * Return:  Number of elements in the ring
+ */
+uint32_t sps_ring_count(struct sps_ring* ring);
+
+/**
+ * sps_ring_get_stats() - read the push and drop counters
+ *
+ * @ring:   Ring to query
+ * @stats:  Memory where the counters are stored
+ */
+void sps_ring_get_stats(struct sps_ring* ring, struct sps_ring_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_RING_H */
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_shm.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SPS_SHM_MAGIC 0x4d535053 /* "SPSM" */
+#define SPS_SHM_VERSION 1
+
+struct sps_shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t record_size;
+    uint32_t slot_stride;
+    uint32_t state; /* SPS_SHM_STATE_* */
+    uint32_t reserved[2];
+};
+
+#define SPS_SHM_STATE_ACTIVE 0
+/* The publisher replaced the segment by a new one with the same name */
+#define SPS_SHM_STATE_STALE 1
+
+/*
+ * Every slot starts with a 64 bit aligned seqlock counter followed by the
+ * record. The counter is odd while the publisher is writing the record and is
+ * incremented by two for each record published.
+ */
+#define SPS_SHM_SLOT_HEADER_SIZE 8
+
+static uint32_t* sps_shm_slot_seq(const struct sps_shm* shm, uint32_t slot) {
+    return (uint32_t*)(shm->base + sizeof(struct sps_shm_header) +
+                       (size_t)slot * shm->slot_stride);
+}
+
+static uint8_t* sps_shm_slot_record(const struct sps_shm* shm,
+                                    uint32_t slot) {
+    return (uint8_t*)sps_shm_slot_seq(shm, slot) + SPS_SHM_SLOT_HEADER_SIZE;
+}
+
+static uint8_t sps_shm_header_matches(const struct sps_shm_header* a,
+                                     const struct sps_shm_header* b) {
+    return a->magic == b->magic && a->version == b->version &&
+           a->num_slots == b->num_slots && a->record_size == b->record_size &&
+           a->slot_stride == b->slot_stride;
+}
+
+/*
+ * Map an existing segment of the publisher and check whether it can be
+ * reused. The segment is never truncated since readers may still map it.
+ */
+static int16_t sps_shm_publisher_reuse(struct sps_shm* shm, const char* name,
+                                       const struct sps_shm_header* header) {
+    struct sps_shm_header existing;
+    struct stat st;
+    void* base;
+    int fd;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return SPS_SHM_ERR_SYSTEM;
+    if (fstat(fd, &st) || (uint64_t)st.st_size < sizeof(existing)) {
+        close(fd);
+        return SPS_SHM_ERR_INVALID_SEGMENT;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return SPS_SHM_ERR_SYSTEM;
+
+    memcpy(&existing, base, sizeof(existing));
+    if ((uint64_t)st.st_size == shm->size &&
+        sps_shm_header_matches(&existing, header) &&
+        existing.state == SPS_SHM_STATE_ACTIVE) {
+        shm->base = (uint8_t*)base;
+        return 0;
+    }
+
+    /* Tell readers of the old segment to reopen by name */
+    if ((uint64_t)st.st_size >= sizeof(existing) &&
+        existing.magic == SPS_SHM_MAGIC)
+        __atomic_store_n(&((struct sps_shm_header*)base)->state,
+                         SPS_SHM_STATE_STALE, __ATOMIC_RELEASE);
+    munmap(base, (size_t)st.st_size);
+    return SPS_SHM_ERR_INVALID_SEGMENT;
+}
+
+int16_t sps_shm_publisher_open(struct sps_shm* shm, const char* name,
+                               uint32_t num_slots, uint32_t record_size) {
+    struct sps_shm_header header;
+    void* base;
+    int16_t ret;
+    int fd;
+
+    header.magic = SPS_SHM_MAGIC;
+    header.version = SPS_SHM_VERSION;
+    header.num_slots = num_slots;
+    header.record_size = record_size;
+    header.slot_stride = (SPS_SHM_SLOT_HEADER_SIZE + record_size + 7) / 8 * 8;
+    header.state = SPS_SHM_STATE_ACTIVE;
+    memset(header.reserved, 0, sizeof(header.reserved));
+
+    shm->num_slots = num_slots;
+    shm->record_size = record_size;
+    shm->slot_stride = header.slot_stride;
+    shm->size = (uint32_t)sizeof(header) + num_slots * header.slot_stride;
+
+    /* A restarted publisher keeps publishing into a matching segment */
+    ret = sps_shm_publisher_reuse(shm, name, &header);
+    if (ret == 0)
+        return 0;
+
+    /*
+     * Otherwise the name is bound to a new segment. Readers still mapping an
+     * old segment keep a valid mapping and see it marked stale.
+     */
+    if (ret == SPS_SHM_ERR_INVALID_SEGMENT && shm_unlink(name))
+        return SPS_SHM_ERR_SYSTEM;
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return SPS_SHM_ERR_SYSTEM;
+    if (ftruncate(fd, (off_t)shm->size)) {
+        close(fd);
+        return SPS_SHM_ERR_SYSTEM;
+    }
+    base = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return SPS_SHM_ERR_SYSTEM;
+
+    shm->base = (uint8_t*)base;
+    /* The header is written last so readers never see a partial segment */
+    memcpy(shm->base, &header, sizeof(header));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return 0;
+}
+
+int16_t sps_shm_publish(struct sps_shm* shm, uint32_t slot,
+                        const void* record) {
+    uint32_t* seq;
+    uint32_t s;
+
+    if (slot >= shm->num_slots)
+        return SPS_SHM_ERR_INVALID_SLOT;
+
+    seq = sps_shm_slot_seq(shm, slot);
+    /* Odd if a previous publisher died while writing the slot */
+    s = __atomic_load_n(seq, __ATOMIC_RELAXED) & ~(uint32_t)1;
+    __atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(sps_shm_slot_record(shm, slot), record, shm->record_size);
+    __atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int16_t sps_shm_reader_open(struct sps_shm* shm, const char* name) {
+    struct sps_shm_header header;
+    struct stat st;
+    void* base;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return SPS_SHM_ERR_SYSTEM;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(header)) {
+        close(fd);
+        return SPS_SHM_ERR_INVALID_SEGMENT;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return SPS_SHM_ERR_SYSTEM;
+
+    shm->base = (uint8_t*)base;
+    shm->size = (uint32_t)st.st_size;
+    memcpy(&header, shm->base, sizeof(header));
+    if (header.magic != SPS_SHM_MAGIC || header.version != SPS_SHM_VERSION ||
+        sizeof(header) + (uint64_t)header.num_slots * header.slot_stride >
+            shm->size) {
+        munmap(base, shm->size);
+        return SPS_SHM_ERR_INVALID_SEGMENT;
+    }
+
+    shm->num_slots = header.num_slots;
+    shm->record_size = header.record_size;
+    shm->slot_stride = header.slot_stride;
+    return 0;
+}
+
+int16_t sps_shm_read_latest(const struct sps_shm* shm, uint32_t slot,
+                            void* record, uint32_t* sequence) {
+    const uint32_t* seq;
+    uint32_t before;
+    uint32_t after;
+    uint16_t i;
+
+    if (slot >= shm->num_slots)
+        return SPS_SHM_ERR_INVALID_SLOT;
+    if (__atomic_load_n(&((const struct sps_shm_header*)shm->base)->state,
+                        __ATOMIC_ACQUIRE) != SPS_SHM_STATE_ACTIVE)
+        return SPS_SHM_ERR_STALE;
+
+    seq = sps_shm_slot_seq(shm, slot);
+    for (i = 0; i < SPS_SHM_READ_RETRIES; ++i) {
+        before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (before == 0)
+            return SPS_SHM_ERR_NO_DATA;
+        if (before & 1)
+            continue;
+
+        memcpy(record, sps_shm_slot_record(shm, slot), shm->record_size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(seq, __ATOMIC_RELAXED);
+        if (before == after) {
+            if (sequence)
+                *sequence = before / 2;
+            return 0;
+        }
+    }
+    return SPS_SHM_ERR_BUSY;
+}
+
+uint32_t sps_shm_get_record_size(const struct sps_shm* shm) {
+    return shm->record_size;
+}
+
+int16_t sps_shm_close(struct sps_shm* shm, const char* name) {
+    int16_t ret = 0;
+
+    if (munmap(shm->base, shm->size))
+        ret = SPS_SHM_ERR_SYSTEM;
+    shm->base = (uint8_t*)NULL;
+    if (name && shm_unlink(name))
+        ret = SPS_SHM_ERR_SYSTEM;
+    return ret;
+}
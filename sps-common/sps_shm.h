@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_SHM_H
+#define SPS_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_SHM_ERR_SYSTEM (-1)
+#define SPS_SHM_ERR_INVALID_SEGMENT (-2)
+#define SPS_SHM_ERR_INVALID_SLOT (-3)
+#define SPS_SHM_ERR_NO_DATA (-4)
+#define SPS_SHM_ERR_BUSY (-5)
+#define SPS_SHM_ERR_STALE (-6)
+
+/**
+ * Number of attempts of sps_shm_read_latest() to get a consistent copy while
+ * the publisher keeps overwriting the slot
+ */
+#ifndef SPS_SHM_READ_RETRIES
+#define SPS_SHM_READ_RETRIES 100
+#endif
+
+/**
+ * Publisher and readers of a POSIX shared memory segment holding the latest
+ * record of each slot (e.g. one slot per sensor), each protected by a
+ * seqlock. The publisher never waits for readers and readers don't need any
+ * syscall after opening the segment.
+ *
+ * There must be only one publisher per segment. The members are private.
+ */
+struct sps_shm {
+    uint8_t* base;
+    uint32_t size;
+    uint32_t num_slots;
+    uint32_t record_size;
+    uint32_t slot_stride;
+};
+
+/**
+ * sps_shm_publisher_open() - create or reuse and map a segment
+ *
+ * An existing segment with the same number of slots and record size is
+ * reused, e.g. when the publisher restarts, thus readers keep their mapping.
+ * Otherwise a new segment is created under the name and the old one is marked
+ * stale, which readers detect through SPS_SHM_ERR_STALE.
+ *
+ * @shm:            Handle to initialize
+ * @name:           Name of the segment as passed to shm_open, e.g. "/sps30"
+ * @num_slots:      Number of slots
+ * @record_size:    Size of the record stored per slot in bytes
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t sps_shm_publisher_open(struct sps_shm* shm, const char* name,
+                               uint32_t num_slots, uint32_t record_size);
+
+/**
+ * sps_shm_publish() - store the latest record of a slot
+ *
+ * @shm:    Publisher handle
+ * @slot:   Slot index
+ * @record: Record of record_size bytes
+ * Return:  0 on success, SPS_SHM_ERR_INVALID_SLOT if slot is out of range
+ */
+int16_t sps_shm_publish(struct sps_shm* shm, uint32_t slot, const void* record);
+
+/**
+ * sps_shm_reader_open() - map an existing segment read-only
+ *
+ * @shm:    Handle to initialize
+ * @name:   Name of the segment as passed to shm_open
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_shm_reader_open(struct sps_shm* shm, const char* name);
+
+/**
+ * sps_shm_read_latest() - copy the latest record of a slot
+ *
+ * Note that record and sequence must be discarded on failure.
+ *
+ * @shm:        Reader handle
+ * @slot:       Slot index
+ * @record:     Memory of record_size bytes where the record is copied to
+ * @sequence:   Memory where the number of records published into this slot so
+ *              far is stored, may be NULL
+ * Return:      0 on success, SPS_SHM_ERR_NO_DATA if nothing was published
+ *              yet, SPS_SHM_ERR_BUSY if no consistent copy could be made,
+ *              SPS_SHM_ERR_STALE if the publisher replaced the segment and
+ *              the reader has to close and reopen it
+ */
+int16_t sps_shm_read_latest(const struct sps_shm* shm, uint32_t slot,
+                            void* record, uint32_t* sequence);
+
+/**
+ * sps_shm_get_record_size() - size of the records stored in the segment
+ *
+ * @shm:    Publisher or reader handle
+ * Return:  Record size in bytes
+ */
+uint32_t sps_shm_get_record_size(const struct sps_shm* shm);
+
+/**
+ * sps_shm_close() - unmap the segment
+ *
+ * @shm:    Publisher or reader handle
+ * @name:   Name of the segment to remove, NULL to keep it for other processes
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps_shm_close(struct sps_shm* shm, const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_SHM_H */
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_stats.h"
+#include <string.h>
+
+static struct sps_stats_bucket*
+sps_stats_bucket_of(const struct sps_stats_window* window, uint32_t bucket) {
+    return &window->buckets[bucket % window->config.num_buckets];
+}
+
+static uint32_t sps_stats_deque_back(const struct sps_stats_window* window,
+                                     const struct sps_stats_deque* deque) {
+    return deque->buckets[(deque->first + deque->len - 1) %
+                          window->config.num_buckets];
+}
+
+static uint32_t sps_stats_deque_front(const struct sps_stats_deque* deque) {
+    return deque->buckets[deque->first];
+}
+
+/**
+ * Append a finished bucket to the monotonic deque. Buckets which can never
+ * become the extremum again (since the new one is newer and at least as
+ * extreme) are dropped from the back.
+ */
+static void sps_stats_deque_push(const struct sps_stats_window* window,
+                                 struct sps_stats_deque* deque,
+                                 uint32_t bucket, uint8_t is_max) {
+    float value = is_max ? sps_stats_bucket_of(window, bucket)->max
+                         : sps_stats_bucket_of(window, bucket)->min;
+    struct sps_stats_bucket* back;
+
+    while (deque->len) {
+        back = sps_stats_bucket_of(window, sps_stats_deque_back(window, deque));
+        if (is_max ? back->max > value : back->min < value)
+            break;
+        --deque->len;
+    }
+    deque->buckets[(deque->first + deque->len) % window->config.num_buckets] =
+        bucket;
+    ++deque->len;
+}
+
+static void sps_stats_deque_expire(const struct sps_stats_window* window,
+                                   struct sps_stats_deque* deque,
+                                   uint32_t bucket) {
+    if (deque->len && sps_stats_deque_front(deque) == bucket) {
+        deque->first = (deque->first + 1) % window->config.num_buckets;
+        --deque->len;
+    }
+}
+
+/**
+ * Prepare the slot of a new bucket by expiring the bucket stored in it before
+ */
+static void sps_stats_bucket_reuse(struct sps_stats_window* window,
+                                   uint32_t bucket) {
+    struct sps_stats_bucket* b = sps_stats_bucket_of(window, bucket);
+    uint32_t expired = bucket - window->config.num_buckets;
+    uint16_t* bins;
+    uint16_t i;
+
+    if (b->count) {
+        window->count -= b->count;
+        window->sum -= b->sum;
+        sps_stats_deque_expire(window, &window->min_deque, expired);
+        sps_stats_deque_expire(window, &window->max_deque, expired);
+        if (window->config.num_bins) {
+            bins = &window->bucket_bins[(bucket % window->config.num_buckets) *
+                                        window->config.num_bins];
+            for (i = 0; i < window->config.num_bins; ++i) {
+                window->bins[i] -= bins[i];
+                bins[i] = 0;
+            }
+        }
+    }
+    b->sum = 0;
+    b->count = 0;
+}
+
+int16_t sps_stats_window_init(struct sps_stats_window* window,
+                              const struct sps_stats_window_config* config,
+                              void* storage, uint32_t storage_size) {
+    uint8_t* mem = (uint8_t*)storage;
+
+    if (config->num_buckets == 0 || config->bucket_usec == 0 ||
+        (config->num_bins && config->histogram_max <= config->histogram_min))
+        return SPS_STATS_ERR_INVALID_CONFIG;
+    if (storage_size < SPS_STATS_WINDOW_STORAGE_SIZE(
+                           (uint32_t)config->num_buckets, config->num_bins))
+        return SPS_STATS_ERR_STORAGE_TOO_SMALL;
+
+    memset(storage, 0, storage_size);
+    window->config = *config;
+    window->buckets = (struct sps_stats_bucket*)mem;
+    mem += sizeof(struct sps_stats_bucket) * config->num_buckets;
+    window->min_deque.buckets = (uint32_t*)mem;
+    mem += sizeof(uint32_t) * config->num_buckets;
+    window->max_deque.buckets = (uint32_t*)mem;
+    mem += sizeof(uint32_t) * config->num_buckets;
+    window->bins = (uint32_t*)mem;
+    mem += sizeof(uint32_t) * config->num_bins;
+    window->bucket_bins = (uint16_t*)mem;
+
+    window->min_deque.first = 0;
+    window->min_deque.len = 0;
+    window->max_deque.first = 0;
+    window->max_deque.len = 0;
+    window->current = 0;
+    window->started = 0;
+    window->count = 0;
+    window->sum = 0;
+    return 0;
+}
+
+void sps_stats_window_advance(struct sps_stats_window* window,
+                              uint64_t timestamp_usec) {
+    uint32_t bucket = (uint32_t)(timestamp_usec / window->config.bucket_usec);
+    uint32_t steps;
+
+    if (!window->started) {
+        window->current = bucket;
+        window->started = 1;
+        return;
+    }
+    if (bucket <= window->current)
+        return;
+
+    /* The current bucket is complete and takes part in the deques now */
+    if (sps_stats_bucket_of(window, window->current)->count) {
+        sps_stats_deque_push(window, &window->min_deque, window->current, 0);
+        sps_stats_deque_push(window, &window->max_deque, window->current, 1);
+    }
+
+    steps = bucket - window->current;
+    if (steps >= window->config.num_buckets) {
+        /* All samples are outdated */
+        memset(window->buckets, 0,
+               sizeof(struct sps_stats_bucket) * window->config.num_buckets);
+        memset(window->bins, 0, sizeof(uint32_t) * window->config.num_bins);
+        memset(window->bucket_bins, 0,
+               sizeof(uint16_t) * window->config.num_bins *
+                   window->config.num_buckets);
+        window->min_deque.len = 0;
+        window->max_deque.len = 0;
+        window->count = 0;
+        window->sum = 0;
+        window->current = bucket;
+        return;
+    }
+
+    while (steps--)
+        sps_stats_bucket_reuse(window, ++window->current);
+}
+
+void sps_stats_window_add(struct sps_stats_window* window,
+                          uint64_t timestamp_usec, float value) {
+    struct sps_stats_bucket* b;
+    const struct sps_stats_window_config* c = &window->config;
+    int32_t bin;
+
+    sps_stats_window_advance(window, timestamp_usec);
+    b = sps_stats_bucket_of(window, window->current);
+    if (!b->count || value < b->min)
+        b->min = value;
+    if (!b->count || value > b->max)
+        b->max = value;
+    b->sum += value;
+    ++b->count;
+    window->sum += value;
+    ++window->count;
+
+    if (c->num_bins) {
+        bin = (int32_t)((value - c->histogram_min) * (float)c->num_bins /
+                        (c->histogram_max - c->histogram_min));
+        if (bin < 0)
+            bin = 0;
+        if (bin >= c->num_bins)
+            bin = c->num_bins - 1;
+        ++window->bins[bin];
+        ++window->bucket_bins[(window->current % c->num_buckets) *
+                                  c->num_bins +
+                              (uint32_t)bin];
+    }
+}
+
+void sps_stats_window_get_summary(const struct sps_stats_window* window,
+                                  struct sps_stats_summary* summary) {
+    const struct sps_stats_bucket* cur =
+        sps_stats_bucket_of(window, window->current);
+    const struct sps_stats_bucket* b;
+
+    summary->count = window->count;
+    summary->mean = 0;
+    summary->min = 0;
+    summary->max = 0;
+    if (!window->count)
+        return;
+
+    summary->mean = (float)(window->sum / window->count);
+    if (cur->count) {
+        summary->min = cur->min;
+        summary->max = cur->max;
+    }
+    if (window->min_deque.len) {
+        b = sps_stats_bucket_of(window,
+                                sps_stats_deque_front(&window->min_deque));
+        if (!cur->count || b->min < summary->min)
+            summary->min = b->min;
+    }
+    if (window->max_deque.len) {
+        b = sps_stats_bucket_of(window,
+                                sps_stats_deque_front(&window->max_deque));
+        if (!cur->count || b->max > summary->max)
+            summary->max = b->max;
+    }
+}
+
+int16_t sps_stats_window_get_percentile(const struct sps_stats_window* window,
+                                        uint8_t percent, float* value) {
+    const struct sps_stats_window_config* c = &window->config;
+    float bin_width = (c->histogram_max - c->histogram_min) / c->num_bins;
+    uint32_t rank;
+    uint32_t seen = 0;
+    uint16_t i;
+
+    if (!c->num_bins || !window->count || percent > 100)
+        return SPS_STATS_ERR_INVALID_CONFIG;
+
+    /* rank of the sample in the sorted window, 1-based */
+    rank = (window->count * percent + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+
+    for (i = 0; i < c->num_bins; ++i) {
+        if (seen + window->bins[i] >= rank)
+            break;
+        seen += window->bins[i];
+    }
+    *value = c->histogram_min +
+             bin_width * ((float)i + (float)(rank - seen) / window->bins[i]);
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_STATS_H
+#define SPS_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_STATS_ERR_INVALID_CONFIG (-1)
+#define SPS_STATS_ERR_STORAGE_TOO_SMALL (-2)
+
+/**
+ * Size in bytes of the storage required by a window with the given number of
+ * buckets and histogram bins. Without histogram (num_bins = 0), percentiles
+ * are not available.
+ *
+ * E.g. a 1 h window of 60 buckets with 32 bins requires 5408 bytes, without
+ * histogram 1440 bytes.
+ */
+#define SPS_STATS_WINDOW_STORAGE_SIZE(num_buckets, num_bins) \
+    ((num_buckets)*24 + (num_bins)*4 + (num_buckets) * (num_bins)*2)
+
+struct sps_stats_window_config {
+    uint32_t bucket_usec; /* time covered by one bucket */
+    uint16_t num_buckets; /* the window covers num_buckets * bucket_usec */
+    uint16_t num_bins;    /* histogram bins for percentiles, may be 0 */
+    float histogram_min;  /* lower bound of the first bin */
+    float histogram_max;  /* upper bound of the last bin */
+};
+
+struct sps_stats_bucket {
+    float sum;
+    float min;
+    float max;
+    uint32_t count;
+};
+
+struct sps_stats_deque {
+    uint32_t* buckets;
+    uint16_t first;
+    uint16_t len;
+};
+
+/**
+ * Rolling time window over one value, e.g. the mc_2p5 field of
+ * struct sps30_measurement.
+ *
+ * Samples are aggregated into buckets of fixed duration. Count, sum, minimum
+ * and maximum of the window are updated incrementally in O(1) per sample
+ * (amortized), using monotonic deques over the buckets for minimum and
+ * maximum. Percentiles are approximated from a fixed-bin histogram. The
+ * memory is provided by the caller, see SPS_STATS_WINDOW_STORAGE_SIZE.
+ *
+ * The members are private, use the sps_stats_window_* functions.
+ */
+struct sps_stats_window {
+    struct sps_stats_window_config config;
+    struct sps_stats_bucket* buckets;
+    struct sps_stats_deque min_deque;
+    struct sps_stats_deque max_deque;
+    uint32_t* bins;
+    uint16_t* bucket_bins;
+    uint32_t current;
+    uint8_t started;
+    uint32_t count;
+    double sum;
+};
+
+struct sps_stats_summary {
+    uint32_t count;
+    float mean;
+    float min;
+    float max;
+};
+
+/**
+ * sps_stats_window_init() - initialize an empty window
+ *
+ * @window:         Window to initialize
+ * @config:         Window configuration, copied into window
+ * @storage:        32 bit aligned memory which must stay valid as long as the
+ *                  window is used
+ * @storage_size:   Size of storage, at least SPS_STATS_WINDOW_STORAGE_SIZE()
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t sps_stats_window_init(struct sps_stats_window* window,
+                              const struct sps_stats_window_config* config,
+                              void* storage, uint32_t storage_size);
+
+/**
+ * sps_stats_window_add() - add a sample and expire outdated buckets
+ *
+ * Timestamps are expected to be monotonic, e.g. from
+ * sps30_read_measurement_ts(). Samples older than the current bucket are
+ * accounted to the current bucket.
+ *
+ * @window:         Window to add the sample to
+ * @timestamp_usec: Time of the sample
+ * @value:          Value of the sample
+ */
+void sps_stats_window_add(struct sps_stats_window* window,
+                          uint64_t timestamp_usec, float value);
+
+/**
+ * sps_stats_window_advance() - expire outdated buckets without adding a sample
+ *
+ * @window:         Window to update
+ * @timestamp_usec: Current time
+ */
+void sps_stats_window_advance(struct sps_stats_window* window,
+                              uint64_t timestamp_usec);
+
+/**
+ * sps_stats_window_get_summary() - read count, mean, minimum and maximum
+ *
+ * Note that mean, min and max are 0 if the window is empty.
+ *
+ * @window:     Window to query
+ * @summary:    Memory where the summary is stored
+ */
+void sps_stats_window_get_summary(const struct sps_stats_window* window,
+                                  struct sps_stats_summary* summary);
+
+/**
+ * sps_stats_window_get_percentile() - approximate a percentile
+ *
+ * The value is interpolated linearly within the histogram bin containing the
+ * percentile, values outside of the histogram range are accounted to the
+ * first or last bin.
+ *
+ * @window:     Window to query
+ * @percent:    Percentile to compute, 0 to 100
+ * @value:      Memory where the percentile is stored
+ * Return:      0 on success, SPS_STATS_ERR_INVALID_CONFIG if the window has
+ *              no histogram or is empty
+ */
+int16_t sps_stats_window_get_percentile(const struct sps_stats_window* window,
+                                        uint8_t percent, float* value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_STATS_H */
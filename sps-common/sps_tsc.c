@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps_tsc.h"
+#include "sensirion_shdlc.h"
+#include <string.h>
+
+/*
+ * Block layout (multi-byte values are big-endian):
+ *
+ *   0  magic 'S' 'T'
+ *   2  format version
+ *   3  number of fields per sample
+ *   4  number of samples (uint16_t)
+ *   6  payload size in bytes (uint16_t)
+ *   8  timestamp resolution in microseconds (uint32_t)
+ *  12  timestamp of the first sample in units of the resolution (uint64_t)
+ *  20  payload: bit stream, MSB first
+ *
+ * For every sample but the first, the payload contains the delta-of-delta of
+ * the timestamp:
+ *   '0'                        delta unchanged
+ *   '10'   + 7 bit zigzag      small change
+ *   '110'  + 9 bit zigzag
+ *   '1110' + 12 bit zigzag
+ *   '1111' + 32 bit zigzag
+ *
+ * followed by each field XORed with the previous value of the field (0 for the
+ * first sample):
+ *   '0'                        value unchanged
+ *   '10' + meaningful bits     the XOR fits the previous window of
+ *                              leading and trailing zero bits
+ *   '11' + 5 bit leading zeros + 6 bit length + meaningful bits
+ */
+
+#define SPS_TSC_MAGIC_0 'S'
+#define SPS_TSC_MAGIC_1 'T'
+#define SPS_TSC_VERSION 1
+#define SPS_TSC_MAX_SAMPLE_BITS(num_fields) (36 + 45 * (uint32_t)(num_fields))
+#define SPS_TSC_NO_WINDOW 0xff
+
+union sps_tsc_float {
+    uint32_t u32_value;
+    float float32;
+};
+
+static uint64_t sps_tsc_zigzag(int64_t value) {
+    return value < 0 ? ((uint64_t)(-(value + 1)) << 1) | 1
+                     : (uint64_t)value << 1;
+}
+
+static int64_t sps_tsc_unzigzag(uint64_t value) {
+    return value & 1 ? -(int64_t)(value >> 1) - 1 : (int64_t)(value >> 1);
+}
+
+static uint8_t sps_tsc_leading_zeros(uint32_t value) {
+    uint8_t n = 0;
+
+    while (n < 32 && !(value & (0x80000000u >> n)))
+        ++n;
+    return n;
+}
+
+static uint8_t sps_tsc_trailing_zeros(uint32_t value) {
+    uint8_t n = 0;
+
+    while (n < 32 && !(value & (1u << n)))
+        ++n;
+    return n;
+}
+
+static void sps_tsc_write_bits(struct sps_tsc_encoder* encoder, uint32_t value,
+                               uint8_t num_bits) {
+    uint8_t* byte;
+    uint8_t used;
+    uint8_t take;
+
+    while (num_bits) {
+        byte = &encoder->buffer[SPS_TSC_BLOCK_HEADER_SIZE +
+                                encoder->bit_pos / 8];
+        used = encoder->bit_pos % 8;
+        take = (uint8_t)(8 - used) < num_bits ? (uint8_t)(8 - used) : num_bits;
+        if (!used)
+            *byte = 0;
+        *byte |= (uint8_t)(((value >> (num_bits - take)) & ((1u << take) - 1))
+                           << (8 - used - take));
+        num_bits -= take;
+        encoder->bit_pos += take;
+    }
+}
+
+static int16_t sps_tsc_read_bits(struct sps_tsc_decoder* decoder,
+                                 uint8_t num_bits, uint32_t* value) {
+    const uint8_t* payload = decoder->block + SPS_TSC_BLOCK_HEADER_SIZE;
+    uint32_t payload_bits = (decoder->block_size - SPS_TSC_BLOCK_HEADER_SIZE) *
+                            8;
+    uint8_t used;
+    uint8_t take;
+
+    if (decoder->bit_pos + num_bits > payload_bits)
+        return SPS_TSC_ERR_INVALID_BLOCK;
+
+    *value = 0;
+    while (num_bits) {
+        used = decoder->bit_pos % 8;
+        take = (uint8_t)(8 - used) < num_bits ? (uint8_t)(8 - used) : num_bits;
+        *value = (*value << take) |
+                 ((uint32_t)(payload[decoder->bit_pos / 8] >>
+                             (8 - used - take)) &
+                  ((1u << take) - 1));
+        num_bits -= take;
+        decoder->bit_pos += take;
+    }
+    return 0;
+}
+
+static void sps_tsc_reset_fields(struct sps_tsc_field_state* fields) {
+    uint8_t i;
+
+    for (i = 0; i < SPS_TSC_MAX_FIELDS; ++i) {
+        fields[i].value = 0;
+        fields[i].leading = SPS_TSC_NO_WINDOW;
+        fields[i].trailing = 0;
+    }
+}
+
+static void sps_tsc_encoder_reset(struct sps_tsc_encoder* encoder) {
+    encoder->bit_pos = 0;
+    encoder->num_samples = 0;
+    encoder->prev_delta = 0;
+    sps_tsc_reset_fields(encoder->fields);
+}
+
+int16_t sps_tsc_encoder_init(struct sps_tsc_encoder* encoder,
+                             const struct sps_tsc_config* config,
+                             uint8_t* buffer, uint16_t buffer_size) {
+    if (config->num_fields == 0 || config->num_fields > SPS_TSC_MAX_FIELDS ||
+        config->mantissa_bits > 23 || config->resolution_usec == 0 ||
+        !config->write ||
+        buffer_size < SPS_TSC_MIN_BUFFER_SIZE(config->num_fields))
+        return SPS_TSC_ERR_INVALID_CONFIG;
+
+    encoder->config = *config;
+    encoder->buffer = buffer;
+    encoder->buffer_size = buffer_size;
+    sps_tsc_encoder_reset(encoder);
+    return 0;
+}
+
+static void sps_tsc_encode_timestamp(struct sps_tsc_encoder* encoder,
+                                     uint64_t zigzag_dod) {
+    uint32_t value = (uint32_t)zigzag_dod;
+
+    if (value == 0) {
+        sps_tsc_write_bits(encoder, 0, 1);
+    } else if (value < (1u << 7)) {
+        sps_tsc_write_bits(encoder, 0x2, 2);
+        sps_tsc_write_bits(encoder, value, 7);
+    } else if (value < (1u << 9)) {
+        sps_tsc_write_bits(encoder, 0x6, 3);
+        sps_tsc_write_bits(encoder, value, 9);
+    } else if (value < (1u << 12)) {
+        sps_tsc_write_bits(encoder, 0xe, 4);
+        sps_tsc_write_bits(encoder, value, 12);
+    } else {
+        sps_tsc_write_bits(encoder, 0xf, 4);
+        sps_tsc_write_bits(encoder, value, 32);
+    }
+}
+
+static void sps_tsc_encode_value(struct sps_tsc_encoder* encoder,
+                                 struct sps_tsc_field_state* field,
+                                 uint32_t value) {
+    uint32_t xor_value = value ^ field->value;
+    uint8_t leading;
+    uint8_t trailing;
+
+    field->value = value;
+    if (!xor_value) {
+        sps_tsc_write_bits(encoder, 0, 1);
+        return;
+    }
+
+    leading = sps_tsc_leading_zeros(xor_value);
+    if (leading > 31)
+        leading = 31;
+    trailing = sps_tsc_trailing_zeros(xor_value);
+
+    if (field->leading != SPS_TSC_NO_WINDOW && leading >= field->leading &&
+        trailing >= field->trailing) {
+        sps_tsc_write_bits(encoder, 0x2, 2);
+        sps_tsc_write_bits(encoder, xor_value >> field->trailing,
+                           (uint8_t)(32 - field->leading - field->trailing));
+        return;
+    }
+
+    sps_tsc_write_bits(encoder, 0x3, 2);
+    sps_tsc_write_bits(encoder, leading, 5);
+    sps_tsc_write_bits(encoder, (uint32_t)(32 - leading - trailing), 6);
+    sps_tsc_write_bits(encoder, xor_value >> trailing,
+                       (uint8_t)(32 - leading - trailing));
+    field->leading = leading;
+    field->trailing = trailing;
+}
+
+int16_t sps_tsc_encoder_append(struct sps_tsc_encoder* encoder,
+                               uint64_t timestamp_usec, const float* values) {
+    const struct sps_tsc_config* c = &encoder->config;
+    uint32_t capacity_bits =
+        (uint32_t)(encoder->buffer_size - SPS_TSC_BLOCK_HEADER_SIZE) * 8;
+    uint32_t mask = ~((1u << (23 - c->mantissa_bits)) - 1);
+    uint64_t ticks = timestamp_usec / c->resolution_usec;
+    uint64_t zigzag_dod = 0;
+    union sps_tsc_float value;
+    int64_t delta = 0;
+    int16_t ret;
+    uint8_t i;
+
+    if (encoder->num_samples) {
+        delta = (int64_t)(ticks - encoder->prev_ticks);
+        zigzag_dod = sps_tsc_zigzag(delta - encoder->prev_delta);
+        if (zigzag_dod > 0xffffffffu || encoder->num_samples == 0xffff ||
+            encoder->bit_pos + SPS_TSC_MAX_SAMPLE_BITS(c->num_fields) >
+                capacity_bits) {
+            ret = sps_tsc_encoder_flush(encoder);
+            if (ret)
+                return ret;
+        }
+    }
+
+    if (encoder->num_samples) {
+        sps_tsc_encode_timestamp(encoder, zigzag_dod);
+        encoder->prev_delta = delta;
+    } else {
+        encoder->first_ticks = ticks;
+    }
+    encoder->prev_ticks = ticks;
+
+    for (i = 0; i < c->num_fields; ++i) {
+        value.float32 = values[i];
+        sps_tsc_encode_value(encoder, &encoder->fields[i],
+                             value.u32_value & mask);
+    }
+    ++encoder->num_samples;
+    return 0;
+}
+
+int16_t sps_tsc_encoder_flush(struct sps_tsc_encoder* encoder) {
+    uint8_t* header = encoder->buffer;
+    uint16_t payload_size = (uint16_t)((encoder->bit_pos + 7) / 8);
+    int16_t ret;
+
+    if (!encoder->num_samples)
+        return 0;
+
+    header[0] = SPS_TSC_MAGIC_0;
+    header[1] = SPS_TSC_MAGIC_1;
+    header[2] = SPS_TSC_VERSION;
+    header[3] = encoder->config.num_fields;
+    sensirion_uint16_t_to_bytes(encoder->num_samples, &header[4]);
+    sensirion_uint16_t_to_bytes(payload_size, &header[6]);
+    sensirion_uint32_t_to_bytes(encoder->config.resolution_usec, &header[8]);
+    sensirion_uint32_t_to_bytes((uint32_t)(encoder->first_ticks >> 32),
+                                &header[12]);
+    sensirion_uint32_t_to_bytes((uint32_t)encoder->first_ticks, &header[16]);
+
+    ret = encoder->config.write(encoder->config.write_ctx, encoder->buffer,
+                                SPS_TSC_BLOCK_HEADER_SIZE + payload_size);
+    sps_tsc_encoder_reset(encoder);
+    return ret;
+}
+
+int16_t sps_tsc_get_block_size(const uint8_t* header, uint32_t* block_size) {
+    if (header[0] != SPS_TSC_MAGIC_0 || header[1] != SPS_TSC_MAGIC_1 ||
+        header[2] != SPS_TSC_VERSION || header[3] == 0 ||
+        header[3] > SPS_TSC_MAX_FIELDS)
+        return SPS_TSC_ERR_INVALID_BLOCK;
+
+    *block_size = SPS_TSC_BLOCK_HEADER_SIZE +
+                  (uint32_t)sensirion_bytes_to_uint16_t(&header[6]);
+    return 0;
+}
+
+int16_t sps_tsc_decoder_init(struct sps_tsc_decoder* decoder,
+                             const uint8_t* block, uint32_t block_size) {
+    uint32_t expected_size;
+
+    if (block_size < SPS_TSC_BLOCK_HEADER_SIZE ||
+        sps_tsc_get_block_size(block, &expected_size) ||
+        expected_size > block_size)
+        return SPS_TSC_ERR_INVALID_BLOCK;
+
+    decoder->block = block;
+    decoder->block_size = expected_size;
+    decoder->bit_pos = 0;
+    decoder->num_fields = block[3];
+    decoder->num_samples = sensirion_bytes_to_uint16_t(&block[4]);
+    decoder->resolution_usec = sensirion_bytes_to_uint32_t(&block[8]);
+    decoder->prev_ticks =
+        (uint64_t)sensirion_bytes_to_uint32_t(&block[12]) << 32 |
+        sensirion_bytes_to_uint32_t(&block[16]);
+    decoder->prev_delta = 0;
+    decoder->sample = 0;
+    sps_tsc_reset_fields(decoder->fields);
+    return 0;
+}
+
+uint8_t sps_tsc_decoder_get_num_fields(const struct sps_tsc_decoder* decoder) {
+    return decoder->num_fields;
+}
+
+static int16_t sps_tsc_decode_timestamp(struct sps_tsc_decoder* decoder) {
+    static const uint8_t widths[] = {7, 9, 12, 32};
+    uint32_t bit;
+    uint32_t value = 0;
+    uint8_t prefix;
+    int16_t ret;
+
+    for (prefix = 0; prefix < 4; ++prefix) {
+        ret = sps_tsc_read_bits(decoder, 1, &bit);
+        if (ret)
+            return ret;
+        if (!bit)
+            break;
+    }
+    if (prefix) {
+        ret = sps_tsc_read_bits(decoder, widths[prefix - 1], &value);
+        if (ret)
+            return ret;
+    }
+    decoder->prev_delta += sps_tsc_unzigzag(value);
+    decoder->prev_ticks += (uint64_t)decoder->prev_delta;
+    return 0;
+}
+
+static int16_t sps_tsc_decode_value(struct sps_tsc_decoder* decoder,
+                                    struct sps_tsc_field_state* field) {
+    uint32_t control;
+    uint32_t leading;
+    uint32_t length;
+    uint32_t bits;
+    int16_t ret;
+
+    ret = sps_tsc_read_bits(decoder, 1, &control);
+    if (ret || !control)
+        return ret;
+
+    ret = sps_tsc_read_bits(decoder, 1, &control);
+    if (ret)
+        return ret;
+    if (control) {
+        ret = sps_tsc_read_bits(decoder, 5, &leading);
+        if (!ret)
+            ret = sps_tsc_read_bits(decoder, 6, &length);
+        if (ret)
+            return ret;
+        if (length == 0 || leading + length > 32)
+            return SPS_TSC_ERR_INVALID_BLOCK;
+        field->leading = (uint8_t)leading;
+        field->trailing = (uint8_t)(32 - leading - length);
+    } else if (field->leading == SPS_TSC_NO_WINDOW) {
+        return SPS_TSC_ERR_INVALID_BLOCK;
+    }
+
+    ret = sps_tsc_read_bits(
+        decoder, (uint8_t)(32 - field->leading - field->trailing), &bits);
+    if (ret)
+        return ret;
+    field->value ^= bits << field->trailing;
+    return 0;
+}
+
+int16_t sps_tsc_decoder_next(struct sps_tsc_decoder* decoder,
+                             uint64_t* timestamp_usec, float* values) {
+    union sps_tsc_float value;
+    int16_t ret;
+    uint8_t i;
+
+    if (decoder->sample >= decoder->num_samples)
+        return SPS_TSC_ERR_END_OF_BLOCK;
+
+    if (decoder->sample) {
+        ret = sps_tsc_decode_timestamp(decoder);
+        if (ret)
+            return ret;
+    }
+
+    for (i = 0; i < decoder->num_fields; ++i) {
+        ret = sps_tsc_decode_value(decoder, &decoder->fields[i]);
+        if (ret)
+            return ret;
+        value.u32_value = decoder->fields[i].value;
+        values[i] = value.float32;
+    }
+
+    *timestamp_usec = decoder->prev_ticks * decoder->resolution_usec;
+    ++decoder->sample;
+    return 0;
+}
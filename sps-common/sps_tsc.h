@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS_TSC_H
+#define SPS_TSC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+
+#define SPS_TSC_ERR_INVALID_CONFIG (-1)
+#define SPS_TSC_ERR_INVALID_BLOCK (-2)
+#define SPS_TSC_ERR_END_OF_BLOCK (-3)
+
+/** Maximum number of float fields per sample */
+#define SPS_TSC_MAX_FIELDS 16
+
+/** Size of the header at the beginning of every block */
+#define SPS_TSC_BLOCK_HEADER_SIZE 20
+
+/**
+ * Minimum block buffer size to hold at least one sample with the given
+ * number of fields
+ */
+#define SPS_TSC_MIN_BUFFER_SIZE(num_fields) \
+    (SPS_TSC_BLOCK_HEADER_SIZE + (36 + 45 * (num_fields) + 7) / 8)
+
+/**
+ * Function called with every completed block, e.g. to append it to a file:
+ *
+ *   static int16_t write_block(void* ctx, const uint8_t* block, uint16_t len) {
+ *       return fwrite(block, 1, len, (FILE*)ctx) == len ? 0 : -1;
+ *   }
+ *
+ * Return:  0 on success, a negative error code which is passed on otherwise
+ */
+typedef int16_t (*sps_tsc_write_fn)(void* ctx, const uint8_t* block,
+                                    uint16_t len);
+
+struct sps_tsc_config {
+    uint8_t num_fields;        /* float fields per sample */
+    uint8_t mantissa_bits;     /* retained mantissa bits, 23 is lossless */
+    uint32_t resolution_usec;  /* timestamp resolution, e.g. 1000 for ms */
+    sps_tsc_write_fn write;    /* called with each completed block */
+    void* write_ctx;           /* passed to write */
+};
+
+/**
+ * Per-field state of the XOR float compression
+ */
+struct sps_tsc_field_state {
+    uint32_t value;
+    uint8_t leading;
+    uint8_t trailing;
+};
+
+/**
+ * Streaming encoder for blocks of timestamped float samples, e.g. all fields
+ * of struct sps30_measurement (see sps30_get_measurement_field()).
+ *
+ * Timestamps are stored with delta-of-delta encoding, values as XOR with the
+ * previous value of the same field, both with variable length bit codes.
+ * Samples are encoded into the caller-provided block buffer which is passed
+ * to the write function when it is full or sps_tsc_encoder_flush() is
+ * called, thus the memory used is bounded by the buffer size.
+ *
+ * Reducing mantissa_bits drops the least significant mantissa bits, which
+ * makes slowly varying but noisy values compress much better. E.g. 10 bits
+ * still resolve 0.1% of the value, far below the sensor accuracy.
+ *
+ * The members are private.
+ */
+struct sps_tsc_encoder {
+    struct sps_tsc_config config;
+    uint8_t* buffer;
+    uint16_t buffer_size;
+    uint32_t bit_pos;
+    uint16_t num_samples;
+    uint64_t first_ticks;
+    uint64_t prev_ticks;
+    int64_t prev_delta;
+    struct sps_tsc_field_state fields[SPS_TSC_MAX_FIELDS];
+};
+
+/**
+ * Decoder of a single block. The members are private.
+ */
+struct sps_tsc_decoder {
+    const uint8_t* block;
+    uint32_t block_size;
+    uint32_t bit_pos;
+    uint8_t num_fields;
+    uint32_t resolution_usec;
+    uint16_t num_samples;
+    uint16_t sample;
+    uint64_t prev_ticks;
+    int64_t prev_delta;
+    struct sps_tsc_field_state fields[SPS_TSC_MAX_FIELDS];
+};
+
+/**
+ * sps_tsc_encoder_init() - initialize an encoder
+ *
+ * @encoder:        Encoder to initialize
+ * @config:         Configuration, copied into encoder
+ * @buffer:         Memory for one block, at least SPS_TSC_MIN_BUFFER_SIZE
+ * @buffer_size:    Size of buffer in bytes
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t sps_tsc_encoder_init(struct sps_tsc_encoder* encoder,
+                             const struct sps_tsc_config* config,
+                             uint8_t* buffer, uint16_t buffer_size);
+
+/**
+ * sps_tsc_encoder_append() - append a sample
+ *
+ * Completes and writes the current block first if the sample might not fit.
+ *
+ * @encoder:        Encoder to append to
+ * @timestamp_usec: Time of the sample, must not decrease
+ * @values:         num_fields values of the sample
+ * Return:          0 on success, an error code of the write function otherwise
+ */
+int16_t sps_tsc_encoder_append(struct sps_tsc_encoder* encoder,
+                               uint64_t timestamp_usec, const float* values);
+
+/**
+ * sps_tsc_encoder_flush() - complete and write the current block
+ *
+ * Nothing is written if the block is empty.
+ *
+ * @encoder:    Encoder to flush
+ * Return:      0 on success, an error code of the write function otherwise
+ */
+int16_t sps_tsc_encoder_flush(struct sps_tsc_encoder* encoder);
+
+/**
+ * sps_tsc_get_block_size() - get the total size of a block from its header
+ *
+ * @header:     First SPS_TSC_BLOCK_HEADER_SIZE bytes of a block
+ * @block_size: Memory where the size of the block including the header is
+ *              stored
+ * Return:      0 on success, SPS_TSC_ERR_INVALID_BLOCK otherwise
+ */
+int16_t sps_tsc_get_block_size(const uint8_t* header, uint32_t* block_size);
+
+/**
+ * sps_tsc_decoder_init() - start decoding a block
+ *
+ * @decoder:    Decoder to initialize
+ * @block:      Complete block, must stay valid while decoding
+ * @block_size: Size of block in bytes
+ * Return:      0 on success, SPS_TSC_ERR_INVALID_BLOCK otherwise
+ */
+int16_t sps_tsc_decoder_init(struct sps_tsc_decoder* decoder,
+                             const uint8_t* block, uint32_t block_size);
+
+/**
+ * sps_tsc_decoder_get_num_fields() - number of fields per sample of a block
+ *
+ * @decoder:    Initialized decoder
+ * Return:      Number of fields
+ */
+uint8_t sps_tsc_decoder_get_num_fields(const struct sps_tsc_decoder* decoder);
+
+/**
+ * sps_tsc_decoder_next() - decode the next sample
+ *
+ * @decoder:        Decoder to read from
+ * @timestamp_usec: Memory where the timestamp is stored
+ * @values:         Memory for num_fields values
+ * Return:          0 on success, SPS_TSC_ERR_END_OF_BLOCK if all samples were
+ *                  decoded, SPS_TSC_ERR_INVALID_BLOCK on corrupt data
+ */
+int16_t sps_tsc_decoder_next(struct sps_tsc_decoder* decoder,
+                             uint64_t* timestamp_usec, float* values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS_TSC_H */
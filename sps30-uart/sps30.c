@@ -33,6 +33,7 @@
 #include "sensirion_shdlc.h"
 #include "sensirion_uart.h"
 #include "sps_git_version.h"
+#include <math.h>
 
 #define SPS30_ADDR 0x00
 #define SPS30_CMD_START_MEASUREMENT 0x00
@@ -52,21 +53,54 @@
 #define SPS30_CMD_READ_VERSION 0xd1
 #define SPS30_CMD_RESET 0xd3
 #define SPS30_ERR_STATE(state) (SPS30_ERR_STATE_MASK | (state))
+#define SPS30_INIT_RX_DELAY_USEC 20000
+#define SPS30_VERSION_LEN 7
 
 const char* sps_get_driver_version(void) {
     return SPS_DRV_VERSION_STR;
 }
 
-int16_t sps30_probe(void) {
+/* Bits of struct sps30_metadata_cache.valid */
+#define SPS30_CACHED_SERIAL 0x01
+#define SPS30_CACHED_VERSION 0x02
+#define SPS30_CACHED_FAN_INTERVAL 0x04
+
+struct sps30_metadata_cache {
+    uint8_t valid;
     char serial[SPS30_MAX_SERIAL_LEN];
-    // Try to wake up, but ignore failure if it is not in sleep mode
-    (void)sps30_wake_up();
-    int16_t ret = sps30_get_serial(serial);
+    struct sps30_version_information version;
+    uint32_t fan_interval_seconds;
+};
+
+static struct sps30_metadata_cache sps30_caches[SPS30_MAX_CACHED_PORTS];
+static uint8_t sps30_cache_enabled = 0;
+static uint8_t sps30_port = 0;
+
+/* Return the cache of the selected port, NULL if the port is not cached */
+static struct sps30_metadata_cache* sps30_get_cache(void) {
+    if (!sps30_cache_enabled || sps30_port >= SPS30_MAX_CACHED_PORTS)
+        return (struct sps30_metadata_cache*)NULL;
+    return &sps30_caches[sps30_port];
+}
 
-    return ret;
+static void sps30_copy_serial(char* dst, const char* src) {
+    uint8_t i;
+
+    for (i = 0; i < SPS30_MAX_SERIAL_LEN; ++i)
+        dst[i] = src[i];
 }
 
-int16_t sps30_get_serial(char* serial) {
+static uint8_t sps30_serial_equal(const char* a, const char* b) {
+    uint8_t i;
+
+    for (i = 0; i < SPS30_MAX_SERIAL_LEN && (a[i] || b[i]); ++i) {
+        if (a[i] != b[i])
+            return 0;
+    }
+    return 1;
+}
+
+static int16_t sps30_read_serial(char* serial) {
     struct sensirion_shdlc_rx_header header;
     uint8_t param_buf[] = SPS30_CMD_DEV_INFO_SUBCMD_GET_SERIAL;
     int16_t ret;
@@ -83,6 +117,74 @@ int16_t sps30_get_serial(char* serial) {
     return 0;
 }
 
+int16_t sps30_select_port(uint8_t port) {
+    int16_t ret;
+
+    ret = sensirion_uart_select_port(port);
+    if (ret == 0) {
+        sps30_port = port;
+        sensirion_shdlc_set_port(port);
+    }
+    return ret;
+}
+
+void sps30_enable_cache(uint8_t enable) {
+    uint8_t i;
+
+    for (i = 0; i < SPS30_MAX_CACHED_PORTS; ++i)
+        sps30_caches[i].valid = 0;
+    sps30_cache_enabled = enable;
+}
+
+void sps30_invalidate_cache(void) {
+    struct sps30_metadata_cache* cache = sps30_get_cache();
+
+    if (cache)
+        cache->valid = 0;
+}
+
+int16_t sps30_probe(void) {
+    struct sps30_metadata_cache* cache = sps30_get_cache();
+    char serial[SPS30_MAX_SERIAL_LEN];
+    int16_t ret;
+
+    // Try to wake up, but ignore failure if it is not in sleep mode
+    (void)sps30_wake_up();
+
+    /* Always read the serial number, a replaced sensor responds as well */
+    ret = sps30_read_serial(serial);
+    if (!cache)
+        return ret;
+    if (ret) {
+        cache->valid = 0;
+        return ret;
+    }
+    /* A different serial number means the sensor was replaced */
+    if ((cache->valid & SPS30_CACHED_SERIAL) &&
+        !sps30_serial_equal(cache->serial, serial))
+        cache->valid = 0;
+    sps30_copy_serial(cache->serial, serial);
+    cache->valid |= SPS30_CACHED_SERIAL;
+    return 0;
+}
+
+int16_t sps30_get_serial(char* serial) {
+    struct sps30_metadata_cache* cache = sps30_get_cache();
+    int16_t ret;
+
+    if (cache && (cache->valid & SPS30_CACHED_SERIAL)) {
+        sps30_copy_serial(serial, cache->serial);
+        return 0;
+    }
+
+    ret = sps30_read_serial(serial);
+    if (ret == 0 && cache) {
+        sps30_copy_serial(cache->serial, serial);
+        cache->valid |= SPS30_CACHED_SERIAL;
+    }
+    return ret;
+}
+
 int16_t sps30_start_measurement(void) {
     struct sensirion_shdlc_rx_header header;
     uint8_t param_buf[] = SPS30_SUBCMD_MEASUREMENT_START;
@@ -99,40 +201,384 @@ int16_t sps30_stop_measurement(void) {
                                (uint8_t*)NULL, 0, &header, (uint8_t*)NULL);
 }
 
-int16_t sps30_read_measurement(struct sps30_measurement* measurement) {
+static void
+sps30_set_measurement_fields(struct sps30_measurement* measurement,
+                             const float* values) {
+    measurement->mc_1p0 = values[SPS30_FIELD_MC_1P0];
+    measurement->mc_2p5 = values[SPS30_FIELD_MC_2P5];
+    measurement->mc_4p0 = values[SPS30_FIELD_MC_4P0];
+    measurement->mc_10p0 = values[SPS30_FIELD_MC_10P0];
+    measurement->nc_0p5 = values[SPS30_FIELD_NC_0P5];
+    measurement->nc_1p0 = values[SPS30_FIELD_NC_1P0];
+    measurement->nc_2p5 = values[SPS30_FIELD_NC_2P5];
+    measurement->nc_4p0 = values[SPS30_FIELD_NC_4P0];
+    measurement->nc_10p0 = values[SPS30_FIELD_NC_10P0];
+    measurement->typical_particle_size =
+        values[SPS30_FIELD_TYPICAL_PARTICLE_SIZE];
+}
+
+static int16_t
+sps30_read_measurement_internal(struct sps30_measurement* measurement,
+                                struct sensirion_shdlc_rx_timestamps* ts) {
     struct sensirion_shdlc_rx_header header;
     int16_t error;
-    uint8_t data[10][4];
-
-    error = sensirion_shdlc_xcv(SPS30_ADDR, SPS30_CMD_READ_MEASUREMENT, 0,
-                                (uint8_t*)NULL, sizeof(data), &header,
-                                (uint8_t*)data);
+    uint8_t data[SPS30_NUM_FIELDS][4];
+    float values[SPS30_NUM_FIELDS];
+
+    if (ts) {
+        error = sensirion_shdlc_xcv_ts(SPS30_ADDR, SPS30_CMD_READ_MEASUREMENT,
+                                       0, (uint8_t*)NULL, sizeof(data),
+                                       &header, (uint8_t*)data, ts);
+    } else {
+        error = sensirion_shdlc_xcv(SPS30_ADDR, SPS30_CMD_READ_MEASUREMENT, 0,
+                                    (uint8_t*)NULL, sizeof(data), &header,
+                                    (uint8_t*)data);
+    }
     if (error) {
         return error;
     }
 
+    /* A sensor which is not measuring responds with an error state and no
+     * data, which must not be mistaken for a measurement not ready yet */
+    if (header.state) {
+        return SPS30_ERR_STATE(header.state);
+    }
+
     if (header.data_len != sizeof(data)) {
         return SPS30_ERR_NOT_ENOUGH_DATA;
     }
 
-    measurement->mc_1p0 = sensirion_bytes_to_float(data[0]);
-    measurement->mc_2p5 = sensirion_bytes_to_float(data[1]);
-    measurement->mc_4p0 = sensirion_bytes_to_float(data[2]);
-    measurement->mc_10p0 = sensirion_bytes_to_float(data[3]);
-    measurement->nc_0p5 = sensirion_bytes_to_float(data[4]);
-    measurement->nc_1p0 = sensirion_bytes_to_float(data[5]);
-    measurement->nc_2p5 = sensirion_bytes_to_float(data[6]);
-    measurement->nc_4p0 = sensirion_bytes_to_float(data[7]);
-    measurement->nc_10p0 = sensirion_bytes_to_float(data[8]);
-    measurement->typical_particle_size = sensirion_bytes_to_float(data[9]);
+    sensirion_bytes_to_float_array(data[0], values, SPS30_NUM_FIELDS);
+    sps30_set_measurement_fields(measurement, values);
 
-    if (header.state) {
-        return SPS30_ERR_STATE(header.state);
+    return 0;
+}
+
+int16_t sps30_read_measurement(struct sps30_measurement* measurement) {
+    return sps30_read_measurement_internal(
+        measurement, (struct sensirion_shdlc_rx_timestamps*)NULL);
+}
+
+int16_t
+sps30_read_measurement_ts(struct sps30_measurement* measurement,
+                          struct sensirion_shdlc_rx_timestamps* timestamps) {
+    return sps30_read_measurement_internal(measurement, timestamps);
+}
+
+uint32_t sps30_get_warm_up_usec(const struct sps30_measurement* measurement) {
+    if (measurement->nc_10p0 >= SPS30_WARM_UP_HIGH_NC)
+        return SPS30_WARM_UP_HIGH_USEC;
+    if (measurement->nc_10p0 >= SPS30_WARM_UP_MEDIUM_NC)
+        return SPS30_WARM_UP_MEDIUM_USEC;
+    return SPS30_WARM_UP_LOW_USEC;
+}
+
+void sps30_session_init(struct sps30_session* session) {
+    session->start_usec = 0;
+    session->time_to_stable_usec = 0;
+    session->samples = 0;
+    session->warm_up_samples = 0;
+    session->running = 0;
+    session->stable = 0;
+    session->stable_sessions = 0;
+    session->min_time_to_stable_usec = 0;
+    session->max_time_to_stable_usec = 0;
+    session->sum_time_to_stable_usec = 0;
+}
+
+int16_t sps30_session_start(struct sps30_session* session) {
+    int16_t ret;
+
+    ret = sps30_start_measurement();
+    if (ret)
+        return ret;
+
+    session->start_usec = sensirion_get_time_usec();
+    session->time_to_stable_usec = 0;
+    session->samples = 0;
+    session->warm_up_samples = 0;
+    session->running = 1;
+    session->stable = 0;
+    return 0;
+}
+
+int16_t sps30_session_stop(struct sps30_session* session) {
+    session->running = 0;
+    return sps30_stop_measurement();
+}
+
+int16_t sps30_session_read_measurement(struct sps30_session* session,
+                                       struct sps30_measurement* measurement,
+                                       uint8_t* warm_up) {
+    struct sensirion_shdlc_rx_timestamps timestamps;
+    uint64_t elapsed;
+    int16_t ret;
+
+    ret = sps30_read_measurement_ts(measurement, &timestamps);
+    if (ret)
+        return ret;
+
+    ++session->samples;
+    elapsed = timestamps.last_byte_usec - session->start_usec;
+    if (!session->stable &&
+        (!session->running || elapsed < sps30_get_warm_up_usec(measurement))) {
+        ++session->warm_up_samples;
+        *warm_up = 1;
+        return 0;
+    }
+    *warm_up = 0;
+    if (session->stable)
+        return 0;
+
+    /* First stable sample of this session */
+    session->stable = 1;
+    session->time_to_stable_usec =
+        elapsed > 0xffffffff ? 0xffffffff : (uint32_t)elapsed;
+    if (session->stable_sessions == 0 ||
+        session->time_to_stable_usec < session->min_time_to_stable_usec)
+        session->min_time_to_stable_usec = session->time_to_stable_usec;
+    if (session->time_to_stable_usec > session->max_time_to_stable_usec)
+        session->max_time_to_stable_usec = session->time_to_stable_usec;
+    session->sum_time_to_stable_usec += session->time_to_stable_usec;
+    ++session->stable_sessions;
+    return 0;
+}
+
+void sps30_session_get_stats(const struct sps30_session* session,
+                             struct sps30_session_stats* stats) {
+    stats->stable_sessions = session->stable_sessions;
+    stats->min_time_to_stable_usec = session->min_time_to_stable_usec;
+    stats->max_time_to_stable_usec = session->max_time_to_stable_usec;
+    stats->mean_time_to_stable_usec =
+        session->stable_sessions
+            ? (uint32_t)(session->sum_time_to_stable_usec /
+                         session->stable_sessions)
+            : 0;
+}
+
+float sps30_get_measurement_field(const struct sps30_measurement* measurement,
+                                  enum sps30_measurement_field field) {
+    switch (field) {
+        case SPS30_FIELD_MC_1P0:
+            return measurement->mc_1p0;
+        case SPS30_FIELD_MC_2P5:
+            return measurement->mc_2p5;
+        case SPS30_FIELD_MC_4P0:
+            return measurement->mc_4p0;
+        case SPS30_FIELD_MC_10P0:
+            return measurement->mc_10p0;
+        case SPS30_FIELD_NC_0P5:
+            return measurement->nc_0p5;
+        case SPS30_FIELD_NC_1P0:
+            return measurement->nc_1p0;
+        case SPS30_FIELD_NC_2P5:
+            return measurement->nc_2p5;
+        case SPS30_FIELD_NC_4P0:
+            return measurement->nc_4p0;
+        case SPS30_FIELD_NC_10P0:
+            return measurement->nc_10p0;
+        case SPS30_FIELD_TYPICAL_PARTICLE_SIZE:
+            return measurement->typical_particle_size;
+        default:
+            return 0;
+    }
+}
+
+void sps30_set_measurement_field(struct sps30_measurement* measurement,
+                                 enum sps30_measurement_field field,
+                                 float value) {
+    switch (field) {
+        case SPS30_FIELD_MC_1P0:
+            measurement->mc_1p0 = value;
+            break;
+        case SPS30_FIELD_MC_2P5:
+            measurement->mc_2p5 = value;
+            break;
+        case SPS30_FIELD_MC_4P0:
+            measurement->mc_4p0 = value;
+            break;
+        case SPS30_FIELD_MC_10P0:
+            measurement->mc_10p0 = value;
+            break;
+        case SPS30_FIELD_NC_0P5:
+            measurement->nc_0p5 = value;
+            break;
+        case SPS30_FIELD_NC_1P0:
+            measurement->nc_1p0 = value;
+            break;
+        case SPS30_FIELD_NC_2P5:
+            measurement->nc_2p5 = value;
+            break;
+        case SPS30_FIELD_NC_4P0:
+            measurement->nc_4p0 = value;
+            break;
+        case SPS30_FIELD_NC_10P0:
+            measurement->nc_10p0 = value;
+            break;
+        case SPS30_FIELD_TYPICAL_PARTICLE_SIZE:
+            measurement->typical_particle_size = value;
+            break;
+        default:
+            break;
+    }
+}
+
+static const char* const sps30_field_names[SPS30_NUM_FIELDS] = {
+    "mc_1p0",
+    "mc_2p5",
+    "mc_4p0",
+    "mc_10p0",
+    "nc_0p5",
+    "nc_1p0",
+    "nc_2p5",
+    "nc_4p0",
+    "nc_10p0",
+    "typical_particle_size",
+};
+
+const char*
+sps30_get_measurement_field_name(enum sps30_measurement_field field) {
+    if ((unsigned)field >= SPS30_NUM_FIELDS)
+        return (const char*)NULL;
+    return sps30_field_names[field];
+}
+
+int16_t sps30_format_measurement(char* buf, uint16_t size,
+                                enum sps_format_style style,
+                                const struct sps30_measurement* measurement) {
+    static const uint8_t decimals[SPS30_NUM_FIELDS] = {2, 2, 2, 2, 2,
+                                                       2, 2, 2, 2, 2};
+    float values[SPS30_NUM_FIELDS];
+    uint8_t i;
+
+    if (style != SPS_FORMAT_CSV_HEADER) {
+        for (i = 0; i < SPS30_NUM_FIELDS; ++i)
+            values[i] = sps30_get_measurement_field(
+                measurement, (enum sps30_measurement_field)i);
+    }
+    return sps_format_line(buf, size, style, sps30_field_names, values,
+                           decimals, SPS30_NUM_FIELDS);
+}
+
+int16_t sps30_cbor_encode_measurement(
+    struct sps_cbor_writer* writer, uint64_t timestamp_usec,
+    const struct sps30_measurement* measurement) {
+    float value;
+    uint8_t i;
+
+    sps_cbor_write_array(writer, 1 + SPS30_NUM_FIELDS);
+    sps_cbor_write_uint(writer, timestamp_usec);
+    for (i = 0; i < SPS30_NUM_FIELDS; ++i) {
+        value = sps30_get_measurement_field(measurement,
+                                            (enum sps30_measurement_field)i);
+        sps_cbor_write_float(writer, value);
     }
+    return sps_cbor_writer_commit(writer);
+}
+
+int16_t sps30_cbor_decode_measurement(struct sps_cbor_reader* reader,
+                                      uint64_t* timestamp_usec,
+                                      struct sps30_measurement* measurement) {
+    struct sps_cbor_reader r = *reader;
+    float values[SPS30_NUM_FIELDS];
+    uint16_t count;
+    int16_t ret;
+    uint8_t i;
+
+    ret = sps_cbor_read_array(&r, &count);
+    if (ret)
+        return ret;
+    if (count != 1 + SPS30_NUM_FIELDS)
+        return SPS_CBOR_ERR_TYPE;
+    ret = sps_cbor_read_uint(&r, timestamp_usec);
+    for (i = 0; i < SPS30_NUM_FIELDS && !ret; ++i)
+        ret = sps_cbor_read_float(&r, &values[i]);
+    if (ret)
+        return ret;
 
+    sps30_set_measurement_fields(measurement, values);
+    *reader = r;
     return 0;
 }
 
+int16_t
+sps30_measurement_columns_init(struct sps30_measurement_columns* columns,
+                               uint32_t capacity, void* storage,
+                               uint32_t storage_size) {
+    uint32_t stride = (capacity + 7) / 8 * 8;
+    uint8_t i;
+
+    if ((uintptr_t)storage % SPS30_COLUMNS_ALIGNMENT ||
+        storage_size <
+            SPS30_MEASUREMENT_COLUMNS_STORAGE_SIZE((uint64_t)capacity))
+        return SPS30_ERR_INVALID_STORAGE;
+
+    for (i = 0; i < SPS30_NUM_FIELDS; ++i)
+        columns->fields[i] = (float*)storage + i * stride;
+    columns->capacity = capacity;
+    columns->count = 0;
+    return 0;
+}
+
+int16_t
+sps30_measurement_columns_append(struct sps30_measurement_columns* columns,
+                                 const struct sps30_measurement* measurements,
+                                 uint32_t num_measurements) {
+    float** f = columns->fields;
+    uint32_t row = columns->count;
+    uint32_t i;
+
+    if (num_measurements > columns->capacity - columns->count)
+        return SPS30_ERR_COLUMNS_FULL;
+
+    for (i = 0; i < num_measurements; ++i, ++row) {
+        f[SPS30_FIELD_MC_1P0][row] = measurements[i].mc_1p0;
+        f[SPS30_FIELD_MC_2P5][row] = measurements[i].mc_2p5;
+        f[SPS30_FIELD_MC_4P0][row] = measurements[i].mc_4p0;
+        f[SPS30_FIELD_MC_10P0][row] = measurements[i].mc_10p0;
+        f[SPS30_FIELD_NC_0P5][row] = measurements[i].nc_0p5;
+        f[SPS30_FIELD_NC_1P0][row] = measurements[i].nc_1p0;
+        f[SPS30_FIELD_NC_2P5][row] = measurements[i].nc_2p5;
+        f[SPS30_FIELD_NC_4P0][row] = measurements[i].nc_4p0;
+        f[SPS30_FIELD_NC_10P0][row] = measurements[i].nc_10p0;
+        f[SPS30_FIELD_TYPICAL_PARTICLE_SIZE][row] =
+            measurements[i].typical_particle_size;
+    }
+    columns->count = row;
+    return 0;
+}
+
+int16_t
+sps30_read_measurement_columns(struct sps30_measurement_columns* columns,
+                               const uint8_t* ports, uint8_t num_ports,
+                               int16_t* errors) {
+    struct sps30_measurement m;
+    int16_t result = 0;
+    int16_t ret;
+    uint8_t i;
+    uint8_t j;
+
+    if (num_ports > columns->capacity - columns->count)
+        return SPS30_ERR_COLUMNS_FULL;
+
+    for (i = 0; i < num_ports; ++i) {
+        ret = sps30_select_port(ports[i]);
+        if (ret == 0)
+            ret = sps30_read_measurement(&m);
+        if (ret) {
+            for (j = 0; j < SPS30_NUM_FIELDS; ++j)
+                columns->fields[j][columns->count] = NAN;
+            ++columns->count;
+            result = ret;
+        } else {
+            sps30_measurement_columns_append(columns, &m, 1);
+        }
+        if (errors)
+            errors[i] = ret;
+    }
+    return result;
+}
+
 int16_t sps30_sleep(void) {
     struct sensirion_shdlc_rx_header header;
 
@@ -154,11 +600,17 @@ int16_t sps30_wake_up(void) {
 }
 
 int16_t sps30_get_fan_auto_cleaning_interval(uint32_t* interval_seconds) {
+    struct sps30_metadata_cache* cache = sps30_get_cache();
     struct sensirion_shdlc_rx_header header;
     uint8_t tx_data[] = {SPS30_SUBCMD_READ_FAN_CLEAN_INTV};
     int16_t ret;
     uint8_t data[4];
 
+    if (cache && (cache->valid & SPS30_CACHED_FAN_INTERVAL)) {
+        *interval_seconds = cache->fan_interval_seconds;
+        return 0;
+    }
+
     ret = sensirion_shdlc_xcv(
         SPS30_ADDR, SPS30_CMD_FAN_CLEAN_INTV, sizeof(tx_data), tx_data,
         sizeof(*interval_seconds), &header, (uint8_t*)data);
@@ -170,19 +622,35 @@ int16_t sps30_get_fan_auto_cleaning_interval(uint32_t* interval_seconds) {
     if (header.state)
         return SPS30_ERR_STATE(header.state);
 
+    if (cache) {
+        cache->fan_interval_seconds = *interval_seconds;
+        cache->valid |= SPS30_CACHED_FAN_INTERVAL;
+    }
     return 0;
 }
 
 int16_t sps30_set_fan_auto_cleaning_interval(uint32_t interval_seconds) {
+    struct sps30_metadata_cache* cache = sps30_get_cache();
     struct sensirion_shdlc_rx_header header;
     uint8_t cleaning_command[SPS30_CMD_FAN_CLEAN_INTV_LEN];
+    int16_t ret;
 
     cleaning_command[0] = SPS30_SUBCMD_READ_FAN_CLEAN_INTV;
     sensirion_uint32_t_to_bytes(interval_seconds, &cleaning_command[1]);
 
-    return sensirion_shdlc_xcv(SPS30_ADDR, SPS30_CMD_FAN_CLEAN_INTV,
-                               sizeof(cleaning_command), cleaning_command, 0,
-                               &header, (uint8_t*)NULL);
+    ret = sensirion_shdlc_xcv(SPS30_ADDR, SPS30_CMD_FAN_CLEAN_INTV,
+                              sizeof(cleaning_command), cleaning_command, 0,
+                              &header, (uint8_t*)NULL);
+    if (cache) {
+        /* Write through, the sensor applies the interval as it is */
+        if (ret == 0 && header.state == 0) {
+            cache->fan_interval_seconds = interval_seconds;
+            cache->valid |= SPS30_CACHED_FAN_INTERVAL;
+        } else {
+            cache->valid &= (uint8_t)~SPS30_CACHED_FAN_INTERVAL;
+        }
+    }
+    return ret;
 }
 
 int16_t sps30_get_fan_auto_cleaning_interval_days(uint8_t* interval_days) {
@@ -190,7 +658,7 @@ int16_t sps30_get_fan_auto_cleaning_interval_days(uint8_t* interval_days) {
     uint32_t interval_seconds;
 
     ret = sps30_get_fan_auto_cleaning_interval(&interval_seconds);
-    if (ret < 0)
+    if (ret)
         return ret;
 
     *interval_days = interval_seconds / (24 * 60 * 60);
@@ -202,6 +670,26 @@ int16_t sps30_set_fan_auto_cleaning_interval_days(uint8_t interval_days) {
                                                 60 * 60);
 }
 
+int16_t sps30_apply_config(const struct sps30_config* config,
+                           uint8_t* changed) {
+    uint32_t interval_seconds;
+    int16_t ret;
+
+    *changed = 0;
+
+    ret = sps30_get_fan_auto_cleaning_interval(&interval_seconds);
+    if (ret)
+        return ret;
+    if (interval_seconds != config->fan_auto_cleaning_interval_seconds) {
+        ret = sps30_set_fan_auto_cleaning_interval(
+            config->fan_auto_cleaning_interval_seconds);
+        if (ret)
+            return ret;
+        *changed |= SPS30_CONFIG_CHANGED_FAN_AUTO_CLEANING_INTERVAL;
+    }
+    return 0;
+}
+
 int16_t sps30_start_manual_fan_cleaning(void) {
     struct sensirion_shdlc_rx_header header;
 
@@ -209,12 +697,28 @@ int16_t sps30_start_manual_fan_cleaning(void) {
                                (uint8_t*)NULL, 0, &header, (uint8_t*)NULL);
 }
 
+static void
+sps30_decode_version(const uint8_t* data,
+                     struct sps30_version_information* version_information) {
+    version_information->firmware_major = data[0];
+    version_information->firmware_minor = data[1];
+    version_information->hardware_revision = data[3];
+    version_information->shdlc_major = data[5];
+    version_information->shdlc_minor = data[6];
+}
+
 int16_t
 sps30_read_version(struct sps30_version_information* version_information) {
+    struct sps30_metadata_cache* cache = sps30_get_cache();
     struct sensirion_shdlc_rx_header header;
     int16_t error;
     uint8_t data[7];
 
+    if (cache && (cache->valid & SPS30_CACHED_VERSION)) {
+        *version_information = cache->version;
+        return 0;
+    }
+
     error = sensirion_shdlc_xcv(SPS30_ADDR, SPS30_CMD_READ_VERSION, 0,
                                 (uint8_t*)NULL, sizeof(data), &header, data);
     if (error) {
@@ -229,15 +733,227 @@ sps30_read_version(struct sps30_version_information* version_information) {
         return SPS30_ERR_STATE(header.state);
     }
 
-    version_information->firmware_major = data[0];
-    version_information->firmware_minor = data[1];
-    version_information->hardware_revision = data[3];
-    version_information->shdlc_major = data[5];
-    version_information->shdlc_minor = data[6];
+    sps30_decode_version(data, version_information);
 
+    if (cache) {
+        cache->version = *version_information;
+        cache->valid |= SPS30_CACHED_VERSION;
+    }
     return error;
 }
 
 int16_t sps30_reset(void) {
+    sps30_invalidate_cache();
     return sensirion_shdlc_tx(SPS30_ADDR, SPS30_CMD_RESET, 0, (uint8_t*)NULL);
 }
+
+/* Discard responses to earlier ready polls which arrived late */
+static void sps30_discard_rx(void) {
+    uint8_t buf[16];
+
+    sensirion_sleep_usec(SPS30_READY_POLL_USEC);
+    while (sensirion_uart_rx(sizeof(buf), buf) > 0) {
+    }
+}
+
+static int16_t sps30_poll_ready(uint8_t cmd, uint64_t start_usec,
+                                uint32_t timeout_usec, uint32_t* ready_usec) {
+    struct sensirion_shdlc_rx_header header;
+    struct sensirion_shdlc_rx_timestamps timestamps;
+    uint8_t data[SPS30_VERSION_LEN];
+    const uint8_t wake_up = 0xFF;
+    uint64_t attempt_usec;
+    uint64_t now;
+    uint16_t attempts = 0;
+    int16_t ret;
+
+    for (;;) {
+        attempt_usec = sensirion_get_time_usec();
+        ++attempts;
+        ret = 0;
+        if (cmd == SPS30_CMD_WAKE_UP)
+            ret = sensirion_uart_tx(1, &wake_up);
+        if (ret >= 0)
+            ret = sensirion_shdlc_tx(SPS30_ADDR, cmd, 0, (uint8_t*)NULL);
+        if (ret == 0)
+            ret = sensirion_shdlc_rx_timeout(sizeof(data), &header, data,
+                                             SPS30_READY_POLL_USEC,
+                                             &timestamps);
+        /* Any response, even with an error state, means the sensor is up */
+        if (ret == 0)
+            break;
+
+        now = sensirion_get_time_usec();
+        if (now - start_usec >= timeout_usec)
+            return ret;
+        if (now - attempt_usec < SPS30_READY_POLL_USEC)
+            sensirion_sleep_usec(
+                (uint32_t)(SPS30_READY_POLL_USEC - (now - attempt_usec)));
+    }
+
+    if (ready_usec) {
+        now = timestamps.first_byte_usec - start_usec;
+        *ready_usec = now > 0xffffffff ? 0xffffffff : (uint32_t)now;
+    }
+    if (attempts > 1)
+        sps30_discard_rx();
+    return 0;
+}
+
+int16_t sps30_wait_ready(uint32_t timeout_usec, uint32_t* ready_usec) {
+    return sps30_poll_ready(SPS30_CMD_READ_VERSION, sensirion_get_time_usec(),
+                            timeout_usec, ready_usec);
+}
+
+int16_t sps30_reset_wait_ready(uint32_t timeout_usec, uint32_t* ready_usec) {
+    struct sensirion_shdlc_rx_header header;
+    uint64_t start_usec = sensirion_get_time_usec();
+    int16_t ret;
+
+    ret = sps30_reset();
+    if (ret)
+        return ret;
+
+    /* Consume the acknowledgement sent before the sensor resets */
+    (void)sensirion_shdlc_rx_timeout(
+        0, &header, (uint8_t*)NULL, SPS30_READY_POLL_USEC,
+        (struct sensirion_shdlc_rx_timestamps*)NULL);
+    return sps30_poll_ready(SPS30_CMD_READ_VERSION, start_usec, timeout_usec,
+                            ready_usec);
+}
+
+int16_t sps30_wake_up_wait_ready(uint32_t timeout_usec, uint32_t* ready_usec) {
+    return sps30_poll_ready(SPS30_CMD_WAKE_UP, sensirion_get_time_usec(),
+                            timeout_usec, ready_usec);
+}
+
+/* Commands sent by sps30_init_devices(), in this order */
+struct sps30_init_step {
+    uint8_t cmd;
+    uint8_t tx_data_len;
+    uint8_t tx_data[2];
+    uint8_t rx_data_len;
+};
+
+static const struct sps30_init_step sps30_init_steps[] = {
+    {SPS30_CMD_WAKE_UP, 0, {0}, 0},
+    {SPS30_CMD_DEV_INFO, 1, SPS30_CMD_DEV_INFO_SUBCMD_GET_SERIAL,
+     SPS30_MAX_SERIAL_LEN},
+    {SPS30_CMD_READ_VERSION, 0, {0}, 7},
+    {SPS30_CMD_FAN_CLEAN_INTV, 1, {SPS30_SUBCMD_READ_FAN_CLEAN_INTV}, 4},
+    {SPS30_CMD_START_MEASUREMENT, 2, SPS30_SUBCMD_MEASUREMENT_START, 0},
+};
+
+#define SPS30_NUM_INIT_STEPS \
+    (sizeof(sps30_init_steps) / sizeof(sps30_init_steps[0]))
+
+static int16_t sps30_init_tx(const struct sps30_init_step* step) {
+    const uint8_t wake_up = 0xFF;
+    int16_t ret;
+
+    if (step->cmd == SPS30_CMD_WAKE_UP) {
+        ret = sensirion_uart_tx(1, &wake_up);
+        if (ret < 0)
+            return ret;
+    }
+    return sensirion_shdlc_tx(SPS30_ADDR, step->cmd, step->tx_data_len,
+                              step->tx_data);
+}
+
+static int16_t sps30_init_rx(const struct sps30_init_step* step,
+                             struct sps30_device_info* info) {
+    struct sensirion_shdlc_rx_header header;
+    uint8_t data[SPS30_MAX_SERIAL_LEN];
+    int16_t ret;
+    uint8_t i;
+
+    ret = sensirion_shdlc_rx(step->rx_data_len, &header, data);
+    if (step->cmd == SPS30_CMD_WAKE_UP)
+        return 0; /* Only sleeping sensors accept the wake-up command */
+    if (ret < 0)
+        return ret;
+    if (header.state)
+        return SPS30_ERR_STATE(header.state);
+
+    switch (step->cmd) {
+        case SPS30_CMD_DEV_INFO:
+            for (i = 0; i < SPS30_MAX_SERIAL_LEN; ++i)
+                info->serial[i] = i < header.data_len ? (char)data[i] : '\0';
+            info->serial[SPS30_MAX_SERIAL_LEN - 1] = '\0';
+            break;
+        case SPS30_CMD_READ_VERSION:
+            if (header.data_len != step->rx_data_len)
+                return SPS30_ERR_NOT_ENOUGH_DATA;
+            sps30_decode_version(data, &info->version);
+            break;
+        case SPS30_CMD_FAN_CLEAN_INTV:
+            if (header.data_len != step->rx_data_len)
+                return SPS30_ERR_NOT_ENOUGH_DATA;
+            info->fan_auto_cleaning_interval_seconds =
+                sensirion_bytes_to_uint32_t(data);
+            break;
+    }
+    return 0;
+}
+
+int16_t sps30_init_devices(const uint8_t* ports, uint8_t num_ports,
+                           uint8_t start_measurement,
+                           struct sps30_device_info* infos, int16_t* errors) {
+    struct sps30_metadata_cache* cache;
+    const struct sps30_init_step* step;
+    uint8_t num_steps = SPS30_NUM_INIT_STEPS;
+    int16_t result = 0;
+    uint8_t i;
+    uint8_t s;
+
+    if (!start_measurement)
+        --num_steps;
+
+    for (i = 0; i < num_ports; ++i)
+        errors[i] = 0;
+
+    for (s = 0; s < num_steps; ++s) {
+        step = &sps30_init_steps[s];
+
+        /* Send the command to all sensors, then collect the responses, so
+         * that all sensors process the command at the same time */
+        for (i = 0; i < num_ports; ++i) {
+            if (errors[i])
+                continue;
+            errors[i] = sps30_select_port(ports[i]);
+            if (errors[i] == 0)
+                errors[i] = sps30_init_tx(step);
+        }
+
+        sensirion_sleep_usec(SPS30_INIT_RX_DELAY_USEC);
+
+        for (i = 0; i < num_ports; ++i) {
+            if (errors[i])
+                continue;
+            errors[i] = sps30_select_port(ports[i]);
+            if (errors[i] == 0)
+                errors[i] = sps30_init_rx(step, &infos[i]);
+        }
+    }
+
+    for (i = 0; i < num_ports; ++i) {
+        if (errors[i]) {
+            result = errors[i];
+            if (sps30_select_port(ports[i]) == 0)
+                sps30_invalidate_cache();
+            continue;
+        }
+        if (sps30_select_port(ports[i]) != 0)
+            continue;
+        cache = sps30_get_cache();
+        if (cache) {
+            sps30_copy_serial(cache->serial, infos[i].serial);
+            cache->version = infos[i].version;
+            cache->fan_interval_seconds =
+                infos[i].fan_auto_cleaning_interval_seconds;
+            cache->valid = SPS30_CACHED_SERIAL | SPS30_CACHED_VERSION |
+                           SPS30_CACHED_FAN_INTERVAL;
+        }
+    }
+    return result;
+}
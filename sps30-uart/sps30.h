@@ -37,12 +37,34 @@ extern "C" {
 #endif
 
 #include "sensirion_arch_config.h"
+#include "sensirion_shdlc.h"
+#include "sps_cbor.h"
+#include "sps_format.h"
 
 #define SPS30_MAX_SERIAL_LEN 32
 #define SPS30_ERR_NOT_ENOUGH_DATA (-1)
 #define SPS30_ERR_STATE_MASK (0x100)
 #define SPS30_IS_ERR_STATE(err_code) (((err_code) | 0xff) == 0x1ff)
 #define SPS30_GET_ERR_STATE(err_code) ((err_code)&0xff)
+#define SPS30_ERR_COLUMNS_FULL (-16)
+#define SPS30_ERR_INVALID_STORAGE (-17)
+
+/**
+ * Interval at which sps30_wait_ready() and friends poll the sensor
+ */
+#ifndef SPS30_READY_POLL_USEC
+#define SPS30_READY_POLL_USEC 10000
+#endif
+
+/**
+ * Number of UART ports (see sps30_select_port()) for which serial number,
+ * version information and fan auto-cleaning interval are cached once enabled
+ * with sps30_enable_cache(). Metadata of sensors on higher ports is always
+ * read from the sensor.
+ */
+#ifndef SPS30_MAX_CACHED_PORTS
+#define SPS30_MAX_CACHED_PORTS 4
+#endif
 
 struct sps30_measurement {
     float mc_1p0;
@@ -57,6 +79,95 @@ struct sps30_measurement {
     float typical_particle_size;
 };
 
+/**
+ * Fields of struct sps30_measurement, e.g. to process them generically with
+ * sps30_get_measurement_field()
+ */
+enum sps30_measurement_field {
+    SPS30_FIELD_MC_1P0,
+    SPS30_FIELD_MC_2P5,
+    SPS30_FIELD_MC_4P0,
+    SPS30_FIELD_MC_10P0,
+    SPS30_FIELD_NC_0P5,
+    SPS30_FIELD_NC_1P0,
+    SPS30_FIELD_NC_2P5,
+    SPS30_FIELD_NC_4P0,
+    SPS30_FIELD_NC_10P0,
+    SPS30_FIELD_TYPICAL_PARTICLE_SIZE,
+    SPS30_NUM_FIELDS,
+};
+
+/* Buffer size to fit any measurement formatted by sps30_format_measurement() */
+#define SPS30_FORMAT_MAX_LEN 256
+
+/**
+ * Alignment in bytes of the columns of struct sps30_measurement_columns,
+ * suitable for 256 bit SIMD loads
+ */
+#define SPS30_COLUMNS_ALIGNMENT 32
+
+/**
+ * Size in bytes of the storage required by struct sps30_measurement_columns
+ * with the given capacity. Each column is padded to a multiple of
+ * SPS30_COLUMNS_ALIGNMENT.
+ */
+#define SPS30_MEASUREMENT_COLUMNS_STORAGE_SIZE(capacity) \
+    (SPS30_NUM_FIELDS * (((capacity) + 7) / 8 * 8) * 4)
+
+/**
+ * Measurements in structure-of-arrays layout, e.g. to process the same field
+ * of many sensors or samples with vectorized code:
+ * columns->fields[SPS30_FIELD_MC_2P5][i] is the mc_2p5 field of row i.
+ *
+ * All columns are aligned to SPS30_COLUMNS_ALIGNMENT bytes. Rows of failed
+ * reads are filled with NAN.
+ */
+struct sps30_measurement_columns {
+    float* fields[SPS30_NUM_FIELDS];
+    uint32_t capacity;
+    uint32_t count;
+};
+
+/**
+ * Start-up times according to the datasheet: readings are stable after
+ * SPS30_WARM_UP_HIGH_USEC at a total number concentration (nc_10p0) of at
+ * least SPS30_WARM_UP_HIGH_NC #/cm^3, after SPS30_WARM_UP_MEDIUM_USEC at
+ * least SPS30_WARM_UP_MEDIUM_NC #/cm^3 and after SPS30_WARM_UP_LOW_USEC
+ * otherwise.
+ */
+#define SPS30_WARM_UP_HIGH_NC 200
+#define SPS30_WARM_UP_HIGH_USEC 8000000
+#define SPS30_WARM_UP_MEDIUM_NC 100
+#define SPS30_WARM_UP_MEDIUM_USEC 16000000
+#define SPS30_WARM_UP_LOW_USEC 30000000
+
+/**
+ * Measurement session from sps30_session_start() to sps30_session_stop().
+ * Samples read before the sensor is warmed up for the measured concentration
+ * are marked as warm-up samples. The time to the first stable sample is
+ * accumulated over all sessions.
+ */
+struct sps30_session {
+    uint64_t start_usec;
+    uint32_t time_to_stable_usec; /* 0 until the first stable sample */
+    uint32_t samples;
+    uint32_t warm_up_samples;
+    uint8_t running;
+    uint8_t stable;
+    /* Accumulated over sessions */
+    uint32_t stable_sessions;
+    uint32_t min_time_to_stable_usec;
+    uint32_t max_time_to_stable_usec;
+    uint64_t sum_time_to_stable_usec;
+};
+
+struct sps30_session_stats {
+    uint32_t stable_sessions;
+    uint32_t min_time_to_stable_usec;
+    uint32_t max_time_to_stable_usec;
+    uint32_t mean_time_to_stable_usec;
+};
+
 struct sps30_version_information {
     uint8_t firmware_major;
     uint8_t firmware_minor;
@@ -65,15 +176,74 @@ struct sps30_version_information {
     uint8_t shdlc_minor;
 };
 
+/**
+ * Metadata of a sensor as collected by sps30_init_devices()
+ */
+struct sps30_device_info {
+    char serial[SPS30_MAX_SERIAL_LEN];
+    struct sps30_version_information version;
+    uint32_t fan_auto_cleaning_interval_seconds;
+};
+
+/**
+ * Desired configuration of a sensor, see sps30_apply_config()
+ */
+struct sps30_config {
+    uint32_t fan_auto_cleaning_interval_seconds;
+};
+
+/* Bits reported by sps30_apply_config() for written parameters */
+#define SPS30_CONFIG_CHANGED_FAN_AUTO_CLEANING_INTERVAL 0x01
+
 /**
  * sps_get_driver_version() - Return the driver version
  * Return:  Driver version string
  */
 const char* sps_get_driver_version(void);
 
+/**
+ * sps30_select_port() - select the UART port of the sensor to talk to
+ *
+ * Selects the port with sensirion_uart_select_port() and the metadata cache
+ * of that port, see sps30_enable_cache(). Use this function instead of
+ * sensirion_uart_select_port() when talking to more than one sensor.
+ *
+ * @port:   UART port index
+ * Return:  0 on success, an error code otherwise
+ */
+int16_t sps30_select_port(uint8_t port);
+
+/**
+ * sps30_enable_cache() - enable or disable the metadata cache
+ *
+ * The cache is disabled by default. Once enabled, serial number, version
+ * information and fan auto-cleaning interval are cached per port selected
+ * with sps30_select_port(). Only enable the cache if every port switch goes
+ * through sps30_select_port(), the driver cannot tell which sensor it talks
+ * to after a plain sensirion_uart_select_port() and would return the metadata
+ * of another sensor. Enabling or disabling drops all cached metadata.
+ *
+ * @enable: 1 to enable, 0 to disable the cache
+ */
+void sps30_enable_cache(uint8_t enable);
+
+/**
+ * sps30_invalidate_cache() - drop the cached metadata of the selected port
+ *
+ * Serial number, version information and fan auto-cleaning interval are read
+ * from the sensor again on the next request. Call this function after the
+ * sensor was reconnected in a way the driver cannot detect, e.g. after
+ * reopening the UART. sps30_reset() invalidates the cache implicitly.
+ */
+void sps30_invalidate_cache(void);
+
 /**
  * sps30_probe() - check if SPS sensor is available and initialize it
  *
+ * The sensor is woken up and its serial number is read. The cache is
+ * invalidated if the probe fails or the serial number changed, i.e. a
+ * different sensor was connected.
+ *
  * Return:  0 on success, an error code otherwise
  */
 int16_t sps30_probe(void);
@@ -81,6 +251,9 @@ int16_t sps30_probe(void);
 /**
  * sps30_get_serial() - retrieve the serial number
  *
+ * With sps30_enable_cache(), the serial number is cached after the first
+ * successful read.
+ *
  * Note that serial must be discarded when the return code is non-zero.
  *
  * @serial: Memory where the serial number is written into as hex string (zero
@@ -115,6 +288,228 @@ int16_t sps30_stop_measurement(void);
  */
 int16_t sps30_read_measurement(struct sps30_measurement* measurement);
 
+/**
+ * sps30_read_measurement_ts() - read a measurement and timestamp its arrival
+ *
+ * Read the last measurement. In contrast to sps30_read_measurement(), the
+ * response is polled for instead of waiting a fixed delay and the arrival
+ * times of the first and last byte of the response are recorded with
+ * sensirion_get_time_usec().
+ *
+ * Note that measurement and timestamps must be discarded when the return code
+ * is non-zero.
+ *
+ * @measurement:    Memory where the measurement is stored
+ * @timestamps:     Memory where the arrival times are stored
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t
+sps30_read_measurement_ts(struct sps30_measurement* measurement,
+                          struct sensirion_shdlc_rx_timestamps* timestamps);
+
+/**
+ * sps30_get_warm_up_usec() - get the start-up time for a measurement
+ *
+ * @measurement:    Measurement of which the total number concentration
+ *                  (nc_10p0) determines the start-up time
+ * Return:          Time in microseconds after the start of a measurement
+ *                  until readings at this concentration are stable
+ */
+uint32_t sps30_get_warm_up_usec(const struct sps30_measurement* measurement);
+
+/**
+ * sps30_session_init() - initialize a measurement session
+ *
+ * Clears the state of the session and the accumulated time to stable
+ * metrics.
+ *
+ * @session:    Session to initialize
+ */
+void sps30_session_init(struct sps30_session* session);
+
+/**
+ * sps30_session_start() - start measuring and begin a new session
+ *
+ * Starts the measurement with sps30_start_measurement() and records the
+ * start time with sensirion_get_time_usec().
+ *
+ * @session:    Session to begin
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sps30_session_start(struct sps30_session* session);
+
+/**
+ * sps30_session_stop() - stop measuring and end the session
+ *
+ * The session is ended even if sps30_stop_measurement() fails.
+ *
+ * @session:    Session to end
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sps30_session_stop(struct sps30_session* session);
+
+/**
+ * sps30_session_read_measurement() - read a measurement of a session
+ *
+ * Reads the last measurement with sps30_read_measurement_ts() and compares
+ * the arrival time since the session start against
+ * sps30_get_warm_up_usec() of the measurement. Once a sample is stable, all
+ * further samples of the session are stable as well.
+ *
+ * @session:        Running session
+ * @measurement:    Memory where the measurement is stored
+ * @warm_up:        Set to 1 if the sample was taken during the warm-up, 0
+ *                  if it is stable
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t sps30_session_read_measurement(struct sps30_session* session,
+                                       struct sps30_measurement* measurement,
+                                       uint8_t* warm_up);
+
+/**
+ * sps30_session_get_stats() - get the time to first stable sample metrics
+ *
+ * @session:    Session to get the accumulated metrics from
+ * @stats:      Memory where the metrics are stored. All times are 0 if no
+ *              session had a stable sample yet.
+ */
+void sps30_session_get_stats(const struct sps30_session* session,
+                             struct sps30_session_stats* stats);
+
+/**
+ * sps30_get_measurement_field() - get a field of a measurement by index
+ *
+ * @measurement:    Measurement to read the field from
+ * @field:          Field to read
+ * Return:          The value of the field, 0 if field is invalid
+ */
+float sps30_get_measurement_field(const struct sps30_measurement* measurement,
+                                  enum sps30_measurement_field field);
+
+/**
+ * sps30_set_measurement_field() - set a field of a measurement by index
+ *
+ * @measurement:    Measurement to write the field to
+ * @field:          Field to write, invalid fields are ignored
+ * @value:          New value of the field
+ */
+void sps30_set_measurement_field(struct sps30_measurement* measurement,
+                                 enum sps30_measurement_field field,
+                                 float value);
+
+/**
+ * sps30_get_measurement_field_name() - get the name of a measurement field
+ *
+ * @field:  Field to get the name of
+ * Return:  The name of the field, e.g. "mc_2p5", NULL if field is invalid
+ */
+const char*
+sps30_get_measurement_field_name(enum sps30_measurement_field field);
+
+/**
+ * sps30_format_measurement() - format a measurement as CSV or JSON line
+ *
+ * All fields are formatted with two decimals, e.g.
+ * {"mc_1p0":1.23,...,"typical_particle_size":0.54}
+ *
+ * @buf:            Buffer to write the zero terminated line to, at least
+ *                  SPS30_FORMAT_MAX_LEN bytes long to fit any measurement
+ * @size:           Size of buf
+ * @style:          Output format, see sps_format_line()
+ * @measurement:    Measurement to format, unused for SPS_FORMAT_CSV_HEADER
+ * Return:          Length of the line on success, an error code otherwise
+ */
+int16_t sps30_format_measurement(char* buf, uint16_t size,
+                                enum sps_format_style style,
+                                const struct sps30_measurement* measurement);
+
+/**
+ * sps30_cbor_encode_measurement() - append a timestamped measurement as CBOR
+ *
+ * The record is an array of the timestamp followed by the fields in the
+ * order of enum sps30_measurement_field, each in its shortest lossless float
+ * encoding. If the record does not fit, the writer is left unchanged, e.g.
+ * to flush the buffer and retry.
+ *
+ * @writer:         Writer to append to
+ * @timestamp_usec: Timestamp of the measurement
+ * @measurement:    Measurement to append
+ * Return:          0 on success, SPS_CBOR_ERR_BUFFER_FULL if the record does
+ *                  not fit
+ */
+int16_t sps30_cbor_encode_measurement(
+    struct sps_cbor_writer* writer, uint64_t timestamp_usec,
+    const struct sps30_measurement* measurement);
+
+/**
+ * sps30_cbor_decode_measurement() - read a record written by
+ * sps30_cbor_encode_measurement()
+ *
+ * The reader is only advanced if the record was read successfully.
+ *
+ * @reader:         Reader to read from
+ * @timestamp_usec: Memory where the timestamp is stored
+ * @measurement:    Memory where the measurement is stored
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t sps30_cbor_decode_measurement(struct sps_cbor_reader* reader,
+                                      uint64_t* timestamp_usec,
+                                      struct sps30_measurement* measurement);
+
+/**
+ * sps30_measurement_columns_init() - initialize empty measurement columns
+ *
+ * @columns:        Columns to initialize
+ * @capacity:       Maximum number of rows
+ * @storage:        Memory aligned to SPS30_COLUMNS_ALIGNMENT bytes which must
+ *                  stay valid as long as the columns are used
+ * @storage_size:   Size of storage, at least
+ *                  SPS30_MEASUREMENT_COLUMNS_STORAGE_SIZE(capacity)
+ * Return:          0 on success, an error code otherwise
+ */
+int16_t
+sps30_measurement_columns_init(struct sps30_measurement_columns* columns,
+                               uint32_t capacity, void* storage,
+                               uint32_t storage_size);
+
+/**
+ * sps30_measurement_columns_append() - append measurements as rows
+ *
+ * Transposes measurements, e.g. from a history buffer, into the columns.
+ *
+ * @columns:            Columns to append to
+ * @measurements:       Measurements to append
+ * @num_measurements:   Number of measurements
+ * Return:              0 on success, SPS30_ERR_COLUMNS_FULL if the columns
+ *                      cannot hold all measurements, in which case nothing
+ *                      is appended
+ */
+int16_t
+sps30_measurement_columns_append(struct sps30_measurement_columns* columns,
+                                 const struct sps30_measurement* measurements,
+                                 uint32_t num_measurements);
+
+/**
+ * sps30_read_measurement_columns() - read a measurement from each of several
+ * sensors and append them as rows
+ *
+ * The sensors are selected with sps30_select_port(), row
+ * columns->count + i is read from ports[i]. The rows of sensors which fail
+ * to read are filled with NAN.
+ *
+ * @columns:    Columns to append to
+ * @ports:      UART ports of the sensors
+ * @num_ports:  Number of sensors
+ * @errors:     Optional memory for num_ports error codes, 0 for sensors which
+ *              were read successfully
+ * Return:      0 if all sensors were read successfully, the last error code
+ *              otherwise
+ */
+int16_t
+sps30_read_measurement_columns(struct sps30_measurement_columns* columns,
+                               const uint8_t* ports, uint8_t num_ports,
+                               int16_t* errors);
+
 /**
  * sps30_sleep() - Enter sleep mode with minimum power consumption.
  *
@@ -139,6 +534,9 @@ int16_t sps30_wake_up(void);
  * sps30_get_fan_auto_cleaning_interval() - read the current auto-cleaning
  * interval
  *
+ * With sps30_enable_cache(), the interval is cached after the first
+ * successful read or write.
+ *
  * Note that interval_seconds must be discarded when the return code is
  * non-zero.
  *
@@ -181,6 +579,25 @@ int16_t sps30_get_fan_auto_cleaning_interval_days(uint8_t* interval_days);
  */
 int16_t sps30_set_fan_auto_cleaning_interval_days(uint8_t interval_days);
 
+/**
+ * sps30_apply_config() - bring the sensor to the desired configuration
+ *
+ * Every settable parameter is read and only written if it differs from the
+ * desired value, which avoids needless writes to the non-volatile memory of
+ * the sensor. Parameters are read from the metadata cache if available.
+ *
+ * Note that the sensor reports a newly written auto-cleaning interval only
+ * after a reset. The cache is updated on write, but once the cache is lost
+ * (e.g. on reboot of the host) the interval is written again unless the
+ * sensor was reset with sps30_reset() in between.
+ *
+ * @config:     Desired configuration
+ * @changed:    Memory where the SPS30_CONFIG_CHANGED_* bits of the written
+ *              parameters are stored, 0 if nothing was written
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sps30_apply_config(const struct sps30_config* config, uint8_t* changed);
+
 /**
  * sps30_start_manual_fan_cleaning() - Immediately trigger the fan cleaning
  *
@@ -195,14 +612,89 @@ int16_t sps30_start_manual_fan_cleaning(void);
 /**
  * sps30_read_version() - Read version information.
  *
+ * With sps30_enable_cache(), the version information is cached after the
+ * first successful read.
+ *
  * Return:          0 on success, an error code otherwise
  */
 int16_t
 sps30_read_version(struct sps30_version_information* version_information);
 
+/**
+ * sps30_wait_ready() - wait until the sensor responds to commands
+ *
+ * Sends the read version command every SPS30_READY_POLL_USEC until the sensor
+ * responds or timeout_usec elapsed.
+ *
+ * @timeout_usec:   Maximum time to wait
+ * @ready_usec:     Optional memory where the time from the call until the
+ *                  arrival of the first response is stored
+ * Return:          0 when the sensor responded, the error of the last poll
+ *                  otherwise
+ */
+int16_t sps30_wait_ready(uint32_t timeout_usec, uint32_t* ready_usec);
+
+/**
+ * sps30_reset_wait_ready() - reset the sensor and wait until it is ready
+ *
+ * Replaces a fixed delay after sps30_reset(), see sps30_wait_ready().
+ *
+ * @timeout_usec:   Maximum time to wait, including the reset command
+ * @ready_usec:     Optional memory where the time from the reset command until
+ *                  the arrival of the first response is stored
+ * Return:          0 when the sensor responded after the reset, an error code
+ *                  otherwise
+ */
+int16_t sps30_reset_wait_ready(uint32_t timeout_usec, uint32_t* ready_usec);
+
+/**
+ * sps30_wake_up_wait_ready() - wake up the sensor and wait until it is ready
+ *
+ * Repeats the wake-up sequence of sps30_wake_up() every SPS30_READY_POLL_USEC
+ * until the sensor responds or timeout_usec elapsed. A sensor which was not
+ * sleeping responds immediately.
+ *
+ * @timeout_usec:   Maximum time to wait
+ * @ready_usec:     Optional memory where the time from the call until the
+ *                  arrival of the first response is stored
+ * Return:          0 when the sensor responded, the error of the last poll
+ *                  otherwise
+ */
+int16_t sps30_wake_up_wait_ready(uint32_t timeout_usec, uint32_t* ready_usec);
+
+/**
+ * sps30_init_devices() - wake up several sensors and read their metadata
+ *
+ * The sensors on the given ports are woken up and their serial number,
+ * version information and fan auto-cleaning interval are read. Optionally,
+ * the measurement is started. Each command is sent to all sensors before the
+ * responses are collected, so the response delay is waited once per command
+ * instead of once per command and sensor. This requires the UART
+ * implementation to buffer received data of all ports.
+ *
+ * If enabled, the metadata cache of each port is filled with the collected
+ * metadata.
+ * Sensors which fail a command are skipped for the remaining commands.
+ *
+ * @ports:              UART ports of the sensors
+ * @num_ports:          Number of sensors
+ * @start_measurement:  Start the measurement on all sensors if not 0
+ * @infos:              Memory for num_ports device infos. Entries of sensors
+ *                      which failed must be discarded.
+ * @errors:             Memory for num_ports error codes, 0 for sensors which
+ *                      were initialized successfully
+ * Return:              0 if all sensors were initialized successfully, the
+ *                      last error code otherwise
+ */
+int16_t sps30_init_devices(const uint8_t* ports, uint8_t num_ports,
+                           uint8_t start_measurement,
+                           struct sps30_device_info* infos, int16_t* errors);
+
 /**
  * sps30_reset() - reset the SGP30
  *
+ * Invalidates the cached metadata of the selected port.
+ *
  * Return:          0 on success, an error code otherwise
  */
 int16_t sps30_reset(void);
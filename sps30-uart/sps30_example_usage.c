@@ -33,6 +33,7 @@
 
 #include "sensirion_uart.h"
 #include "sps30.h"
+#include "sps30_scheduler.h"
 
 /**
  * TO USE CONSOLE OUTPUT (PRINTF) AND WAIT (SLEEP) PLEASE ADAPT THEM TO YOUR
@@ -43,7 +44,14 @@
 int main(void) {
     struct sps30_measurement m;
     char serial[SPS30_MAX_SERIAL_LEN];
-    const uint8_t AUTO_CLEAN_DAYS = 4;
+    char line[SPS30_FORMAT_MAX_LEN];
+    const struct sps30_scheduler_config schedule = {120000000, 30000000, 10};
+    struct sps30_scheduler scheduler;
+    struct sps30_scheduler_stats stats;
+    uint64_t now;
+    uint64_t next;
+    const struct sps30_config config = {4 * 24 * 60 * 60}; /* 4 days */
+    uint8_t changed;
     int16_t ret;
 
     while (sensirion_uart_open() != 0) {
@@ -79,72 +87,38 @@ int main(void) {
     else
         printf("SPS30 Serial: %s\n", serial);
 
-    ret = sps30_set_fan_auto_cleaning_interval_days(AUTO_CLEAN_DAYS);
+    /* Only write the auto-cleaning interval if it differs */
+    ret = sps30_apply_config(&config, &changed);
     if (ret)
         printf("error %d setting the auto-clean interval\n", ret);
+    else if (changed & SPS30_CONFIG_CHANGED_FAN_AUTO_CLEANING_INTERVAL)
+        printf("auto-clean interval changed\n");
 
-    while (1) {
-        ret = sps30_start_measurement();
-        if (ret < 0) {
-            printf("error starting measurement\n");
-        }
-
-        printf("measurements started\n");
-
-        for (int i = 0; i < 60; ++i) {
-
-            ret = sps30_read_measurement(&m);
-            if (ret < 0) {
-                printf("error reading measurement\n");
-            } else {
-                if (SPS30_IS_ERR_STATE(ret)) {
-                    printf(
-                        "Chip state: %u - measurements may not be accurate\n",
-                        SPS30_GET_ERR_STATE(ret));
-                }
-
-                printf("measured values:\n"
-                       "\t%0.2f pm1.0\n"
-                       "\t%0.2f pm2.5\n"
-                       "\t%0.2f pm4.0\n"
-                       "\t%0.2f pm10.0\n"
-                       "\t%0.2f nc0.5\n"
-                       "\t%0.2f nc1.0\n"
-                       "\t%0.2f nc2.5\n"
-                       "\t%0.2f nc4.5\n"
-                       "\t%0.2f nc10.0\n"
-                       "\t%0.2f typical particle size\n\n",
-                       m.mc_1p0, m.mc_2p5, m.mc_4p0, m.mc_10p0, m.nc_0p5,
-                       m.nc_1p0, m.nc_2p5, m.nc_4p0, m.nc_10p0,
-                       m.typical_particle_size);
-            }
-            sensirion_sleep_usec(1000000); /* sleep for 1s */
-        }
-
-        /* Stop measurement for 1min to preserve power. Also enter sleep mode
-         * if the firmware version is >=2.0.
-         */
-        ret = sps30_stop_measurement();
-        if (ret) {
-            printf("Stopping measurement failed\n");
-        }
-
-        if (version_information.firmware_major >= 2) {
-            ret = sps30_sleep();
-            if (ret) {
-                printf("Entering sleep failed\n");
-            }
-        }
-
-        printf("No measurements for 1 minute\n");
-        sensirion_sleep_usec(1000000 * 60);
+    /* Sample every 2 minutes, averaging 10 readings after 30s warm-up. The
+     * sensor is stopped in between and also sleeps if the firmware version is
+     * >=2.0.
+     */
+    while ((ret = sps30_scheduler_init(&scheduler, &schedule)) != 0) {
+        printf("error %d initializing the measurement schedule\n", ret);
+        sensirion_sleep_usec(1000000); /* sleep for 1s */
+    }
 
-        if (version_information.firmware_major >= 2) {
-            ret = sps30_wake_up();
-            if (ret) {
-                printf("Error %i waking up sensor\n", ret);
-            }
+    while (1) {
+        now = sensirion_get_time_usec();
+        ret = sps30_scheduler_step(&scheduler, now, &m, &next);
+        if (ret == SPS30_SCHEDULER_SAMPLE) {
+            sps30_format_measurement(line, sizeof(line), SPS_FORMAT_JSON, &m);
+            printf("measured values: %s", line);
+
+            sps30_scheduler_get_stats(&scheduler, &stats);
+            printf("duty cycle: %u permille, energy: %lu uJ per sample\n",
+                   stats.duty_cycle_permille,
+                   (unsigned long)stats.energy_per_sample_uj);
+        } else if (ret) {
+            printf("error %d executing the measurement schedule\n", ret);
         }
+        if (next > now)
+            sensirion_sleep_usec((uint32_t)(next - now));
     }
 
     if (sensirion_uart_close() != 0)
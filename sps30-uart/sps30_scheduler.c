@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps30_scheduler.h"
+
+#define SPS30_SCHEDULER_READ_INTERVAL_USEC 1000000
+#define SPS30_SCHEDULER_RETRY_USEC 100000
+
+int16_t sps30_scheduler_init(struct sps30_scheduler* scheduler,
+                             const struct sps30_scheduler_config* config) {
+    struct sps30_version_information version;
+    uint64_t active_usec;
+    int16_t ret;
+
+    if (config->sample_period_usec == 0 || config->readings_per_sample == 0)
+        return SPS30_SCHEDULER_ERR_INVALID_CONFIG;
+
+    ret = sps30_read_version(&version);
+    if (ret)
+        return ret;
+
+    /* The sensor may still be measuring, e.g. after a restart of the host */
+    (void)sps30_stop_measurement();
+
+    active_usec = (uint64_t)config->warm_up_usec +
+                  (uint64_t)config->readings_per_sample *
+                      SPS30_SCHEDULER_READ_INTERVAL_USEC;
+    scheduler->config = *config;
+    scheduler->state = SPS30_SCHEDULER_OFF;
+    scheduler->can_sleep = version.firmware_major >= 2;
+    scheduler->continuous = config->sample_period_usec <= active_usec;
+    scheduler->started = 0;
+    scheduler->measuring = 0;
+    scheduler->sleeping = 0;
+    scheduler->readings = 0;
+    scheduler->cycle_start_usec = 0;
+    scheduler->next_usec = 0;
+    scheduler->last_step_usec = 0;
+    scheduler->stats.samples = 0;
+    scheduler->stats.measurement_usec = 0;
+    scheduler->stats.idle_usec = 0;
+    scheduler->stats.sleep_usec = 0;
+    return 0;
+}
+
+/* Stop measuring and enter sleep mode if available */
+static int16_t sps30_scheduler_power_down(struct sps30_scheduler* scheduler) {
+    int16_t ret;
+
+    if (scheduler->measuring) {
+        ret = sps30_stop_measurement();
+        if (ret)
+            return ret;
+        scheduler->measuring = 0;
+    }
+    if (scheduler->can_sleep && !scheduler->sleeping) {
+        ret = sps30_sleep();
+        if (ret)
+            return ret;
+        scheduler->sleeping = 1;
+    }
+    return 0;
+}
+
+static int16_t sps30_scheduler_power_up(struct sps30_scheduler* scheduler) {
+    int16_t ret;
+
+    if (scheduler->sleeping) {
+        ret = sps30_wake_up();
+        if (ret)
+            return ret;
+        scheduler->sleeping = 0;
+    }
+    if (!scheduler->measuring) {
+        ret = sps30_start_measurement();
+        if (ret)
+            return ret;
+        scheduler->measuring = 1;
+    }
+    return 0;
+}
+
+static void sps30_scheduler_account(struct sps30_scheduler* scheduler,
+                                    uint64_t now_usec) {
+    uint64_t elapsed = now_usec - scheduler->last_step_usec;
+
+    if (scheduler->measuring)
+        scheduler->stats.measurement_usec += elapsed;
+    else if (scheduler->sleeping)
+        scheduler->stats.sleep_usec += elapsed;
+    else
+        scheduler->stats.idle_usec += elapsed;
+    scheduler->last_step_usec = now_usec;
+}
+
+/* Add a reading, return 1 once the sample is complete */
+static uint8_t sps30_scheduler_add(struct sps30_scheduler* scheduler,
+                                   const struct sps30_measurement* reading,
+                                   struct sps30_measurement* sample) {
+    enum sps30_measurement_field f;
+    uint8_t i;
+
+    for (i = 0; i < SPS30_NUM_FIELDS; ++i) {
+        f = (enum sps30_measurement_field)i;
+        if (scheduler->readings == 0)
+            scheduler->sums[i] = 0;
+        scheduler->sums[i] += sps30_get_measurement_field(reading, f);
+    }
+    if (++scheduler->readings < scheduler->config.readings_per_sample)
+        return 0;
+
+    for (i = 0; i < SPS30_NUM_FIELDS; ++i) {
+        f = (enum sps30_measurement_field)i;
+        sps30_set_measurement_field(sample, f,
+                                    scheduler->sums[i] / scheduler->readings);
+    }
+    scheduler->readings = 0;
+    return 1;
+}
+
+int16_t sps30_scheduler_step(struct sps30_scheduler* scheduler,
+                             uint64_t now_usec,
+                             struct sps30_measurement* measurement,
+                             uint64_t* next_usec) {
+    struct sps30_measurement reading;
+    const uint64_t period = scheduler->config.sample_period_usec;
+    uint64_t span;
+    int16_t ret = 0;
+
+    if (!scheduler->started) {
+        scheduler->started = 1;
+        scheduler->cycle_start_usec = now_usec;
+        scheduler->next_usec = now_usec;
+        scheduler->last_step_usec = now_usec;
+    }
+    sps30_scheduler_account(scheduler, now_usec);
+
+    if (now_usec < scheduler->next_usec) {
+        *next_usec = scheduler->next_usec;
+        return 0;
+    }
+
+    switch (scheduler->state) {
+        case SPS30_SCHEDULER_OFF:
+            if (now_usec < scheduler->cycle_start_usec) {
+                /* Retry a failed power down until the next cycle */
+                ret = sps30_scheduler_power_down(scheduler);
+                scheduler->next_usec = ret ? now_usec +
+                                                 SPS30_SCHEDULER_RETRY_USEC
+                                           : scheduler->cycle_start_usec;
+                break;
+            }
+            ret = sps30_scheduler_power_up(scheduler);
+            if (ret) {
+                scheduler->next_usec = now_usec + SPS30_SCHEDULER_RETRY_USEC;
+                break;
+            }
+            scheduler->state = SPS30_SCHEDULER_WARMING_UP;
+            scheduler->next_usec =
+                scheduler->cycle_start_usec + scheduler->config.warm_up_usec;
+            break;
+
+        case SPS30_SCHEDULER_WARMING_UP:
+            scheduler->state = SPS30_SCHEDULER_SAMPLING;
+            scheduler->readings = 0;
+            scheduler->next_usec = now_usec;
+            /* fall through */
+
+        case SPS30_SCHEDULER_SAMPLING:
+            ret = sps30_read_measurement(&reading);
+            if (ret == SPS30_ERR_NOT_ENOUGH_DATA) {
+                /* No new reading available yet */
+                scheduler->next_usec = now_usec + SPS30_SCHEDULER_RETRY_USEC;
+                ret = 0;
+                break;
+            }
+            if (ret) {
+                /* E.g. SPS30_ERR_STATE if the sensor stopped measuring: drop
+                 * the partial sample and restart the sensor with a new cycle
+                 */
+                (void)sps30_stop_measurement();
+                scheduler->measuring = 0;
+                scheduler->state = SPS30_SCHEDULER_OFF;
+                scheduler->cycle_start_usec =
+                    now_usec + SPS30_SCHEDULER_RETRY_USEC;
+                scheduler->next_usec = scheduler->cycle_start_usec;
+                break;
+            }
+            ret = 0;
+            if (!sps30_scheduler_add(scheduler, &reading, measurement)) {
+                scheduler->next_usec =
+                    now_usec + SPS30_SCHEDULER_READ_INTERVAL_USEC;
+                break;
+            }
+
+            /* Sample complete, schedule the next cycle and skip missed ones */
+            ++scheduler->stats.samples;
+            ret = SPS30_SCHEDULER_SAMPLE;
+            scheduler->cycle_start_usec += period;
+            while (scheduler->cycle_start_usec + period <= now_usec)
+                scheduler->cycle_start_usec += period;
+
+            if (scheduler->continuous) {
+                /* Already warm: only the averaging window precedes a sample */
+                span = (uint64_t)(scheduler->config.readings_per_sample - 1) *
+                       SPS30_SCHEDULER_READ_INTERVAL_USEC;
+                if (period > span)
+                    scheduler->next_usec = now_usec + period - span;
+                else
+                    scheduler->next_usec =
+                        now_usec + SPS30_SCHEDULER_READ_INTERVAL_USEC;
+            } else {
+                scheduler->state = SPS30_SCHEDULER_OFF;
+                scheduler->next_usec =
+                    sps30_scheduler_power_down(scheduler)
+                        ? now_usec + SPS30_SCHEDULER_RETRY_USEC
+                        : scheduler->cycle_start_usec;
+            }
+            break;
+    }
+
+    *next_usec = scheduler->next_usec;
+    return ret;
+}
+
+void sps30_scheduler_get_stats(const struct sps30_scheduler* scheduler,
+                               struct sps30_scheduler_stats* stats) {
+    uint64_t total;
+    uint64_t charge_uc;
+
+    *stats = scheduler->stats;
+    total = stats->measurement_usec + stats->idle_usec + stats->sleep_usec;
+    stats->duty_cycle_permille =
+        total ? (uint16_t)(stats->measurement_usec * 1000 / total) : 0;
+
+    charge_uc = (stats->measurement_usec * SPS30_CURRENT_MEASUREMENT_UA +
+                 stats->idle_usec * SPS30_CURRENT_IDLE_UA +
+                 stats->sleep_usec * SPS30_CURRENT_SLEEP_UA) /
+                1000000;
+    stats->energy_uj = charge_uc * SPS30_SUPPLY_VOLTAGE_MV / 1000;
+    stats->energy_per_sample_uj =
+        stats->samples ? (uint32_t)(stats->energy_uj / stats->samples) : 0;
+}
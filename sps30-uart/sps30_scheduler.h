@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS30_SCHEDULER_H
+#define SPS30_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+#include "sps30.h"
+
+#define SPS30_SCHEDULER_ERR_INVALID_CONFIG (-18)
+
+/** Return value of sps30_scheduler_step() when a sample was produced */
+#define SPS30_SCHEDULER_SAMPLE 1
+
+/*
+ * Typical supply current in uA of the operating modes and supply voltage in
+ * mV according to the datasheet, used for the energy estimate
+ */
+#ifndef SPS30_CURRENT_MEASUREMENT_UA
+#define SPS30_CURRENT_MEASUREMENT_UA 55000
+#endif
+#ifndef SPS30_CURRENT_IDLE_UA
+#define SPS30_CURRENT_IDLE_UA 330
+#endif
+#ifndef SPS30_CURRENT_SLEEP_UA
+#define SPS30_CURRENT_SLEEP_UA 38
+#endif
+#ifndef SPS30_SUPPLY_VOLTAGE_MV
+#define SPS30_SUPPLY_VOLTAGE_MV 5000
+#endif
+
+struct sps30_scheduler_config {
+    uint32_t sample_period_usec; /* time between two samples */
+    uint32_t warm_up_usec;       /* measurement time before the first read */
+    uint8_t readings_per_sample; /* 1 Hz readings averaged into one sample */
+};
+
+enum sps30_scheduler_state {
+    SPS30_SCHEDULER_OFF,        /* idle or sleeping until the next cycle */
+    SPS30_SCHEDULER_WARMING_UP, /* measuring, waiting for stable readings */
+    SPS30_SCHEDULER_SAMPLING,   /* measuring, collecting readings */
+};
+
+struct sps30_scheduler_stats {
+    uint32_t samples;
+    uint64_t measurement_usec; /* time spent in measurement mode */
+    uint64_t idle_usec;        /* time spent in idle mode */
+    uint64_t sleep_usec;       /* time spent in sleep mode */
+    uint16_t duty_cycle_permille;
+    uint64_t energy_uj;            /* estimated energy since init */
+    uint32_t energy_per_sample_uj; /* estimated energy per sample */
+};
+
+/**
+ * Duty-cycle scheduler driving start/stop measurement and sleep/wake-up of
+ * one SPS30.
+ *
+ * Every sample period, the sensor is woken up (firmware >= 2.0 only) and
+ * started, measures for the warm-up time and then readings_per_sample
+ * readings one second apart are averaged into one sample. Afterwards the
+ * sensor is stopped and sent to sleep (firmware >= 2.0 only, idle otherwise)
+ * until the next period. If the period is too short to stop in between, the
+ * sensor measures continuously.
+ *
+ * The members are private.
+ */
+struct sps30_scheduler {
+    struct sps30_scheduler_config config;
+    enum sps30_scheduler_state state;
+    uint8_t can_sleep;
+    uint8_t continuous;
+    uint8_t started;
+    uint8_t measuring;
+    uint8_t sleeping;
+    uint8_t readings;
+    uint64_t cycle_start_usec;
+    uint64_t next_usec;
+    uint64_t last_step_usec;
+    float sums[SPS30_NUM_FIELDS];
+    struct sps30_scheduler_stats stats;
+};
+
+/**
+ * sps30_scheduler_init() - initialize the scheduler of a probed sensor
+ *
+ * Reads the firmware version to decide whether sleep mode is available. The
+ * first cycle starts with the first call of sps30_scheduler_step().
+ *
+ * @scheduler:  Scheduler to initialize
+ * @config:     Configuration, copied into scheduler
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t sps30_scheduler_init(struct sps30_scheduler* scheduler,
+                             const struct sps30_scheduler_config* config);
+
+/**
+ * sps30_scheduler_step() - execute due actions of the schedule
+ *
+ * Call when the time returned in next_usec is reached, e.g.
+ *
+ *   ret = sps30_scheduler_step(&scheduler, now, &m, &next);
+ *   sensirion_sleep_usec((uint32_t)(next - now));
+ *
+ * @scheduler:      Scheduler
+ * @now_usec:       Current time from sensirion_get_time_usec()
+ * @measurement:    Memory where a sample is stored
+ * @next_usec:      Memory where the time of the next action is stored
+ * Return:          SPS30_SCHEDULER_SAMPLE if measurement contains a new
+ *                  sample, 0 if not, another error code if the sensor failed
+ *                  (e.g. SPS30_ERR_STATE). A failed action is retried at the
+ *                  next step, a failed reading restarts the measurement with
+ *                  a new cycle.
+ */
+int16_t sps30_scheduler_step(struct sps30_scheduler* scheduler,
+                             uint64_t now_usec,
+                             struct sps30_measurement* measurement,
+                             uint64_t* next_usec);
+
+/**
+ * sps30_scheduler_get_stats() - read duty cycle and energy statistics
+ *
+ * @scheduler:  Scheduler to query
+ * @stats:      Memory where the statistics are stored
+ */
+void sps30_scheduler_get_stats(const struct sps30_scheduler* scheduler,
+                               struct sps30_scheduler_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_SCHEDULER_H */
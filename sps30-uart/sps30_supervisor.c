@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sps30_supervisor.h"
+#include "sensirion_shdlc.h"
+#include "sensirion_uart.h"
+
+enum sps30_supervisor_op {
+    SPS30_SUPERVISOR_OP_READ,
+    SPS30_SUPERVISOR_OP_START,
+    SPS30_SUPERVISOR_OP_STOP,
+};
+
+enum sps30_error_class sps30_classify_error(int16_t error) {
+    switch (error) {
+        case 0:
+            return SPS30_ERROR_CLASS_NONE;
+        case SENSIRION_SHDLC_ERR_MISSING_START:
+        case SENSIRION_SHDLC_ERR_MISSING_STOP:
+            return SPS30_ERROR_CLASS_TIMEOUT;
+        case SENSIRION_SHDLC_ERR_CRC_MISMATCH:
+            return SPS30_ERROR_CLASS_CRC;
+        case SENSIRION_SHDLC_ERR_ENCODING_ERROR:
+        case SENSIRION_SHDLC_ERR_FRAME_TOO_LONG:
+            return SPS30_ERROR_CLASS_ENCODING;
+    }
+    if (SPS30_IS_ERR_STATE(error))
+        return SPS30_ERROR_CLASS_STATE;
+    return SPS30_ERROR_CLASS_OTHER;
+}
+
+int16_t
+sps30_supervisor_init(struct sps30_supervisor* supervisor,
+                      const struct sps30_supervisor_config* config,
+                      uint8_t port) {
+    uint8_t i;
+
+    if (config->min_backoff_usec > config->max_backoff_usec)
+        return SPS30_SUPERVISOR_ERR_INVALID_CONFIG;
+
+    supervisor->config = *config;
+    supervisor->port = port;
+    supervisor->measuring = 0;
+    supervisor->health = SPS30_HEALTH_OK;
+    supervisor->last_error_class = SPS30_ERROR_CLASS_NONE;
+    supervisor->consecutive_errors = 0;
+    supervisor->backoff_usec = 0;
+    supervisor->retry_usec = 0;
+    supervisor->fault_usec = 0;
+    for (i = 0; i < SPS30_NUM_ERROR_CLASSES; ++i)
+        supervisor->stats.errors[i] = 0;
+    supervisor->stats.retries = 0;
+    supervisor->stats.resets = 0;
+    supervisor->stats.reopens = 0;
+    supervisor->stats.recoveries = 0;
+    supervisor->stats.last_recovery_usec = 0;
+    supervisor->stats.max_recovery_usec = 0;
+    return 0;
+}
+
+/* Execute the recovery step due after consecutive_errors failures */
+static int16_t sps30_supervisor_recover(struct sps30_supervisor* supervisor) {
+    const struct sps30_supervisor_config* config = &supervisor->config;
+    uint32_t escalation;
+    uint8_t restart;
+    int16_t ret = 0;
+
+    /* A rejected command may mean the sensor lost its measurement mode */
+    restart = supervisor->last_error_class == SPS30_ERROR_CLASS_STATE;
+
+    if (supervisor->consecutive_errors <= config->max_retries) {
+        ++supervisor->stats.retries;
+    } else {
+        /* Cycle through resets_per_reopen resets and one reopen */
+        escalation = (supervisor->consecutive_errors - config->max_retries -
+                      1) %
+                     ((uint32_t)config->resets_per_reopen + 1);
+        if (escalation < config->resets_per_reopen || !config->reopen) {
+            ++supervisor->stats.resets;
+            ret = sps30_reset_wait_ready(SPS30_SUPERVISOR_READY_TIMEOUT_USEC,
+                                         (uint32_t*)NULL);
+        } else {
+            ++supervisor->stats.reopens;
+            sps30_invalidate_cache();
+            ret = config->reopen(supervisor->port);
+            if (ret == 0)
+                ret = sps30_select_port(supervisor->port);
+            if (ret == 0)
+                ret = sps30_wake_up_wait_ready(
+                    SPS30_SUPERVISOR_READY_TIMEOUT_USEC, (uint32_t*)NULL);
+        }
+        restart = 1;
+    }
+
+    if (ret == 0 && restart && supervisor->measuring)
+        ret = sps30_start_measurement();
+    return ret;
+}
+
+static void sps30_supervisor_fail(struct sps30_supervisor* supervisor,
+                                  enum sps30_error_class error_class,
+                                  uint64_t now_usec) {
+    const struct sps30_supervisor_config* config = &supervisor->config;
+    uint32_t n;
+
+    ++supervisor->stats.errors[error_class];
+    supervisor->last_error_class = error_class;
+    if (supervisor->consecutive_errors == 0) {
+        supervisor->fault_usec = now_usec;
+        supervisor->backoff_usec = config->min_backoff_usec;
+    } else if (supervisor->backoff_usec > config->max_backoff_usec / 2) {
+        supervisor->backoff_usec = config->max_backoff_usec;
+    } else {
+        supervisor->backoff_usec *= 2;
+    }
+    if (supervisor->consecutive_errors < 0xffffffff)
+        ++supervisor->consecutive_errors;
+    supervisor->retry_usec = now_usec + supervisor->backoff_usec;
+
+    n = supervisor->consecutive_errors;
+    if (n <= config->max_retries)
+        supervisor->health = SPS30_HEALTH_DEGRADED;
+    else if (n <= (uint32_t)config->max_retries + config->resets_per_reopen + 1)
+        supervisor->health = SPS30_HEALTH_RECOVERING;
+    else
+        supervisor->health = SPS30_HEALTH_FAILED;
+}
+
+static void sps30_supervisor_succeed(struct sps30_supervisor* supervisor,
+                                     uint64_t now_usec) {
+    uint64_t recovery_usec;
+
+    if (supervisor->consecutive_errors) {
+        recovery_usec = now_usec - supervisor->fault_usec;
+        if (recovery_usec > 0xffffffff)
+            recovery_usec = 0xffffffff;
+        ++supervisor->stats.recoveries;
+        supervisor->stats.last_recovery_usec = (uint32_t)recovery_usec;
+        if (supervisor->stats.last_recovery_usec >
+            supervisor->stats.max_recovery_usec)
+            supervisor->stats.max_recovery_usec =
+                supervisor->stats.last_recovery_usec;
+    }
+    supervisor->consecutive_errors = 0;
+    supervisor->last_error_class = SPS30_ERROR_CLASS_NONE;
+    supervisor->health = SPS30_HEALTH_OK;
+}
+
+static int16_t sps30_supervisor_run(struct sps30_supervisor* supervisor,
+                                    enum sps30_supervisor_op op,
+                                    struct sps30_measurement* measurement) {
+    enum sps30_error_class error_class;
+    uint8_t executed = 0;
+    int16_t ret;
+
+    if (supervisor->consecutive_errors &&
+        sensirion_get_time_usec() < supervisor->retry_usec)
+        return SPS30_SUPERVISOR_ERR_BACKOFF;
+
+    ret = sps30_select_port(supervisor->port);
+    if (ret == 0 && supervisor->consecutive_errors)
+        ret = sps30_supervisor_recover(supervisor);
+    if (ret == 0) {
+        executed = 1;
+        switch (op) {
+            case SPS30_SUPERVISOR_OP_READ:
+                ret = sps30_read_measurement(measurement);
+                break;
+            case SPS30_SUPERVISOR_OP_START:
+                ret = sps30_start_measurement();
+                break;
+            case SPS30_SUPERVISOR_OP_STOP:
+                ret = sps30_stop_measurement();
+                break;
+        }
+    }
+
+    /* SPS30_ERR_NOT_ENOUGH_DATA shares its value with UART errors, it only
+     * means no new measurement if the sensor answered the read */
+    if (executed && op == SPS30_SUPERVISOR_OP_READ &&
+        ret == SPS30_ERR_NOT_ENOUGH_DATA)
+        error_class = SPS30_ERROR_CLASS_NONE;
+    else
+        error_class = sps30_classify_error(ret);
+    if (error_class == SPS30_ERROR_CLASS_NONE)
+        sps30_supervisor_succeed(supervisor, sensirion_get_time_usec());
+    else
+        sps30_supervisor_fail(supervisor, error_class,
+                              sensirion_get_time_usec());
+    return ret;
+}
+
+int16_t
+sps30_supervisor_start_measurement(struct sps30_supervisor* supervisor) {
+    supervisor->measuring = 1;
+    return sps30_supervisor_run(supervisor, SPS30_SUPERVISOR_OP_START,
+                                (struct sps30_measurement*)NULL);
+}
+
+int16_t
+sps30_supervisor_stop_measurement(struct sps30_supervisor* supervisor) {
+    supervisor->measuring = 0;
+    return sps30_supervisor_run(supervisor, SPS30_SUPERVISOR_OP_STOP,
+                                (struct sps30_measurement*)NULL);
+}
+
+int16_t
+sps30_supervisor_read_measurement(struct sps30_supervisor* supervisor,
+                                  struct sps30_measurement* measurement) {
+    return sps30_supervisor_run(supervisor, SPS30_SUPERVISOR_OP_READ,
+                                measurement);
+}
+
+enum sps30_health
+sps30_supervisor_get_health(const struct sps30_supervisor* supervisor) {
+    return supervisor->health;
+}
+
+void sps30_supervisor_get_stats(const struct sps30_supervisor* supervisor,
+                                struct sps30_supervisor_stats* stats) {
+    *stats = supervisor->stats;
+}
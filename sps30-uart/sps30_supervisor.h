@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2018, Sensirion AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Sensirion AG nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPS30_SUPERVISOR_H
+#define SPS30_SUPERVISOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensirion_arch_config.h"
+#include "sps30.h"
+
+#define SPS30_SUPERVISOR_ERR_INVALID_CONFIG (-19)
+/** The sensor is faulty and the next recovery attempt is not due yet */
+#define SPS30_SUPERVISOR_ERR_BACKOFF (-20)
+
+/** Maximum time to wait for the sensor after a reset or port reopen */
+#ifndef SPS30_SUPERVISOR_READY_TIMEOUT_USEC
+#define SPS30_SUPERVISOR_READY_TIMEOUT_USEC 1000000
+#endif
+
+enum sps30_error_class {
+    SPS30_ERROR_CLASS_NONE,
+    SPS30_ERROR_CLASS_TIMEOUT,  /* no or no complete response */
+    SPS30_ERROR_CLASS_CRC,      /* corrupted response */
+    SPS30_ERROR_CLASS_ENCODING, /* malformed response */
+    SPS30_ERROR_CLASS_STATE,    /* the sensor rejected the command */
+    SPS30_ERROR_CLASS_OTHER,    /* e.g. UART errors */
+    SPS30_NUM_ERROR_CLASSES,
+};
+
+enum sps30_health {
+    SPS30_HEALTH_OK,         /* the last command succeeded */
+    SPS30_HEALTH_DEGRADED,   /* failed, retrying */
+    SPS30_HEALTH_RECOVERING, /* failed repeatedly, resetting/reopening */
+    SPS30_HEALTH_FAILED,     /* all recovery steps failed, still retrying */
+};
+
+/**
+ * Reopen the UART of the sensor on port, e.g. with sensirion_uart_close() and
+ * sensirion_uart_open() on single-port setups. The UART implementation of
+ * multi-port setups must only reopen the given port, since the other sensors
+ * keep using theirs.
+ */
+typedef int16_t (*sps30_supervisor_reopen_fn)(uint8_t port);
+
+struct sps30_supervisor_config {
+    uint8_t max_retries;       /* plain retries before the first reset */
+    uint8_t resets_per_reopen; /* resets before the port is reopened */
+    uint32_t min_backoff_usec; /* delay before the first retry */
+    uint32_t max_backoff_usec; /* the delay doubles up to this limit */
+    sps30_supervisor_reopen_fn reopen; /* NULL to only reset the sensor */
+};
+
+#define SPS30_SUPERVISOR_DEFAULT_CONFIG \
+    { 2, 2, 100000, 5000000, (sps30_supervisor_reopen_fn)NULL }
+
+struct sps30_supervisor_stats {
+    uint32_t errors[SPS30_NUM_ERROR_CLASSES];
+    uint32_t retries;
+    uint32_t resets;
+    uint32_t reopens;
+    uint32_t recoveries;          /* faults followed by a success */
+    uint32_t last_recovery_usec;  /* time from the first error to recovery */
+    uint32_t max_recovery_usec;
+};
+
+/**
+ * Supervisor of one SPS30 recovering from communication faults.
+ *
+ * Failed commands are retried with exponential backoff. If the sensor still
+ * does not respond, it is reset and, if a reopen function is configured,
+ * eventually its UART is reopened, repeating resets and reopens until the
+ * sensor responds again.
+ * After a reset or reopen, or if the sensor rejects a read because it is not
+ * measuring (e.g. after a power cycle), the measurement is restarted if it
+ * was started through the supervisor.
+ *
+ * The members are private.
+ */
+struct sps30_supervisor {
+    struct sps30_supervisor_config config;
+    uint8_t port;
+    uint8_t measuring;
+    enum sps30_health health;
+    enum sps30_error_class last_error_class;
+    uint32_t consecutive_errors;
+    uint32_t backoff_usec;
+    uint64_t retry_usec;
+    uint64_t fault_usec;
+    struct sps30_supervisor_stats stats;
+};
+
+/**
+ * sps30_classify_error() - classify an error code of the sps30 driver
+ *
+ * SPS30_ERR_NOT_ENOUGH_DATA has the same value as the errors of the UART
+ * HAL, e.g. of sensirion_uart_open() or sps30_select_port(), and is thus
+ * classified as SPS30_ERROR_CLASS_OTHER. Only the caller of
+ * sps30_read_measurement() knows that it means no new measurement yet.
+ *
+ * @error:  Error code returned by a function of the sps30 driver
+ * Return:  Class of the error, SPS30_ERROR_CLASS_NONE for 0
+ */
+enum sps30_error_class sps30_classify_error(int16_t error);
+
+/**
+ * sps30_supervisor_init() - initialize the supervisor of a sensor
+ *
+ * @supervisor: Supervisor to initialize
+ * @config:     Configuration, copied into supervisor, see
+ *              SPS30_SUPERVISOR_DEFAULT_CONFIG
+ * @port:       UART port of the sensor, selected with sps30_select_port()
+ *              before every command
+ * Return:      0 on success, an error code otherwise
+ */
+int16_t
+sps30_supervisor_init(struct sps30_supervisor* supervisor,
+                      const struct sps30_supervisor_config* config,
+                      uint8_t port);
+
+/**
+ * sps30_supervisor_start_measurement() - start measuring under supervision
+ *
+ * The measurement is restarted after recoveries until
+ * sps30_supervisor_stop_measurement() is called.
+ *
+ * @supervisor: Supervisor of the sensor
+ * Return:      0 on success, SPS30_SUPERVISOR_ERR_BACKOFF or an error code of
+ *              the driver otherwise
+ */
+int16_t
+sps30_supervisor_start_measurement(struct sps30_supervisor* supervisor);
+
+/**
+ * sps30_supervisor_stop_measurement() - stop measuring under supervision
+ *
+ * @supervisor: Supervisor of the sensor
+ * Return:      0 on success, SPS30_SUPERVISOR_ERR_BACKOFF or an error code of
+ *              the driver otherwise
+ */
+int16_t
+sps30_supervisor_stop_measurement(struct sps30_supervisor* supervisor);
+
+/**
+ * sps30_supervisor_read_measurement() - read a measurement under supervision
+ *
+ * While the sensor is faulty, calls before the backoff elapsed return
+ * SPS30_SUPERVISOR_ERR_BACKOFF immediately. Otherwise the due recovery step
+ * is executed before the measurement is read.
+ *
+ * @supervisor:     Supervisor of the sensor
+ * @measurement:    Memory where the measurement is stored
+ * Return:          0 on success, SPS30_ERR_NOT_ENOUGH_DATA (not a fault) if
+ *                  no new measurement is available,
+ *                  SPS30_SUPERVISOR_ERR_BACKOFF or an error code of the driver
+ *                  otherwise
+ */
+int16_t
+sps30_supervisor_read_measurement(struct sps30_supervisor* supervisor,
+                                  struct sps30_measurement* measurement);
+
+/**
+ * sps30_supervisor_get_health() - get the health state of the sensor
+ *
+ * @supervisor: Supervisor of the sensor
+ * Return:      Health state
+ */
+enum sps30_health
+sps30_supervisor_get_health(const struct sps30_supervisor* supervisor);
+
+/**
+ * sps30_supervisor_get_stats() - read error and recovery statistics
+ *
+ * @supervisor: Supervisor of the sensor
+ * @stats:      Memory where the statistics are stored
+ */
+void sps30_supervisor_get_stats(const struct sps30_supervisor* supervisor,
+                                struct sps30_supervisor_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPS30_SUPERVISOR_H */
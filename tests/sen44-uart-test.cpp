@@ -113,3 +113,27 @@ TEST (SEN44_Test, SEN44_measurement) {
     CHECK_ZERO_TEXT(error, "sen44_stop_measurement");
     sensirion_sleep_usec(CMD_DELAY_USEC);
 }
+
+TEST (SEN44_Test, SEN44_measurement_ts) {
+    int16_t error;
+    struct sen44_measurement m;
+    struct sensirion_shdlc_rx_timestamps ts;
+    uint64_t before;
+
+    error = sen44_start_measurement();
+    CHECK_ZERO_TEXT(error, "sen44_start_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    sensirion_sleep_usec(1000000);  // wait 1 sec for measurement to be ready
+    before = sensirion_get_time_usec();
+    error = sen44_read_measurement_ts(&m, &ts);
+    CHECK_ZERO_TEXT(error, "sen44_read_measurement_ts");
+    CHECK_TRUE_TEXT(before <= ts.first_byte_usec,
+                    "Response arrived before the request was sent");
+    CHECK_TRUE_TEXT(ts.first_byte_usec <= ts.last_byte_usec,
+                    "Last byte arrived before the first byte");
+
+    error = sen44_stop_measurement();
+    CHECK_ZERO_TEXT(error, "sen44_stop_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+}
@@ -0,0 +1,1194 @@
+#include "sensirion_shdlc.h"
+#include "sensirion_test_setup.h"
+#include "sps30.h"
+#include "sps_aqi.h"
+#include "sps_cbor.h"
+#include "sps_format.h"
+#include "sps_mlog.h"
+#include "sps_range_index.h"
+#include "sps_reader.h"
+#include "sps_report_filter.h"
+#include "sps_ring.h"
+#include "sps_shm.h"
+#include "sps_stats.h"
+#include "sps_tsc.h"
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_RANDOM_SAMPLES 2000
+
+TEST_GROUP (SPS_Common_Test) {};
+
+// Deterministic pseudo random numbers (LCG) for reproducible test data
+static uint32_t random_state;
+
+static uint32_t random_next(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    return random_state >> 8;
+}
+
+static float random_float(float max) {
+    return (float)(random_next() % 1000000) * max / 1000000.0f;
+}
+
+TEST (SPS_Common_Test, SPS_stats_window) {
+    struct sps_stats_window_config config = {1000000, 16, 20, 0.0f, 100.0f};
+    static uint32_t storage[SPS_STATS_WINDOW_STORAGE_SIZE(16, 20) / 4];
+    static uint64_t timestamps[NUM_RANDOM_SAMPLES];
+    static float values[NUM_RANDOM_SAMPLES];
+    static float window_values[NUM_RANDOM_SAMPLES];
+    struct sps_stats_window window;
+    struct sps_stats_summary summary;
+    uint64_t now = 0;
+    uint64_t current_bucket;
+    uint32_t n;
+    uint32_t i;
+    uint32_t j;
+    double sum;
+    float min;
+    float max;
+    float p;
+    float tmp;
+    int16_t error;
+
+    error = sps_stats_window_init(&window, &config, storage, sizeof(storage));
+    CHECK_ZERO_TEXT(error, "sps_stats_window_init");
+    sps_stats_window_get_summary(&window, &summary);
+    CHECK_EQUAL_TEXT(0, summary.count, "New window not empty");
+
+    random_state = 29;
+    for (i = 0; i < NUM_RANDOM_SAMPLES; ++i) {
+        // Mostly dense samples with occasional gaps longer than the window
+        now += random_next() % 50 == 0 ? random_next() % 20000000
+                                       : random_next() % 400000;
+        timestamps[i] = now;
+        values[i] = random_float(100.0f);
+        sps_stats_window_add(&window, now, values[i]);
+
+        // Brute force over the samples in the last num_buckets buckets
+        current_bucket = now / config.bucket_usec;
+        n = 0;
+        sum = 0;
+        min = values[i];
+        max = values[i];
+        for (j = 0; j <= i; ++j) {
+            if (timestamps[j] / config.bucket_usec + config.num_buckets <=
+                current_bucket)
+                continue;
+            window_values[n++] = values[j];
+            sum += values[j];
+            if (values[j] < min)
+                min = values[j];
+            if (values[j] > max)
+                max = values[j];
+        }
+
+        sps_stats_window_get_summary(&window, &summary);
+        CHECK_EQUAL_TEXT(n, summary.count, "Wrong sample count");
+        CHECK_EQUAL_TEXT(min, summary.min, "Wrong minimum");
+        CHECK_EQUAL_TEXT(max, summary.max, "Wrong maximum");
+        CHECK_TRUE_TEXT(summary.mean - sum / n < 1e-3 &&
+                            sum / n - summary.mean < 1e-3,
+                        "Wrong mean");
+    }
+
+    // The median is within one histogram bin of the exact one
+    for (i = 1; i < n; ++i) {
+        tmp = window_values[i];
+        for (j = i; j > 0 && window_values[j - 1] > tmp; --j)
+            window_values[j] = window_values[j - 1];
+        window_values[j] = tmp;
+    }
+    error = sps_stats_window_get_percentile(&window, 50, &p);
+    CHECK_ZERO_TEXT(error, "sps_stats_window_get_percentile");
+    tmp = window_values[(n + 1) / 2 - 1];
+    CHECK_TRUE_TEXT(p - tmp <= 5.0f && tmp - p <= 5.0f, "Median out of bin");
+
+    // All samples expire
+    sps_stats_window_advance(&window, now + 16 * config.bucket_usec);
+    sps_stats_window_get_summary(&window, &summary);
+    CHECK_EQUAL_TEXT(0, summary.count, "Samples not expired");
+}
+
+#define TSC_NUM_FIELDS 10
+#define TSC_NUM_SAMPLES 1000
+
+struct tsc_output {
+    uint8_t data[TSC_NUM_SAMPLES * TSC_NUM_FIELDS * 8];
+    uint32_t len;
+    uint32_t blocks;
+};
+
+static int16_t tsc_write_block(void* ctx, const uint8_t* block, uint16_t len) {
+    struct tsc_output* out = (struct tsc_output*)ctx;
+
+    if (out->len + len > sizeof(out->data))
+        return -1;
+    memcpy(&out->data[out->len], block, len);
+    out->len += len;
+    ++out->blocks;
+    return 0;
+}
+
+static void tsc_round_trip(uint8_t mantissa_bits) {
+    static uint64_t timestamps[TSC_NUM_SAMPLES];
+    static float values[TSC_NUM_SAMPLES][TSC_NUM_FIELDS];
+    static struct tsc_output out;
+    struct sps_tsc_config config = {TSC_NUM_FIELDS, mantissa_bits, 1000,
+                                    tsc_write_block, &out};
+    struct sps_tsc_encoder encoder;
+    struct sps_tsc_decoder decoder;
+    uint8_t buffer[256];
+    uint64_t now = 1000000000;
+    uint64_t timestamp;
+    float decoded[TSC_NUM_FIELDS];
+    float tolerance;
+    float diff;
+    uint32_t block_size;
+    uint32_t pos = 0;
+    uint32_t i = 0;
+    uint8_t j;
+    int16_t error;
+
+    out.len = 0;
+    out.blocks = 0;
+    error = sps_tsc_encoder_init(&encoder, &config, buffer, sizeof(buffer));
+    CHECK_ZERO_TEXT(error, "sps_tsc_encoder_init");
+
+    random_state = 30;
+    for (i = 0; i < TSC_NUM_SAMPLES; ++i) {
+        // 1 s interval with jitter in ms resolution and occasional gaps
+        now += 1000000 + (random_next() % 21) * 1000 - 10000;
+        if (random_next() % 100 == 0)
+            now += (uint64_t)(random_next() % 100000) * 1000;
+        timestamps[i] = now;
+        for (j = 0; j < TSC_NUM_FIELDS; ++j) {
+            if (i == 0 || random_next() % 4 == 0)
+                values[i][j] = random_float(1000.0f) - 10.0f;
+            else
+                values[i][j] = values[i - 1][j];
+        }
+        values[i][0] = 0.0f;
+        error = sps_tsc_encoder_append(&encoder, now, values[i]);
+        CHECK_ZERO_TEXT(error, "sps_tsc_encoder_append");
+    }
+    error = sps_tsc_encoder_flush(&encoder);
+    CHECK_ZERO_TEXT(error, "sps_tsc_encoder_flush");
+    CHECK_TRUE_TEXT(out.blocks > 1, "Samples not split into blocks");
+
+    // 2^-mantissa_bits relative error of the truncated mantissa
+    tolerance = 1.0f / (float)(1 << mantissa_bits);
+    i = 0;
+    while (pos < out.len) {
+        error = sps_tsc_get_block_size(&out.data[pos], &block_size);
+        CHECK_ZERO_TEXT(error, "sps_tsc_get_block_size");
+        error = sps_tsc_decoder_init(&decoder, &out.data[pos], block_size);
+        CHECK_ZERO_TEXT(error, "sps_tsc_decoder_init");
+        CHECK_EQUAL_TEXT(TSC_NUM_FIELDS,
+                         sps_tsc_decoder_get_num_fields(&decoder),
+                         "Wrong number of fields");
+        while ((error = sps_tsc_decoder_next(&decoder, &timestamp,
+                                             decoded)) == 0) {
+            CHECK_TRUE_TEXT(i < TSC_NUM_SAMPLES, "Too many samples");
+            CHECK_EQUAL_TEXT(timestamps[i], timestamp, "Wrong timestamp");
+            for (j = 0; j < TSC_NUM_FIELDS; ++j) {
+                if (mantissa_bits == 23) {
+                    CHECK_EQUAL_TEXT(values[i][j], decoded[j],
+                                     "Lossless value differs");
+                    continue;
+                }
+                diff = values[i][j] - decoded[j];
+                if (diff < 0)
+                    diff = -diff;
+                if (values[i][j] < 0)
+                    CHECK_TRUE_TEXT(diff <= -values[i][j] * tolerance,
+                                    "Lossy value out of tolerance");
+                else
+                    CHECK_TRUE_TEXT(diff <= values[i][j] * tolerance,
+                                    "Lossy value out of tolerance");
+            }
+            ++i;
+        }
+        CHECK_EQUAL_TEXT(SPS_TSC_ERR_END_OF_BLOCK, error, "Corrupt block");
+        pos += block_size;
+    }
+    CHECK_EQUAL_TEXT(TSC_NUM_SAMPLES, i, "Samples missing");
+}
+
+TEST (SPS_Common_Test, SPS_tsc_round_trip_lossless) {
+    tsc_round_trip(23);
+}
+
+TEST (SPS_Common_Test, SPS_tsc_round_trip_lossy) {
+    tsc_round_trip(10);
+}
+
+#define MLOG_PATH "/tmp/sps-common-test.mlog"
+#define MLOG_RECORDS_PER_BLOCK 4
+#define MLOG_NUM_BLOCKS 4
+#define MLOG_NUM_RECORDS 10
+
+struct mlog_record {
+    uint64_t timestamp_usec;
+    uint32_t value;
+    uint32_t padding;
+};
+
+static void mlog_write(void) {
+    struct sps_mlog log;
+    struct mlog_record record;
+    int16_t error;
+    uint32_t i;
+
+    unlink(MLOG_PATH);
+    error = sps_mlog_open_writer(&log, MLOG_PATH, sizeof(record),
+                                 MLOG_RECORDS_PER_BLOCK, MLOG_NUM_BLOCKS);
+    CHECK_ZERO_TEXT(error, "sps_mlog_open_writer");
+    memset(&record, 0, sizeof(record));
+    for (i = 0; i < MLOG_NUM_RECORDS; ++i) {
+        record.timestamp_usec = 1000 * (i + 1);
+        record.value = i;
+        error = sps_mlog_append(&log, &record);
+        CHECK_ZERO_TEXT(error, "sps_mlog_append");
+    }
+    error = sps_mlog_close(&log);
+    CHECK_ZERO_TEXT(error, "sps_mlog_close");
+}
+
+// Read all records from timestamp_usec on and return their number
+static uint32_t mlog_read(uint64_t timestamp_usec, uint32_t* values) {
+    struct sps_mlog log;
+    struct sps_mlog_cursor cursor;
+    struct mlog_record record;
+    int16_t error;
+    uint32_t n = 0;
+
+    error = sps_mlog_open_reader(&log, MLOG_PATH);
+    CHECK_ZERO_TEXT(error, "sps_mlog_open_reader");
+    error = sps_mlog_seek(&log, timestamp_usec, &cursor);
+    CHECK_ZERO_TEXT(error, "sps_mlog_seek");
+    while ((error = sps_mlog_read(&log, &cursor, &record)) == 0) {
+        CHECK_TRUE_TEXT(n < MLOG_NUM_RECORDS, "Too many records");
+        CHECK_EQUAL_TEXT(1000 * (record.value + 1), record.timestamp_usec,
+                         "Record corrupt");
+        values[n++] = record.value;
+    }
+    CHECK_EQUAL_TEXT(SPS_MLOG_ERR_END, error, "sps_mlog_read");
+    sps_mlog_close(&log);
+    return n;
+}
+
+// Overwrite a uint32_t of the file
+static void mlog_poke(off_t offset, uint32_t value) {
+    int fd = open(MLOG_PATH, O_RDWR);
+
+    CHECK_TRUE_TEXT(fd >= 0, "open");
+    CHECK_EQUAL_TEXT(sizeof(value), pwrite(fd, &value, sizeof(value), offset),
+                     "pwrite");
+    close(fd);
+}
+
+// Offset of a record of the block with the given sequence number
+static off_t mlog_record_offset(uint32_t sequence, uint32_t index) {
+    uint32_t geometry[2]; // block_size, header_size
+    int fd = open(MLOG_PATH, O_RDONLY);
+
+    CHECK_TRUE_TEXT(fd >= 0, "open");
+    CHECK_EQUAL_TEXT(sizeof(geometry), pread(fd, geometry, sizeof(geometry),
+                                             5 * sizeof(uint32_t)),
+                     "pread");
+    close(fd);
+    // 32 bytes block header, records followed by their CRC
+    return (off_t)geometry[1] +
+           (off_t)(sequence % MLOG_NUM_BLOCKS) * geometry[0] + 32 +
+           (off_t)index * (sizeof(struct mlog_record) + sizeof(uint32_t));
+}
+
+TEST (SPS_Common_Test, SPS_mlog_write_seek_read) {
+    uint32_t values[MLOG_NUM_RECORDS];
+    uint32_t n;
+    uint32_t i;
+
+    mlog_write();
+    n = mlog_read(0, values);
+    CHECK_EQUAL_TEXT(MLOG_NUM_RECORDS, n, "Records missing");
+    for (i = 0; i < n; ++i)
+        CHECK_EQUAL_TEXT(i, values[i], "Wrong order");
+
+    // Within a block, at a block start and between records
+    n = mlog_read(6000, values);
+    CHECK_EQUAL_TEXT(MLOG_NUM_RECORDS - 5, n, "Seek within block");
+    CHECK_EQUAL_TEXT(5, values[0], "Seek within block");
+    n = mlog_read(4500, values);
+    CHECK_EQUAL_TEXT(MLOG_NUM_RECORDS - 4, n, "Seek to block start");
+    CHECK_EQUAL_TEXT(4, values[0], "Seek to block start");
+    unlink(MLOG_PATH);
+}
+
+TEST (SPS_Common_Test, SPS_mlog_recover_prefix) {
+    struct sps_mlog log;
+    uint32_t expected[] = {0, 1, 2, 3, 4, 8, 9};
+    uint32_t values[MLOG_NUM_RECORDS];
+    int16_t error;
+    uint32_t n;
+    uint32_t i;
+
+    mlog_write();
+    // Second record of block 2 never reached the disk, the count of block 3
+    // neither
+    mlog_poke(mlog_record_offset(2, 1), 0xdeadbeef);
+    mlog_poke(mlog_record_offset(3, 0) - 32 + 2 * sizeof(uint32_t), 0);
+
+    error = sps_mlog_open_writer(&log, MLOG_PATH, sizeof(struct mlog_record),
+                                 MLOG_RECORDS_PER_BLOCK, MLOG_NUM_BLOCKS);
+    CHECK_ZERO_TEXT(error, "sps_mlog_open_writer");
+    error = sps_mlog_close(&log);
+    CHECK_ZERO_TEXT(error, "sps_mlog_close");
+
+    n = mlog_read(0, values);
+    CHECK_EQUAL_TEXT(sizeof(expected) / sizeof(expected[0]), n,
+                     "Valid prefix not recovered");
+    for (i = 0; i < n; ++i)
+        CHECK_EQUAL_TEXT(expected[i], values[i], "Wrong record recovered");
+    unlink(MLOG_PATH);
+}
+
+TEST (SPS_Common_Test, SPS_mlog_invalid_geometry) {
+    struct sps_mlog log;
+    int16_t error;
+
+    mlog_write();
+    // records_per_block exceeding the block size
+    mlog_poke(3 * sizeof(uint32_t), 1000);
+    error = sps_mlog_open_reader(&log, MLOG_PATH);
+    CHECK_EQUAL_TEXT(SPS_MLOG_ERR_INVALID_FILE, error,
+                     "Blocks overlap, file must be rejected");
+    unlink(MLOG_PATH);
+}
+
+#define RANGE_CAPACITY 100
+#define RANGE_NUM_FIELDS 2
+#define RANGE_NUM_SAMPLES 250
+
+TEST (SPS_Common_Test, SPS_range_index_query) {
+    static uint64_t storage[SPS_RANGE_INDEX_STORAGE_SIZE(RANGE_CAPACITY,
+                                                         RANGE_NUM_FIELDS) /
+                            8];
+    static uint64_t timestamps[RANGE_NUM_SAMPLES];
+    static float values[RANGE_NUM_SAMPLES][RANGE_NUM_FIELDS];
+    struct sps_range_index index;
+    struct sps_stats_summary summary;
+    uint64_t from;
+    uint64_t to;
+    uint64_t span;
+    uint64_t now = 0;
+    uint32_t oldest;
+    uint32_t n;
+    uint32_t i;
+    uint32_t j;
+    uint32_t k;
+    uint8_t field;
+    double range_sum;
+    double sum;
+    float min;
+    float max;
+    int16_t error;
+
+    error = sps_range_index_init(&index, RANGE_CAPACITY, RANGE_NUM_FIELDS,
+                                 storage, sizeof(storage));
+    CHECK_ZERO_TEXT(error, "sps_range_index_init");
+    error = sps_range_index_init(&index, RANGE_CAPACITY, RANGE_NUM_FIELDS,
+                                 storage, sizeof(storage) - 1);
+    CHECK_EQUAL_TEXT(SPS_RANGE_INDEX_ERR_STORAGE_TOO_SMALL, error,
+                     "Storage too small not detected");
+    error = sps_range_index_init(&index, RANGE_CAPACITY, RANGE_NUM_FIELDS,
+                                 storage, sizeof(storage));
+    CHECK_ZERO_TEXT(error, "sps_range_index_init");
+
+    random_state = 32;
+    for (i = 0; i < RANGE_NUM_SAMPLES; ++i) {
+        now += 1 + random_next() % 2000000;
+        timestamps[i] = now;
+        for (field = 0; field < RANGE_NUM_FIELDS; ++field)
+            values[i][field] = random_float(1000.0f) - 100.0f;
+        sps_range_index_add(&index, now, values[i]);
+
+        // Random ranges, partly outside of the kept samples
+        oldest = i >= RANGE_CAPACITY ? i - RANGE_CAPACITY + 1 : 0;
+        for (k = 0; k < 10; ++k) {
+            span = now - timestamps[oldest];
+            from = timestamps[oldest] + random_next() % (span + 1);
+            if (k % 3 == 0)
+                from = from > 2000000 ? from - 2000000 : 0;
+            to = from + random_next() % (span + 2000000);
+            field = (uint8_t)(random_next() % RANGE_NUM_FIELDS);
+
+            n = 0;
+            sum = 0;
+            min = 0;
+            max = 0;
+            for (j = oldest; j <= i; ++j) {
+                if (timestamps[j] < from || timestamps[j] > to)
+                    continue;
+                if (n == 0 || values[j][field] < min)
+                    min = values[j][field];
+                if (n == 0 || values[j][field] > max)
+                    max = values[j][field];
+                sum += values[j][field];
+                ++n;
+            }
+
+            error = sps_range_index_query(&index, field, from, to, &summary,
+                                          &range_sum);
+            CHECK_ZERO_TEXT(error, "sps_range_index_query");
+            CHECK_EQUAL_TEXT(n, summary.count, "Wrong sample count");
+            CHECK_EQUAL_TEXT(min, summary.min, "Wrong minimum");
+            CHECK_EQUAL_TEXT(max, summary.max, "Wrong maximum");
+            if (n)
+                CHECK_TRUE_TEXT(summary.mean - sum / n < 1e-2 &&
+                                    sum / n - summary.mean < 1e-2,
+                                "Wrong mean");
+            CHECK_TRUE_TEXT(range_sum - sum <= 1e-2 * n &&
+                                sum - range_sum <= 1e-2 * n,
+                            "Wrong sum");
+        }
+    }
+
+    error = sps_range_index_query(&index, RANGE_NUM_FIELDS, 0, now, &summary,
+                                  (double*)NULL);
+    CHECK_EQUAL_TEXT(SPS_RANGE_INDEX_ERR_INVALID_CONFIG, error,
+                     "Invalid field not detected");
+}
+
+#define FLOAT_ARRAY_MAX_VALUES 13
+
+// Runs the SIMD path the binary was compiled for, see host_test_binaries
+TEST (SPS_Common_Test, SPS_bytes_to_float_array) {
+    uint8_t bytes[4 * FLOAT_ARRAY_MAX_VALUES + 3];
+    float values[FLOAT_ARRAY_MAX_VALUES + 1];
+    uint32_t expected;
+    uint32_t actual;
+    uint16_t num_values;
+    uint16_t offset;
+    uint16_t i;
+
+    random_state = 34;
+    for (i = 0; i < sizeof(bytes); ++i)
+        bytes[i] = (uint8_t)random_next();
+
+    // All remainders of the 4 values per vector and unaligned input
+    for (num_values = 0; num_values <= FLOAT_ARRAY_MAX_VALUES; ++num_values) {
+        for (offset = 0; offset < 4; ++offset) {
+            memset(values, 0xa5, sizeof(values));
+            sensirion_bytes_to_float_array(bytes + offset, values, num_values);
+            for (i = 0; i < num_values; ++i) {
+                expected = (uint32_t)bytes[offset + 4 * i] << 24 |
+                           (uint32_t)bytes[offset + 4 * i + 1] << 16 |
+                           (uint32_t)bytes[offset + 4 * i + 2] << 8 |
+                           (uint32_t)bytes[offset + 4 * i + 3];
+                memcpy(&actual, &values[i], sizeof(actual));
+                CHECK_EQUAL_TEXT(expected, actual, "Wrong byte order");
+            }
+            memcpy(&actual, &values[num_values], sizeof(actual));
+            CHECK_EQUAL_TEXT(0xa5a5a5a5, actual, "Wrote past num_values");
+        }
+    }
+}
+
+// Sub-index of the EPA formula, rounded to the nearest integer
+static uint16_t aqi_reference(const struct sps_aqi_table* table,
+                              uint32_t concentration_tenths) {
+    const struct sps_aqi_breakpoint* bp;
+    uint32_t c = concentration_tenths;
+    uint8_t i;
+
+    c -= c % table->resolution_tenths;
+    for (i = 0; i < table->num_breakpoints; ++i) {
+        bp = &table->breakpoints[i];
+        if (c > bp->c_hi)
+            continue;
+        if (c < bp->c_lo)
+            c = bp->c_lo;
+        return (uint16_t)floor((double)(bp->i_hi - bp->i_lo) /
+                                   (bp->c_hi - bp->c_lo) * (c - bp->c_lo) +
+                               bp->i_lo + 0.5);
+    }
+    return table->breakpoints[table->num_breakpoints - 1].i_hi;
+}
+
+TEST (SPS_Common_Test, SPS_aqi_breakpoints) {
+    uint32_t c;
+
+    // Breakpoints of the EPA tables
+    CHECK_EQUAL_TEXT(0, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 0), "PM2.5");
+    CHECK_EQUAL_TEXT(50, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 90), "PM2.5");
+    CHECK_EQUAL_TEXT(51, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 91), "PM2.5");
+    CHECK_EQUAL_TEXT(100, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 354),
+                     "PM2.5");
+    CHECK_EQUAL_TEXT(101, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 355),
+                     "PM2.5");
+    CHECK_EQUAL_TEXT(201, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 1255),
+                     "PM2.5");
+    CHECK_EQUAL_TEXT(500, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 3254),
+                     "PM2.5");
+    CHECK_EQUAL_TEXT(500, sps_aqi_sub_index(&sps_aqi_epa_pm2p5, 100000),
+                     "PM2.5 above the table");
+    CHECK_EQUAL_TEXT(50, sps_aqi_sub_index(&sps_aqi_epa_pm10, 549),
+                     "PM10 not truncated to whole ug/m^3");
+    CHECK_EQUAL_TEXT(51, sps_aqi_sub_index(&sps_aqi_epa_pm10, 550), "PM10");
+    CHECK_EQUAL_TEXT(500, sps_aqi_sub_index(&sps_aqi_epa_pm10, 6040), "PM10");
+
+    // Fixed-point interpolation against the EPA formula
+    for (c = 0; c <= 3300; ++c)
+        CHECK_EQUAL_TEXT(aqi_reference(&sps_aqi_epa_pm2p5, c),
+                         sps_aqi_sub_index(&sps_aqi_epa_pm2p5, c), "PM2.5");
+    for (c = 0; c <= 6100; ++c)
+        CHECK_EQUAL_TEXT(aqi_reference(&sps_aqi_epa_pm10, c),
+                         sps_aqi_sub_index(&sps_aqi_epa_pm10, c), "PM10");
+
+    CHECK_EQUAL_TEXT(123, sps_aqi_float_to_tenths(12.35f), "Not truncated");
+    CHECK_EQUAL_TEXT(1, sps_aqi_float_to_tenths(0.1f), "Not rounded");
+    CHECK_EQUAL_TEXT(0, sps_aqi_float_to_tenths(-5.0f), "Negative");
+    CHECK_EQUAL_TEXT(0, sps_aqi_float_to_tenths(NAN), "NaN");
+}
+
+#define AQI_HOUR_USEC 3600000000ULL
+#define AQI_NUM_HOURS 30
+
+// NowCast of the EPA over the hours completed before hour h
+static double nowcast_reference(const uint32_t* hourly, int h) {
+    uint32_t c_min = 0xffffffff;
+    uint32_t c_max = 0;
+    double w;
+    double weight = 1;
+    double sum = 0;
+    double weights = 0;
+    int i;
+
+    for (i = 1; i <= SPS_AQI_NOWCAST_HOURS && i <= h; ++i) {
+        c_min = hourly[h - i] < c_min ? hourly[h - i] : c_min;
+        c_max = hourly[h - i] > c_max ? hourly[h - i] : c_max;
+    }
+    w = c_max ? (double)c_min / c_max : 1.0;
+    w = w < 0.5 ? 0.5 : w;
+    for (i = 1; i <= SPS_AQI_NOWCAST_HOURS && i <= h; ++i) {
+        sum += weight * hourly[h - i];
+        weights += weight;
+        weight *= w;
+    }
+    return sum / weights;
+}
+
+TEST (SPS_Common_Test, SPS_aqi_nowcast) {
+    static const uint32_t hourly[AQI_NUM_HOURS] = {
+        120, 130, 5,   400, 380, 350, 90,  95,  100, 500, 20,  25, 30, 35, 40,
+        45,  500, 510, 520, 10,  10,  10,  200, 150, 100, 50,  60, 70, 80, 90};
+    struct sps_aqi_nowcast nowcast;
+    uint32_t concentration;
+    uint64_t start = 12345;
+    int16_t error;
+    int h;
+    int i;
+
+    sps_aqi_nowcast_init(&nowcast);
+    error = sps_aqi_nowcast_get(&nowcast, &concentration);
+    CHECK_EQUAL_TEXT(SPS_AQI_ERR_NO_DATA, error, "NowCast without data");
+
+    for (h = 0; h <= AQI_NUM_HOURS; ++h) {
+        // The first sample of an hour completes the previous one
+        sps_aqi_nowcast_add(&nowcast, start + h * AQI_HOUR_USEC,
+                            hourly[h % AQI_NUM_HOURS] - 5);
+        error = sps_aqi_nowcast_get(&nowcast, &concentration);
+        if (h < 2) {
+            CHECK_EQUAL_TEXT(SPS_AQI_ERR_NO_DATA, error,
+                             "NowCast needs two of three hours");
+        } else {
+            CHECK_ZERO_TEXT(error, "sps_aqi_nowcast_get");
+            CHECK_TRUE_TEXT(fabs(nowcast_reference(hourly, h) -
+                                 concentration) <= 1.0,
+                            "NowCast differs from the EPA formula");
+        }
+        if (h == AQI_NUM_HOURS)
+            break;
+
+        // Further samples averaging to the hourly value
+        for (i = 1; i < 4; ++i)
+            sps_aqi_nowcast_add(&nowcast,
+                                start + h * AQI_HOUR_USEC +
+                                    i * (AQI_HOUR_USEC / 4),
+                                hourly[h] + (i == 1 ? 5 : 0));
+    }
+
+    // Two of the three most recent hours are missing
+    sps_aqi_nowcast_add(&nowcast, start + (AQI_NUM_HOURS + 3) * AQI_HOUR_USEC,
+                        100);
+    error = sps_aqi_nowcast_get(&nowcast, &concentration);
+    CHECK_EQUAL_TEXT(SPS_AQI_ERR_NO_DATA, error, "Missing hours not detected");
+}
+
+#define FORMAT_NUM_VALUES 20000
+
+TEST (SPS_Common_Test, SPS_format_float) {
+    static const char* const names[] = {"mc_1p0", "mc_2p5"};
+    static const uint8_t decimals[] = {2, 1};
+    const float values[] = {1.0f, -2.45f};
+    char expected[64];
+    char buf[64];
+    float value;
+    uint8_t d;
+    int16_t len;
+    int i;
+
+    random_state = 36;
+    for (i = 0; i < FORMAT_NUM_VALUES; ++i) {
+        d = (uint8_t)(i % (SPS_FORMAT_MAX_DECIMALS + 1));
+        // Scaled magnitude below 2^32, many small values to test rounding
+        if (i % 3)
+            value = random_float(4.2e9f) / (float)pow(10, d);
+        else
+            value = random_float(0.1f);
+        if (i & 1)
+            value = -value;
+        snprintf(expected, sizeof(expected), "%.*f", d, value);
+        // Negative values rounding to zero have no sign
+        if (expected[0] == '-' && strspn(expected + 1, "0.") ==
+                                      strlen(expected + 1))
+            memmove(expected, expected + 1, strlen(expected));
+        len = sps_format_float(buf, sizeof(buf), value, d);
+        CHECK_EQUAL_TEXT((int16_t)strlen(expected), len, expected);
+        STRCMP_EQUAL_TEXT(expected, buf, "Differs from snprintf");
+    }
+
+    len = sps_format_float(buf, sizeof(buf), NAN, 2);
+    CHECK_EQUAL_TEXT(3, len, "NaN");
+    STRCMP_EQUAL_TEXT("nan", buf, "NaN");
+    len = sps_format_float(buf, 5, 12.25f, 2);
+    CHECK_EQUAL_TEXT(SPS_FORMAT_ERR_BUFFER_TOO_SMALL, len, "Buffer overflow");
+
+    len = sps_format_line(buf, sizeof(buf), SPS_FORMAT_CSV, names, values,
+                          decimals, 2);
+    CHECK_EQUAL_TEXT(10, len, "sps_format_line");
+    STRCMP_EQUAL_TEXT("1.00,-2.5\n", buf, "CSV");
+    len = sps_format_line(buf, sizeof(buf), SPS_FORMAT_CSV_HEADER, names,
+                          values, decimals, 2);
+    STRCMP_EQUAL_TEXT("mc_1p0,mc_2p5\n", buf, "CSV header");
+    len = sps_format_line(buf, sizeof(buf), SPS_FORMAT_JSON, names, values,
+                          decimals, 2);
+    STRCMP_EQUAL_TEXT("{\"mc_1p0\":1.00,\"mc_2p5\":-2.5}\n", buf, "JSON");
+}
+
+TEST (SPS_Common_Test, SPS30_format_measurement) {
+    int16_t len;
+    char line[SPS30_FORMAT_MAX_LEN];
+    struct sps30_measurement m = {1.0f, 2.5f,   3.125f, 4.0f, 5.0f,
+                                  6.0f, 7.996f, 0.0f,   9.0f, 0.54f};
+
+    len = sps30_format_measurement(line, sizeof(line), SPS_FORMAT_CSV, &m);
+    STRCMP_EQUAL("1.00,2.50,3.12,4.00,5.00,6.00,8.00,0.00,9.00,0.54\n", line);
+    CHECK_EQUAL_TEXT((int16_t)strlen(line), len, "Unexpected length");
+
+    len = sps30_format_measurement(line, sizeof(line), SPS_FORMAT_JSON, &m);
+    CHECK_TRUE_TEXT(len > 0, "sps30_format_measurement");
+    STRNCMP_EQUAL("{\"mc_1p0\":1.00,\"mc_2p5\":2.50,", line, 29);
+
+    len = sps30_format_measurement(line, 10, SPS_FORMAT_CSV, &m);
+    CHECK_EQUAL_TEXT(SPS_FORMAT_ERR_BUFFER_TOO_SMALL, len,
+                     "Buffer overflow not detected");
+}
+
+#define CBOR_NUM_RECORDS 50
+#define CBOR_NUM_VALUES 8
+
+TEST (SPS_Common_Test, SPS_cbor_round_trip) {
+    static uint8_t buf[CBOR_NUM_RECORDS * (32 + CBOR_NUM_VALUES * 5)];
+    static const float special[] = {0.0f, -0.0f, 1.5f, -2.0f, 65504.0f,
+                                    5.9604645e-8f, INFINITY, 0.1f};
+    static float values[CBOR_NUM_RECORDS][CBOR_NUM_VALUES];
+    static uint64_t timestamps[CBOR_NUM_RECORDS];
+    static int64_t offsets[CBOR_NUM_RECORDS];
+    struct sps_cbor_writer writer;
+    struct sps_cbor_reader reader;
+    uint8_t small[8];
+    const char* text;
+    uint64_t u;
+    int64_t n;
+    uint32_t bits;
+    uint32_t expected_bits;
+    uint16_t len;
+    uint16_t count;
+    float f;
+    int16_t error;
+    int i;
+    int j;
+
+    random_state = 37;
+    sps_cbor_writer_init(&writer, buf, sizeof(buf));
+    for (i = 0; i < CBOR_NUM_RECORDS; ++i) {
+        timestamps[i] = (uint64_t)random_next() << (i % 40);
+        offsets[i] = (int64_t)random_next() - (1 << 23);
+        for (j = 0; j < CBOR_NUM_VALUES; ++j)
+            values[i][j] = i % 2 ? special[j] : random_float(1000.0f) - 500;
+        error = sps_cbor_write_map(&writer, 3);
+        error |= sps_cbor_write_text(&writer, "t");
+        error |= sps_cbor_write_uint(&writer, timestamps[i]);
+        error |= sps_cbor_write_text(&writer, "offset");
+        error |= sps_cbor_write_int(&writer, offsets[i]);
+        error |= sps_cbor_write_text(&writer, "v");
+        error |= sps_cbor_write_array(&writer, CBOR_NUM_VALUES);
+        for (j = 0; j < CBOR_NUM_VALUES; ++j)
+            error |= sps_cbor_write_float(&writer, values[i][j]);
+        CHECK_ZERO_TEXT(error, "sps_cbor_write_*");
+        error = sps_cbor_writer_commit(&writer);
+        CHECK_ZERO_TEXT(error, "sps_cbor_writer_commit");
+    }
+
+    sps_cbor_reader_init(&reader, buf, sps_cbor_writer_get_length(&writer));
+    for (i = 0; i < CBOR_NUM_RECORDS; ++i) {
+        error = sps_cbor_read_uint(&reader, &u);
+        CHECK_EQUAL_TEXT(SPS_CBOR_ERR_TYPE, error, "Map read as uint");
+        error = sps_cbor_read_map(&reader, &count);
+        CHECK_ZERO_TEXT(error, "sps_cbor_read_map");
+        CHECK_EQUAL_TEXT(3, count, "Wrong map size");
+        error = sps_cbor_read_text(&reader, &text, &len);
+        CHECK_ZERO_TEXT(error, "sps_cbor_read_text");
+        CHECK_TRUE_TEXT(len == 1 && text[0] == 't', "Wrong key");
+        error = sps_cbor_read_uint(&reader, &u);
+        CHECK_ZERO_TEXT(error, "sps_cbor_read_uint");
+        CHECK_EQUAL_TEXT(timestamps[i], u, "Wrong uint");
+        error = sps_cbor_read_text(&reader, &text, &len);
+        CHECK_ZERO_TEXT(error, "sps_cbor_read_text");
+        CHECK_TRUE_TEXT(len == 6 && memcmp(text, "offset", 6) == 0,
+                        "Wrong key");
+        error = sps_cbor_read_int(&reader, &n);
+        CHECK_ZERO_TEXT(error, "sps_cbor_read_int");
+        CHECK_EQUAL_TEXT(offsets[i], n, "Wrong int");
+        error = sps_cbor_read_text(&reader, &text, &len);
+        CHECK_ZERO_TEXT(error, "sps_cbor_read_text");
+        error = sps_cbor_read_array(&reader, &count);
+        CHECK_ZERO_TEXT(error, "sps_cbor_read_array");
+        CHECK_EQUAL_TEXT(CBOR_NUM_VALUES, count, "Wrong array size");
+        for (j = 0; j < CBOR_NUM_VALUES; ++j) {
+            error = sps_cbor_read_float(&reader, &f);
+            CHECK_ZERO_TEXT(error, "sps_cbor_read_float");
+            // Bit exact, including the sign of zero
+            memcpy(&bits, &f, sizeof(bits));
+            memcpy(&expected_bits, &values[i][j], sizeof(expected_bits));
+            CHECK_EQUAL_TEXT(expected_bits, bits, "Float not lossless");
+        }
+    }
+    CHECK_TRUE_TEXT(sps_cbor_reader_at_end(&reader), "Trailing data");
+    error = sps_cbor_read_uint(&reader, &u);
+    CHECK_EQUAL_TEXT(SPS_CBOR_ERR_END, error, "Read past the end");
+
+    // Shortest encoding: half precision 1.5 and single precision 0.1
+    sps_cbor_writer_init(&writer, small, sizeof(small));
+    sps_cbor_write_float(&writer, 1.5f);
+    sps_cbor_write_float(&writer, 0.1f);
+    error = sps_cbor_writer_commit(&writer);
+    CHECK_ZERO_TEXT(error, "sps_cbor_writer_commit");
+    CHECK_EQUAL_TEXT(8, sps_cbor_writer_get_length(&writer), "Not shortest");
+    CHECK_EQUAL_TEXT(0xf9, small[0], "Not half precision");
+    CHECK_EQUAL_TEXT(0x3e, small[1], "Wrong half precision");
+    CHECK_EQUAL_TEXT(0xfa, small[3], "Not single precision");
+
+    // A record which does not fit is discarded as a whole
+    sps_cbor_write_uint(&writer, 1);
+    error = sps_cbor_writer_commit(&writer);
+    CHECK_EQUAL_TEXT(SPS_CBOR_ERR_BUFFER_FULL, error, "Overflow not detected");
+    CHECK_EQUAL_TEXT(8, sps_cbor_writer_get_length(&writer),
+                     "Partial record kept");
+}
+
+#define FILTER_NUM_FIELDS 3
+#define FILTER_HEARTBEAT_USEC 60000000
+
+TEST (SPS_Common_Test, SPS_report_filter) {
+    static const float abs_threshold[FILTER_NUM_FIELDS] = {1.0f, 0.5f, 0.0f};
+    static const float rel_threshold[FILTER_NUM_FIELDS] = {0.05f, 0.0f, 0.1f};
+    struct sps_report_filter_config config = {
+        FILTER_NUM_FIELDS, abs_threshold, rel_threshold,
+        FILTER_HEARTBEAT_USEC};
+    struct sps_report_filter filter;
+    struct sps_report_filter_stats stats;
+    float values[FILTER_NUM_FIELDS] = {20.0f, 20.0f, 20.0f};
+    float last[FILTER_NUM_FIELDS];
+    float threshold;
+    float diff;
+    uint64_t last_report = 0;
+    uint64_t now = 0;
+    uint32_t reported = 0;
+    uint8_t expected;
+    uint8_t actual;
+    int16_t error;
+    int i;
+    int j;
+
+    config.num_fields = 0;
+    error = sps_report_filter_init(&filter, &config);
+    CHECK_EQUAL_TEXT(SPS_REPORT_FILTER_ERR_INVALID_CONFIG, error,
+                     "Invalid config not detected");
+    config.num_fields = FILTER_NUM_FIELDS;
+    error = sps_report_filter_init(&filter, &config);
+    CHECK_ZERO_TEXT(error, "sps_report_filter_init");
+
+    random_state = 38;
+    for (i = 0; i < NUM_RANDOM_SAMPLES; ++i) {
+        now += 1000000 + random_next() % 4000000;
+        // Random walk with occasional jumps
+        for (j = 0; j < FILTER_NUM_FIELDS; ++j) {
+            values[j] += random_float(1.0f) - 0.5f;
+            if (random_next() % 100 == 0)
+                values[j] += random_float(20.0f);
+            if (values[j] < 0)
+                values[j] = -values[j];
+        }
+
+        expected = i == 0 || now - last_report >= FILTER_HEARTBEAT_USEC;
+        for (j = 0; j < FILTER_NUM_FIELDS && !expected; ++j) {
+            threshold = rel_threshold[j] * last[j];
+            if (threshold < abs_threshold[j])
+                threshold = abs_threshold[j];
+            diff = values[j] - last[j];
+            expected = diff > threshold || -diff > threshold;
+        }
+
+        actual = sps_report_filter_check(&filter, now, values);
+        CHECK_EQUAL_TEXT(expected, actual, "Wrong decision");
+        if (actual) {
+            memcpy(last, values, sizeof(last));
+            last_report = now;
+            ++reported;
+        }
+        CHECK_TRUE_TEXT(now - last_report < FILTER_HEARTBEAT_USEC,
+                        "Heartbeat missed");
+    }
+
+    sps_report_filter_get_stats(&filter, &stats);
+    CHECK_EQUAL_TEXT(reported, stats.reported, "Wrong reported count");
+    CHECK_EQUAL_TEXT(NUM_RANDOM_SAMPLES - reported, stats.suppressed,
+                     "Wrong suppressed count");
+    CHECK_TRUE_TEXT(stats.suppressed > stats.reported, "Nothing suppressed");
+
+    // Unchanged samples are reported after a reset
+    actual = sps_report_filter_check(&filter, now, last);
+    CHECK_ZERO_TEXT(actual, "Unchanged sample reported");
+    sps_report_filter_reset(&filter);
+    actual = sps_report_filter_check(&filter, now, last);
+    CHECK_EQUAL_TEXT(1, actual, "Sample after reset suppressed");
+}
+
+TEST (SPS_Common_Test, SPS_ring_overwrite_oldest) {
+    uint32_t buffer[4];
+    struct sps_ring ring;
+    struct sps_ring_stats stats;
+    uint32_t element;
+    uint32_t i;
+    int16_t error;
+
+    error = sps_ring_init(&ring, buffer, sizeof(buffer[0]), 3,
+                          SPS_RING_OVERWRITE_OLDEST);
+    CHECK_EQUAL_TEXT(SPS_RING_ERR_INVALID_CAPACITY, error, "Capacity 3");
+    error = sps_ring_init(&ring, buffer, sizeof(buffer[0]), 4,
+                          SPS_RING_OVERWRITE_OLDEST);
+    CHECK_ZERO_TEXT(error, "sps_ring_init");
+    error = sps_ring_pop(&ring, &element);
+    CHECK_EQUAL_TEXT(SPS_RING_ERR_EMPTY, error, "Pop from empty ring");
+
+    for (i = 0; i < 10; ++i) {
+        error = sps_ring_push(&ring, &i);
+        CHECK_ZERO_TEXT(error, "sps_ring_push");
+    }
+    CHECK_EQUAL_TEXT(4, sps_ring_count(&ring), "Ring not full");
+    sps_ring_get_stats(&ring, &stats);
+    CHECK_EQUAL_TEXT(10, stats.pushed, "Wrong pushed count");
+    CHECK_EQUAL_TEXT(0, stats.rejected, "Wrong rejected count");
+    CHECK_EQUAL_TEXT(6, stats.overwritten, "Wrong overwritten count");
+
+    // The newest elements are kept in order
+    for (i = 6; i < 10; ++i) {
+        error = sps_ring_pop(&ring, &element);
+        CHECK_ZERO_TEXT(error, "sps_ring_pop");
+        CHECK_EQUAL_TEXT(i, element, "Wrong element");
+    }
+    error = sps_ring_pop(&ring, &element);
+    CHECK_EQUAL_TEXT(SPS_RING_ERR_EMPTY, error, "Ring not empty");
+}
+
+TEST (SPS_Common_Test, SPS_ring_backpressure) {
+    uint32_t buffer[4];
+    struct sps_ring ring;
+    struct sps_ring_stats stats;
+    uint32_t element;
+    uint32_t i;
+    int16_t error;
+
+    error = sps_ring_init(&ring, buffer, sizeof(buffer[0]), 4,
+                          SPS_RING_BACKPRESSURE);
+    CHECK_ZERO_TEXT(error, "sps_ring_init");
+    for (i = 0; i < 6; ++i) {
+        error = sps_ring_push(&ring, &i);
+        CHECK_EQUAL_TEXT(i < 4 ? 0 : SPS_RING_ERR_FULL, error,
+                         "sps_ring_push");
+    }
+    sps_ring_get_stats(&ring, &stats);
+    CHECK_EQUAL_TEXT(4, stats.pushed, "Wrong pushed count");
+    CHECK_EQUAL_TEXT(2, stats.rejected, "Wrong rejected count");
+    CHECK_EQUAL_TEXT(0, stats.overwritten, "Wrong overwritten count");
+
+    // The oldest elements are kept, popping makes room again
+    error = sps_ring_pop(&ring, &element);
+    CHECK_ZERO_TEXT(error, "sps_ring_pop");
+    CHECK_EQUAL_TEXT(0, element, "Wrong element");
+    error = sps_ring_push(&ring, &i);
+    CHECK_ZERO_TEXT(error, "sps_ring_push after pop");
+    for (i = 1; i < 4; ++i) {
+        error = sps_ring_pop(&ring, &element);
+        CHECK_ZERO_TEXT(error, "sps_ring_pop");
+        CHECK_EQUAL_TEXT(i, element, "Wrong element");
+    }
+    error = sps_ring_pop(&ring, &element);
+    CHECK_ZERO_TEXT(error, "sps_ring_pop");
+    CHECK_EQUAL_TEXT(6, element, "Wrong element");
+}
+
+// Fake driver: a new measurement every other read, an error on port 1
+static uint32_t reader_reads;
+static uint8_t reader_port;
+
+static int16_t reader_select_port(uint8_t port) {
+    reader_port = port;
+    return 0;
+}
+
+static int16_t reader_read(void* measurement,
+                           struct sensirion_shdlc_rx_timestamps* ts) {
+    uint32_t n;
+
+    if (reader_port == 1)
+        return -5;
+    n = reader_reads++;
+    if (n % 2)
+        return SPS_READER_NO_DATA;
+    ts->first_byte_usec = n;
+    ts->last_byte_usec = n;
+    memcpy(measurement, &n, sizeof(n));
+    return 0;
+}
+
+TEST (SPS_Common_Test, SPS_reader_no_data) {
+    struct reader_record {
+        struct sps_reader_record header;
+        uint32_t measurement;
+    } records[64], record;
+    const uint8_t ports[] = {0, 1};
+    struct sps_reader_config config;
+    struct sps_reader_stats stats;
+    struct sps_reader reader;
+    struct sps_ring ring;
+    uint32_t published = 0;
+    int16_t error;
+
+    error = sps_ring_init(&ring, records, sizeof(record), 64,
+                          SPS_RING_BACKPRESSURE);
+    CHECK_ZERO_TEXT(error, "sps_ring_init");
+    reader_reads = 0;
+    memset(&config, 0, sizeof(config));
+    config.read = reader_read;
+    config.select_port = reader_select_port;
+    config.measurement_size = sizeof(uint32_t);
+    config.ports = ports;
+    config.num_ports = sizeof(ports);
+    config.interval_usec = 1000;
+    config.ring = &ring;
+    error = sps_reader_start(&reader, &config);
+    CHECK_ZERO_TEXT(error, "sps_reader_start");
+    sensirion_sleep_usec(20000);
+    error = sps_reader_stop(&reader);
+    CHECK_ZERO_TEXT(error, "sps_reader_stop");
+
+    sps_reader_get_stats(&reader, &stats);
+    CHECK_TRUE_TEXT(stats.sweeps > 0, "No sweeps");
+    CHECK_EQUAL_TEXT(2 * stats.sweeps, stats.reads, "Wrong read count");
+    CHECK_EQUAL_TEXT(stats.sweeps, stats.read_errors, "Wrong error count");
+    CHECK_EQUAL_TEXT(-5, stats.last_error, "Wrong last error");
+
+    // Only new measurements are published, in order
+    while (sps_ring_pop(&ring, &record) == 0) {
+        CHECK_EQUAL_TEXT(published, record.header.sequence, "Wrong sequence");
+        CHECK_EQUAL_TEXT(0, record.header.status, "Wrong status");
+        CHECK_EQUAL_TEXT(0, record.header.port, "Wrong port");
+        CHECK_EQUAL_TEXT(0, record.measurement % 2, "No data published");
+        ++published;
+    }
+    CHECK_EQUAL_TEXT(stats.reads - stats.read_errors - stats.no_data,
+                     published, "Wrong published count");
+    CHECK_TRUE_TEXT(stats.no_data > 0, "No data not counted");
+}
+
+#define SHM_NUM_SLOTS 2
+#define SHM_RECORD_WORDS 16
+// Seqlock counter of a slot, behind the 32 byte header (see sps_shm.c)
+#define SHM_SLOT_SEQ(shm, slot) \
+    ((uint32_t*)((shm)->base + 32 + (slot) * (shm)->slot_stride))
+
+static void shm_name(char* name, size_t size) {
+    snprintf(name, size, "/sps-common-test-%d", (int)getpid());
+}
+
+static void shm_fill(uint32_t* record, uint32_t value) {
+    int i;
+
+    for (i = 0; i < SHM_RECORD_WORDS; ++i)
+        record[i] = value;
+}
+
+TEST (SPS_Common_Test, SPS_shm_publish_read) {
+    uint32_t record[SHM_RECORD_WORDS];
+    uint32_t read[SHM_RECORD_WORDS];
+    struct sps_shm publisher;
+    struct sps_shm reader;
+    struct sps_shm reopened;
+    uint32_t sequence;
+    char name[64];
+    int16_t error;
+
+    shm_name(name, sizeof(name));
+    error = sps_shm_publisher_open(&publisher, name, SHM_NUM_SLOTS,
+                                   sizeof(record));
+    CHECK_ZERO_TEXT(error, "sps_shm_publisher_open");
+    error = sps_shm_reader_open(&reader, name);
+    CHECK_ZERO_TEXT(error, "sps_shm_reader_open");
+    CHECK_EQUAL_TEXT(sizeof(record), sps_shm_get_record_size(&reader),
+                     "Wrong record size");
+    error = sps_shm_read_latest(&reader, 0, read, &sequence);
+    CHECK_EQUAL_TEXT(SPS_SHM_ERR_NO_DATA, error, "Read before publish");
+    error = sps_shm_read_latest(&reader, SHM_NUM_SLOTS, read, &sequence);
+    CHECK_EQUAL_TEXT(SPS_SHM_ERR_INVALID_SLOT, error, "Read invalid slot");
+    shm_fill(record, 1);
+    error = sps_shm_publish(&publisher, SHM_NUM_SLOTS, record);
+    CHECK_EQUAL_TEXT(SPS_SHM_ERR_INVALID_SLOT, error, "Publish invalid slot");
+
+    error = sps_shm_publish(&publisher, 1, record);
+    CHECK_ZERO_TEXT(error, "sps_shm_publish");
+    shm_fill(record, 2);
+    error = sps_shm_publish(&publisher, 1, record);
+    CHECK_ZERO_TEXT(error, "sps_shm_publish");
+    error = sps_shm_read_latest(&reader, 1, read, &sequence);
+    CHECK_ZERO_TEXT(error, "sps_shm_read_latest");
+    CHECK_EQUAL_TEXT(2, sequence, "Wrong sequence");
+    CHECK_TRUE_TEXT(memcmp(record, read, sizeof(record)) == 0,
+                    "Wrong record");
+
+    // A restarted publisher reuses the matching segment of the reader
+    error = sps_shm_close(&publisher, (const char*)NULL);
+    CHECK_ZERO_TEXT(error, "sps_shm_close");
+    error = sps_shm_publisher_open(&publisher, name, SHM_NUM_SLOTS,
+                                   sizeof(record));
+    CHECK_ZERO_TEXT(error, "sps_shm_publisher_open (restart)");
+    shm_fill(record, 3);
+    error = sps_shm_publish(&publisher, 1, record);
+    CHECK_ZERO_TEXT(error, "sps_shm_publish");
+    error = sps_shm_read_latest(&reader, 1, read, &sequence);
+    CHECK_ZERO_TEXT(error, "sps_shm_read_latest after restart");
+    CHECK_EQUAL_TEXT(3, sequence, "Sequence not continued");
+    CHECK_EQUAL_TEXT(3, read[SHM_RECORD_WORDS - 1], "Wrong record");
+
+    // A publisher with another geometry replaces the segment
+    error = sps_shm_close(&publisher, (const char*)NULL);
+    CHECK_ZERO_TEXT(error, "sps_shm_close");
+    error = sps_shm_publisher_open(&publisher, name, SHM_NUM_SLOTS + 1,
+                                   sizeof(record));
+    CHECK_ZERO_TEXT(error, "sps_shm_publisher_open (replace)");
+    error = sps_shm_read_latest(&reader, 1, read, &sequence);
+    CHECK_EQUAL_TEXT(SPS_SHM_ERR_STALE, error, "Replaced segment not stale");
+    error = sps_shm_reader_open(&reopened, name);
+    CHECK_ZERO_TEXT(error, "sps_shm_reader_open (reopen)");
+    error = sps_shm_read_latest(&reopened, SHM_NUM_SLOTS, read, &sequence);
+    CHECK_EQUAL_TEXT(SPS_SHM_ERR_NO_DATA, error, "New segment not empty");
+
+    CHECK_ZERO_TEXT(sps_shm_close(&reopened, (const char*)NULL), "close");
+    CHECK_ZERO_TEXT(sps_shm_close(&reader, (const char*)NULL), "close");
+    CHECK_ZERO_TEXT(sps_shm_close(&publisher, name), "close");
+}
+
+struct shm_writer {
+    struct sps_shm* shm;
+    uint32_t count;
+};
+
+static void* shm_write(void* arg) {
+    struct shm_writer* writer = (struct shm_writer*)arg;
+    uint32_t record[SHM_RECORD_WORDS];
+    uint32_t i;
+
+    for (i = 1; i <= writer->count; ++i) {
+        shm_fill(record, i);
+        (void)sps_shm_publish(writer->shm, 0, record);
+    }
+    return NULL;
+}
+
+TEST (SPS_Common_Test, SPS_shm_seqlock) {
+    uint32_t record[SHM_RECORD_WORDS];
+    uint32_t read[SHM_RECORD_WORDS];
+    struct shm_writer writer;
+    struct sps_shm publisher;
+    struct sps_shm reader;
+    uint32_t* seq;
+    uint32_t sequence;
+    uint32_t last = 0;
+    pthread_t thread;
+    char name[64];
+    int16_t error;
+    int i;
+
+    shm_name(name, sizeof(name));
+    error = sps_shm_publisher_open(&publisher, name, SHM_NUM_SLOTS,
+                                   sizeof(record));
+    CHECK_ZERO_TEXT(error, "sps_shm_publisher_open");
+    error = sps_shm_reader_open(&reader, name);
+    CHECK_ZERO_TEXT(error, "sps_shm_reader_open");
+    shm_fill(record, 1);
+    error = sps_shm_publish(&publisher, 0, record);
+    CHECK_ZERO_TEXT(error, "sps_shm_publish");
+
+    // An odd counter, e.g. of a publisher which died while writing, is
+    // retried until the reader gives up, the next publish repairs it
+    seq = SHM_SLOT_SEQ(&publisher, 0);
+    CHECK_EQUAL_TEXT(2, *seq, "Unexpected slot layout");
+    *seq = 3;
+    error = sps_shm_read_latest(&reader, 0, read, &sequence);
+    CHECK_EQUAL_TEXT(SPS_SHM_ERR_BUSY, error, "Torn record read");
+    shm_fill(record, 2);
+    error = sps_shm_publish(&publisher, 0, record);
+    CHECK_ZERO_TEXT(error, "sps_shm_publish");
+    error = sps_shm_read_latest(&reader, 0, read, &sequence);
+    CHECK_ZERO_TEXT(error, "sps_shm_read_latest after repair");
+    CHECK_EQUAL_TEXT(2, sequence, "Wrong sequence");
+
+    // Concurrent reads never return a partially written record
+    writer.shm = &publisher;
+    writer.count = 200000;
+    CHECK_ZERO_TEXT(pthread_create(&thread, NULL, shm_write, &writer),
+                    "pthread_create");
+    for (i = 0; i < 200000; ++i) {
+        error = sps_shm_read_latest(&reader, 0, read, &sequence);
+        if (error == SPS_SHM_ERR_BUSY)
+            continue;
+        CHECK_ZERO_TEXT(error, "sps_shm_read_latest");
+        CHECK_EQUAL_TEXT(read[0], read[SHM_RECORD_WORDS - 1], "Torn record");
+        CHECK_TRUE_TEXT(read[0] >= last, "Older record read");
+        last = read[0];
+    }
+    CHECK_ZERO_TEXT(pthread_join(thread, NULL), "pthread_join");
+    error = sps_shm_read_latest(&reader, 0, read, &sequence);
+    CHECK_ZERO_TEXT(error, "sps_shm_read_latest");
+    CHECK_EQUAL_TEXT(writer.count, read[0], "Last record missing");
+
+    CHECK_ZERO_TEXT(sps_shm_close(&reader, (const char*)NULL), "close");
+    CHECK_ZERO_TEXT(sps_shm_close(&publisher, name), "close");
+}
@@ -0,0 +1,35 @@
+// Driver calls recorded by sps30-test-simulation and replayed by
+// sps30-test-replay, which must send the very same frames
+
+#include "sensirion_test_setup.h"
+#include "sps30.h"
+
+#define CAPTURE_PATH "sps30-simulation.pcap"
+#define CAPTURE_MEASUREMENTS_PATH "sps30-simulation.measurements"
+#define CAPTURE_NUM_MEASUREMENTS 20
+
+static void run_capture_session(struct sps30_measurement* measurements) {
+    struct sps30_version_information version;
+    uint32_t interval;
+    int16_t error;
+    int i;
+
+    error = sps30_select_port(0);
+    CHECK_ZERO_TEXT(error, "sps30_select_port");
+    sps30_invalidate_cache();
+    error = sps30_probe();
+    CHECK_ZERO_TEXT(error, "sps30_probe");
+    error = sps30_read_version(&version);
+    CHECK_ZERO_TEXT(error, "sps30_read_version");
+    error = sps30_get_fan_auto_cleaning_interval(&interval);
+    CHECK_ZERO_TEXT(error, "sps30_get_fan_auto_cleaning_interval");
+    error = sps30_start_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_start_measurement");
+    for (i = 0; i < CAPTURE_NUM_MEASUREMENTS; ++i) {
+        sensirion_sleep_usec(1000000);
+        error = sps30_read_measurement(&measurements[i]);
+        CHECK_ZERO_TEXT(error, "sps30_read_measurement");
+    }
+    error = sps30_stop_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_stop_measurement");
+}
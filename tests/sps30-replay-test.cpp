@@ -0,0 +1,47 @@
+#include "sensirion_test_setup.h"
+#include "sensirion_uart.h"
+#include "sensirion_uart_replay.h"
+#include "sps30.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "sps30-capture-session.h"
+
+TEST_GROUP (SPS30_Replay_Test) {
+    void setup() {
+        int16_t error;
+
+        sensirion_uart_replay_configure(CAPTURE_PATH, 0);
+        error = sensirion_uart_open();
+        CHECK_ZERO_TEXT(error, "sensirion_uart_open");
+    }
+
+    void teardown() {
+        sensirion_uart_close();
+    }
+};
+
+// Replay the capture recorded by sps30-test-simulation
+TEST (SPS30_Replay_Test, SPS30_replay_capture) {
+    struct sps30_measurement expected[CAPTURE_NUM_MEASUREMENTS];
+    struct sps30_measurement measurements[CAPTURE_NUM_MEASUREMENTS];
+    struct sensirion_uart_replay_stats stats;
+    FILE* file;
+    int i;
+
+    file = fopen(CAPTURE_MEASUREMENTS_PATH, "rb");
+    CHECK_TRUE_TEXT(file != NULL, "Run sps30-test-simulation first");
+    CHECK_EQUAL_TEXT(1, fread(expected, sizeof(expected), 1, file), "fread");
+    fclose(file);
+
+    run_capture_session(measurements);
+
+    sensirion_uart_replay_get_stats(&stats);
+    CHECK_EQUAL_TEXT(0, stats.tx_mismatches, "Driver sent different frames");
+    CHECK_EQUAL_TEXT(stats.tx_frames, stats.rx_frames, "Responses missing");
+    CHECK_TRUE_TEXT(stats.finished, "Capture not replayed completely");
+    for (i = 0; i < CAPTURE_NUM_MEASUREMENTS; ++i)
+        CHECK_TRUE_TEXT(memcmp(&expected[i], &measurements[i],
+                               sizeof(expected[i])) == 0,
+                        "Decoded measurements differ");
+}
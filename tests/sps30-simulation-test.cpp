@@ -0,0 +1,409 @@
+#include "sensirion_test_setup.h"
+#include "sensirion_uart.h"
+#include "sps30.h"
+#include "sps30_scheduler.h"
+#include "sps30_simulation.h"
+#include "sps30_supervisor.h"
+#include "sps_capture.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "sps30-capture-session.h"
+
+// Concentration of the simulated sensors and its tolerance
+#define SIM_MC_2P5 10.0f
+#define SIM_EPSILON 1e-3f
+#define SIM_HOUR_USEC 3600000000ULL
+#define SIM_CAPTURE_RING_SIZE 128
+
+// Concentration rising by 0.25 ug/m^3 per second
+static float sim_profile_ramp(uint8_t port, uint64_t time_usec) {
+    return 1.0f + (float)(time_usec / 1000) / 4000.0f;
+}
+
+TEST_GROUP (SPS30_Simulation_Test) {
+    void setup() {
+        int16_t error;
+
+        sps30_simulation_reset();
+        sps30_simulation_set_disconnected(0);
+        sps30_simulation_set_profile((sps30_simulation_profile_fn)NULL);
+        error = sensirion_uart_open();
+        CHECK_ZERO_TEXT(error, "sensirion_uart_open");
+        // Drops the metadata of the power-cycled sensors
+        sps30_enable_cache(0);
+        error = sps30_select_port(0);
+        CHECK_ZERO_TEXT(error, "sps30_select_port");
+    }
+
+    void teardown() {
+        sensirion_uart_close();
+    }
+};
+
+TEST (SPS30_Simulation_Test, SPS30_simulation_scheduler) {
+    const struct sps30_scheduler_config config = {120000000, 30000000, 10};
+    struct sps30_scheduler scheduler;
+    struct sps30_scheduler_stats stats;
+    struct sps30_simulation_stats sim_stats;
+    struct sps30_measurement m;
+    uint64_t now;
+    uint64_t next;
+    uint64_t end;
+    uint32_t samples = 0;
+    uint32_t errors = 0;
+    int16_t ret;
+
+    ret = sps30_scheduler_init(&scheduler, &config);
+    CHECK_ZERO_TEXT(ret, "sps30_scheduler_init");
+
+    end = sensirion_get_time_usec() + SIM_HOUR_USEC;
+    while ((now = sensirion_get_time_usec()) < end) {
+        ret = sps30_scheduler_step(&scheduler, now, &m, &next);
+        if (ret == SPS30_SCHEDULER_SAMPLE) {
+            CHECK_TRUE_TEXT(m.mc_2p5 - SIM_MC_2P5 < SIM_EPSILON &&
+                                SIM_MC_2P5 - m.mc_2p5 < SIM_EPSILON,
+                            "Wrong sample");
+            ++samples;
+        } else {
+            CHECK_ZERO_TEXT(ret, "sps30_scheduler_step");
+        }
+        if (next > now)
+            sensirion_sleep_usec((uint32_t)(next - now));
+    }
+    CHECK_EQUAL_TEXT(30, samples, "Wrong number of samples");
+
+    // Stopped for 80 s of the 120 s cycle, thus a third of the time measuring
+    sps30_scheduler_get_stats(&scheduler, &stats);
+    CHECK_TRUE_TEXT(stats.duty_cycle_permille >= 320 &&
+                        stats.duty_cycle_permille <= 350,
+                    "Wrong duty cycle");
+    sps30_simulation_get_stats(0, &sim_stats);
+    CHECK_TRUE_TEXT(sim_stats.sleeps >= 29, "Sensor not put to sleep");
+
+    // The sensor is power-cycled after half of the readings of a sample
+    end = sensirion_get_time_usec() + SIM_HOUR_USEC;
+    samples = 0;
+    while ((now = sensirion_get_time_usec()) < end) {
+        sps30_simulation_get_stats(0, &sim_stats);
+        if (samples == 2 && sim_stats.measurements % 10 == 5 && errors == 0)
+            sps30_simulation_reset();
+
+        ret = sps30_scheduler_step(&scheduler, now, &m, &next);
+        if (ret == SPS30_SCHEDULER_SAMPLE) {
+            CHECK_TRUE_TEXT(m.mc_2p5 - SIM_MC_2P5 < SIM_EPSILON &&
+                                SIM_MC_2P5 - m.mc_2p5 < SIM_EPSILON,
+                            "Sample averaged with a failed reading");
+            ++samples;
+        } else if (ret) {
+            CHECK_TRUE_TEXT(SPS30_IS_ERR_STATE(ret), "Unexpected error");
+            ++errors;
+        }
+        if (next > now)
+            sensirion_sleep_usec((uint32_t)(next - now));
+    }
+    CHECK_EQUAL_TEXT(1, errors, "Stopped sensor not reported");
+    CHECK_TRUE_TEXT(samples >= 28, "Sensor not restarted");
+}
+
+TEST (SPS30_Simulation_Test, SPS30_simulation_session) {
+    struct sps30_session session;
+    struct sps30_session_stats stats;
+    struct sps30_measurement m;
+    uint32_t warm_up_samples = 0;
+    uint32_t samples = 0;
+    uint8_t warm_up;
+    int16_t ret;
+    int i;
+
+    sps30_session_init(&session);
+    ret = sps30_session_start(&session);
+    CHECK_ZERO_TEXT(ret, "sps30_session_start");
+    for (i = 0; i < 60; ++i) {
+        sensirion_sleep_usec(SPS30_SIMULATION_SAMPLE_USEC);
+        ret = sps30_session_read_measurement(&session, &m, &warm_up);
+        CHECK_ZERO_TEXT(ret, "sps30_session_read_measurement");
+        ++samples;
+        if (warm_up) {
+            CHECK_EQUAL_TEXT(samples, ++warm_up_samples,
+                             "Warm-up sample after a stable one");
+        }
+    }
+
+    // 10 ug/m^3 is a low concentration with 30 s warm-up
+    CHECK_TRUE_TEXT(warm_up_samples >= 28 && warm_up_samples <= 30,
+                    "Wrong number of warm-up samples");
+    sps30_session_get_stats(&session, &stats);
+    CHECK_EQUAL_TEXT(1, stats.stable_sessions, "Session not stable");
+    CHECK_TRUE_TEXT(stats.min_time_to_stable_usec >= SPS30_WARM_UP_LOW_USEC &&
+                        stats.min_time_to_stable_usec <=
+                            SPS30_WARM_UP_LOW_USEC +
+                                SPS30_SIMULATION_SAMPLE_USEC,
+                    "Wrong time to stable");
+
+    // A sensor which stopped measuring is an error, not a sample
+    sps30_simulation_reset();
+    sensirion_sleep_usec(SPS30_SIMULATION_SAMPLE_USEC);
+    ret = sps30_session_read_measurement(&session, &m, &warm_up);
+    CHECK_TRUE_TEXT(SPS30_IS_ERR_STATE(ret), "Stopped sensor not reported");
+    CHECK_EQUAL_TEXT(samples, session.samples, "Failed reading counted");
+
+    ret = sps30_session_stop(&session);
+    CHECK_ZERO_TEXT(ret, "sps30_session_stop");
+}
+
+TEST (SPS30_Simulation_Test, SPS30_simulation_supervisor) {
+    const struct sps30_supervisor_config config =
+        SPS30_SUPERVISOR_DEFAULT_CONFIG;
+    struct sps30_supervisor supervisor;
+    struct sps30_supervisor_stats stats;
+    struct sps30_measurement m;
+    int16_t ret;
+    int i;
+
+    ret = sps30_supervisor_init(&supervisor, &config, 1);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_init");
+    ret = sps30_supervisor_start_measurement(&supervisor);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_start_measurement");
+    sensirion_sleep_usec(SPS30_SIMULATION_SAMPLE_USEC);
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_read_measurement");
+
+    // No new measurement yet is not an error
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_EQUAL_TEXT(SPS30_ERR_NOT_ENOUGH_DATA, ret, "Measurement read twice");
+    CHECK_EQUAL_TEXT(SPS30_HEALTH_OK, sps30_supervisor_get_health(&supervisor),
+                     "No data is not a fault");
+
+    // The power-cycled sensor rejects the read and is restarted
+    sps30_simulation_reset();
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_TRUE_TEXT(SPS30_IS_ERR_STATE(ret), "Stopped sensor not detected");
+    CHECK_EQUAL_TEXT(SPS30_HEALTH_DEGRADED,
+                     sps30_supervisor_get_health(&supervisor),
+                     "Fault not detected");
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_EQUAL_TEXT(SPS30_SUPERVISOR_ERR_BACKOFF, ret, "No backoff");
+    for (i = 0; i < 10 && ret == SPS30_SUPERVISOR_ERR_BACKOFF; ++i) {
+        sensirion_sleep_usec(config.min_backoff_usec);
+        ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    }
+    CHECK_EQUAL_TEXT(SPS30_ERR_NOT_ENOUGH_DATA, ret, "Not restarted");
+    sensirion_sleep_usec(SPS30_SIMULATION_SAMPLE_USEC);
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_ZERO_TEXT(ret, "Measurement after recovery");
+    CHECK_TRUE_TEXT(m.mc_2p5 - SIM_MC_2P5 < SIM_EPSILON &&
+                        SIM_MC_2P5 - m.mc_2p5 < SIM_EPSILON,
+                    "Wrong measurement");
+
+    sps30_supervisor_get_stats(&supervisor, &stats);
+    CHECK_EQUAL_TEXT(1, stats.errors[SPS30_ERROR_CLASS_STATE],
+                     "Wrong error class");
+    CHECK_EQUAL_TEXT(1, stats.recoveries, "Recovery not counted");
+}
+
+// The simulation has a single UART for all ports
+static int16_t sim_reopen(uint8_t port) {
+    (void)sensirion_uart_close();
+    return sensirion_uart_open();
+}
+
+TEST (SPS30_Simulation_Test, SPS30_simulation_supervisor_disconnect) {
+    // Reopen the UART after every failure
+    const struct sps30_supervisor_config config = {0, 0, 100000, 1000000,
+                                                   sim_reopen};
+    struct sps30_supervisor supervisor;
+    struct sps30_supervisor_stats stats;
+    struct sps30_measurement m;
+    int16_t ret;
+    int i;
+
+    ret = sps30_supervisor_init(&supervisor, &config, 2);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_init");
+    ret = sps30_supervisor_start_measurement(&supervisor);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_start_measurement");
+    sensirion_sleep_usec(SPS30_SIMULATION_SAMPLE_USEC);
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_read_measurement");
+
+    // Neither the failed reads nor the failed reopens are mistaken for no data
+    sps30_simulation_set_disconnected(1);
+    for (i = 0; i < 20; ++i) {
+        sensirion_sleep_usec(config.max_backoff_usec);
+        ret = sps30_supervisor_read_measurement(&supervisor, &m);
+        CHECK_TRUE_TEXT(ret != 0, "Disconnected UART not detected");
+        CHECK_TRUE_TEXT(sps30_supervisor_get_health(&supervisor) !=
+                            SPS30_HEALTH_OK,
+                        "Disconnected UART reported healthy");
+    }
+    CHECK_EQUAL_TEXT(SPS30_HEALTH_FAILED,
+                     sps30_supervisor_get_health(&supervisor),
+                     "Failed reopens not escalated");
+
+    // The sensor kept measuring and is read again after the reopen
+    sps30_simulation_set_disconnected(0);
+    sensirion_sleep_usec(config.max_backoff_usec);
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_ZERO_TEXT(ret, "Measurement after reconnect");
+    CHECK_EQUAL_TEXT(SPS30_HEALTH_OK, sps30_supervisor_get_health(&supervisor),
+                     "Not recovered");
+
+    sps30_supervisor_get_stats(&supervisor, &stats);
+    CHECK_EQUAL_TEXT(20, stats.reopens, "Wrong reopens");
+    CHECK_EQUAL_TEXT(20, stats.errors[SPS30_ERROR_CLASS_OTHER],
+                     "Wrong error class");
+    CHECK_EQUAL_TEXT(1, stats.recoveries, "Recovery not counted");
+}
+
+TEST (SPS30_Simulation_Test, SPS30_simulation_supervisor_no_reopen) {
+    // Without a reopen function the sensor is only reset
+    const struct sps30_supervisor_config config = {
+        0, 0, 100000, 1000000, (sps30_supervisor_reopen_fn)NULL};
+    struct sps30_supervisor supervisor;
+    struct sps30_supervisor_stats stats;
+    struct sps30_measurement m;
+    int16_t ret;
+    int i;
+
+    ret = sps30_supervisor_init(&supervisor, &config, 3);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_init");
+    ret = sps30_supervisor_start_measurement(&supervisor);
+    CHECK_ZERO_TEXT(ret, "sps30_supervisor_start_measurement");
+
+    sps30_simulation_set_disconnected(1);
+    for (i = 0; i < 5; ++i) {
+        sensirion_sleep_usec(config.max_backoff_usec);
+        ret = sps30_supervisor_read_measurement(&supervisor, &m);
+        CHECK_TRUE_TEXT(ret != 0, "Disconnected UART not detected");
+    }
+
+    // The UART stayed open for the other sensors
+    sps30_simulation_set_disconnected(0);
+    sensirion_sleep_usec(config.max_backoff_usec);
+    ret = sps30_supervisor_read_measurement(&supervisor, &m);
+    CHECK_EQUAL_TEXT(SPS30_ERR_NOT_ENOUGH_DATA, ret, "Not restarted");
+    CHECK_EQUAL_TEXT(SPS30_HEALTH_OK, sps30_supervisor_get_health(&supervisor),
+                     "Not recovered");
+
+    sps30_supervisor_get_stats(&supervisor, &stats);
+    CHECK_EQUAL_TEXT(0, stats.reopens, "UART reopened");
+    CHECK_EQUAL_TEXT(5, stats.resets, "Wrong resets");
+}
+
+TEST (SPS30_Simulation_Test, SPS30_simulation_fan_auto_cleaning) {
+    struct sps30_simulation_stats stats;
+    uint32_t interval;
+    int16_t ret;
+
+    sps30_enable_cache(1);
+
+    ret = sps30_set_fan_auto_cleaning_interval(600);
+    CHECK_ZERO_TEXT(ret, "sps30_set_fan_auto_cleaning_interval");
+
+    // The sensor reports the new interval only after a reset
+    sps30_invalidate_cache();
+    ret = sps30_get_fan_auto_cleaning_interval(&interval);
+    CHECK_ZERO_TEXT(ret, "sps30_get_fan_auto_cleaning_interval");
+    CHECK_EQUAL_TEXT(SPS30_SIMULATION_DEFAULT_FAN_AUTO_CLEANING_INTERVAL,
+                     interval, "New interval reported before reset");
+    ret = sps30_reset_wait_ready(1000000, (uint32_t*)NULL);
+    CHECK_ZERO_TEXT(ret, "sps30_reset_wait_ready");
+    ret = sps30_get_fan_auto_cleaning_interval(&interval);
+    CHECK_ZERO_TEXT(ret, "sps30_get_fan_auto_cleaning_interval");
+    CHECK_EQUAL_TEXT(600, interval, "New interval not reported after reset");
+
+    // Days of measurement pass in an instant on the virtual clock
+    ret = sps30_start_measurement();
+    CHECK_ZERO_TEXT(ret, "sps30_start_measurement");
+    sps30_simulation_advance_usec(2 * SIM_HOUR_USEC);
+    ret = sps30_stop_measurement();
+    CHECK_ZERO_TEXT(ret, "sps30_stop_measurement");
+    sps30_simulation_get_stats(0, &stats);
+    CHECK_EQUAL_TEXT(12, stats.fan_auto_cleanings, "Wrong cleanings");
+}
+
+// Record the traffic and measurements for the replay in sps30-test-replay
+TEST (SPS30_Simulation_Test, SPS30_simulation_capture) {
+    static struct sps_capture_record records[SIM_CAPTURE_RING_SIZE];
+    struct sps30_measurement measurements[CAPTURE_NUM_MEASUREMENTS];
+    struct sps_capture capture;
+    struct sps_capture_stats stats;
+    struct sps_ring ring;
+    int16_t error;
+    FILE* file;
+
+    sps30_simulation_set_profile(sim_profile_ramp);
+    error = sps_ring_init(&ring, records, sizeof(records[0]),
+                          SIM_CAPTURE_RING_SIZE, SPS_RING_BACKPRESSURE);
+    CHECK_ZERO_TEXT(error, "sps_ring_init");
+    error = sps_capture_start(&capture, CAPTURE_PATH, &ring);
+    CHECK_ZERO_TEXT(error, "sps_capture_start");
+    run_capture_session(measurements);
+    error = sps_capture_stop(&capture);
+    CHECK_ZERO_TEXT(error, "sps_capture_stop");
+
+    sps_capture_get_stats(&capture, &stats);
+    CHECK_EQUAL_TEXT(0, stats.dropped, "Frames dropped");
+    CHECK_EQUAL_TEXT(0, stats.truncated, "Frames truncated");
+    CHECK_EQUAL_TEXT(stats.frames, stats.written, "Records not written");
+    CHECK_TRUE_TEXT(measurements[CAPTURE_NUM_MEASUREMENTS - 1].mc_2p5 >
+                        measurements[0].mc_2p5,
+                    "Profile not applied");
+
+    file = fopen(CAPTURE_MEASUREMENTS_PATH, "wb");
+    CHECK_TRUE_TEXT(file != NULL, "fopen");
+    CHECK_EQUAL_TEXT(1, fwrite(measurements, sizeof(measurements), 1, file),
+                     "fwrite");
+    fclose(file);
+}
+
+static void sim_check_serial(uint8_t port) {
+    char serial[SPS30_MAX_SERIAL_LEN];
+    char expected[] = "SIMULATED0000000";
+    int16_t ret;
+
+    expected[15] = (char)('0' + port);
+    ret = sps30_get_serial(serial);
+    CHECK_ZERO_TEXT(ret, "sps30_get_serial");
+    STRCMP_EQUAL_TEXT(expected, serial, "Serial of another sensor");
+}
+
+TEST (SPS30_Simulation_Test, SPS30_simulation_metadata_cache) {
+    char serial[SPS30_MAX_SERIAL_LEN];
+    int16_t ret;
+    uint8_t port;
+
+    // Without the cache, plain port switches talk to the right sensor
+    for (port = 0; port < 2; ++port) {
+        ret = sensirion_uart_select_port(port);
+        CHECK_ZERO_TEXT(ret, "sensirion_uart_select_port");
+        ret = sps30_probe();
+        CHECK_ZERO_TEXT(ret, "sps30_probe");
+    }
+    for (port = 0; port < 2; ++port) {
+        ret = sensirion_uart_select_port(port);
+        CHECK_ZERO_TEXT(ret, "sensirion_uart_select_port");
+        sim_check_serial(port);
+    }
+
+    // The cache keeps the serial number of each port
+    sps30_enable_cache(1);
+    for (port = 0; port < 2; ++port) {
+        ret = sps30_select_port(port);
+        CHECK_ZERO_TEXT(ret, "sps30_select_port");
+        ret = sps30_probe();
+        CHECK_ZERO_TEXT(ret, "sps30_probe");
+    }
+    sps30_simulation_set_disconnected(1);
+    for (port = 0; port < 2; ++port) {
+        ret = sps30_select_port(port);
+        CHECK_ZERO_TEXT(ret, "sps30_select_port");
+        sim_check_serial(port);
+    }
+
+    // Disabling the cache drops the metadata
+    sps30_enable_cache(0);
+    ret = sps30_get_serial(serial);
+    CHECK_TRUE_TEXT(ret != 0, "Serial read from the disabled cache");
+    sps30_simulation_set_disconnected(0);
+}
@@ -1,5 +1,9 @@
 #include "sensirion_test_setup.h"
 #include "sps30.h"
+#include "sps_capture.h"
+#include "sps_reader.h"
+#include "sps_ring.h"
+#include <string.h>
 
 // Measurement ranges according to datasheet
 #define SPS30_MIN_MC 0
@@ -8,6 +12,7 @@
 #define SPS30_MAX_NC 3000
 #define CMD_DELAY_USEC 20000
 #define SLEEP_WAKE_UP_DELAY_USEC 5000
+#define READY_TIMEOUT_USEC 1000000
 
 #ifndef SENSIRION_UART_TTYDEV
 #define SENSIRION_UART_TTYDEV "/dev/ttyUSB0"
@@ -27,9 +32,8 @@ TEST_GROUP (SPS30_Test) {
     void teardown() {
         int16_t error;
 
-        error = sps30_reset();
-        CHECK_ZERO_TEXT(error, "sps30_reset in test reset");
-        sensirion_sleep_usec(CMD_DELAY_USEC);
+        error = sps30_reset_wait_ready(READY_TIMEOUT_USEC, (uint32_t*)NULL);
+        CHECK_ZERO_TEXT(error, "sps30_reset_wait_ready in test reset");
         sensirion_uart_close();
         CHECK_ZERO_TEXT(error, "sensirion_uart_close");
     }
@@ -60,6 +64,74 @@ TEST (SPS30_Test, SPS30_get_serial) {
     printf("SPS30 serial: %s\n", serial);
 }
 
+TEST (SPS30_Test, SPS30_metadata_cache) {
+    int16_t error;
+    char serial[SPS30_MAX_SERIAL_LEN];
+    char cached_serial[SPS30_MAX_SERIAL_LEN];
+    struct sps30_version_information version;
+    struct sps30_version_information cached_version;
+    uint64_t before;
+
+    sps30_enable_cache(1);
+    error = sps30_probe();
+    CHECK_ZERO_TEXT(error, "sps30_probe");
+    error = sps30_read_version(&version);
+    CHECK_ZERO_TEXT(error, "sps30_read_version");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    // Cached reads return without a transaction
+    before = sensirion_get_time_usec();
+    error = sps30_get_serial(cached_serial);
+    CHECK_ZERO_TEXT(error, "sps30_get_serial (cached)");
+    error = sps30_read_version(&cached_version);
+    CHECK_ZERO_TEXT(error, "sps30_read_version (cached)");
+    CHECK_TRUE_TEXT(sensirion_get_time_usec() - before < CMD_DELAY_USEC,
+                    "Cached metadata read from the sensor");
+    CHECK_EQUAL_TEXT(version.firmware_major, cached_version.firmware_major,
+                     "Cached firmware version differs");
+
+    // The cache is refilled from the sensor after a reset
+    error = sps30_reset();
+    CHECK_ZERO_TEXT(error, "sps30_reset");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+    error = sps30_probe();
+    CHECK_ZERO_TEXT(error, "sps30_probe after reset");
+    error = sps30_get_serial(serial);
+    CHECK_ZERO_TEXT(error, "sps30_get_serial");
+    STRCMP_EQUAL(cached_serial, serial);
+    sps30_enable_cache(0);
+}
+
+TEST (SPS30_Test, SPS30_init_devices) {
+    int16_t error;
+    int16_t port_error;
+    uint8_t port = 0;
+    struct sps30_device_info info;
+    struct sps30_version_information version;
+    char serial[SPS30_MAX_SERIAL_LEN];
+
+    error = sps30_init_devices(&port, 1, 1, &info, &port_error);
+    CHECK_ZERO_TEXT(error, "sps30_init_devices");
+    CHECK_ZERO_TEXT(port_error, "sps30_init_devices port error");
+    printf("SPS30 serial: %s, FW: %u.%u, auto-cleaning interval: %us\n",
+           info.serial, info.version.firmware_major,
+           info.version.firmware_minor,
+           (unsigned)info.fan_auto_cleaning_interval_seconds);
+
+    sps30_invalidate_cache();
+    error = sps30_get_serial(serial);
+    CHECK_ZERO_TEXT(error, "sps30_get_serial");
+    STRCMP_EQUAL(serial, info.serial);
+    error = sps30_read_version(&version);
+    CHECK_ZERO_TEXT(error, "sps30_read_version");
+    CHECK_EQUAL_TEXT(version.firmware_major, info.version.firmware_major,
+                     "Firmware version differs");
+
+    error = sps30_stop_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_stop_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+}
+
 TEST (SPS30_Test, SPS30_sleep_and_wake_up) {
     int16_t error;
 
@@ -72,6 +144,32 @@ TEST (SPS30_Test, SPS30_sleep_and_wake_up) {
     sensirion_sleep_usec(SLEEP_WAKE_UP_DELAY_USEC);
 }
 
+TEST (SPS30_Test, SPS30_wait_ready) {
+    int16_t error;
+    uint32_t ready_usec;
+
+    error = sps30_wait_ready(READY_TIMEOUT_USEC, &ready_usec);
+    CHECK_ZERO_TEXT(error, "sps30_wait_ready");
+
+    error = sps30_reset_wait_ready(READY_TIMEOUT_USEC, &ready_usec);
+    CHECK_ZERO_TEXT(error, "sps30_reset_wait_ready");
+    CHECK_TRUE_TEXT(ready_usec <= READY_TIMEOUT_USEC, "Ready time too long");
+    printf("ready %u us after reset\n", (unsigned)ready_usec);
+
+    error = sps30_sleep();
+    CHECK_ZERO_TEXT(error, "sps30_sleep");
+    sensirion_sleep_usec(1000000);  // let sensor sleep for some time
+    error = sps30_wake_up_wait_ready(READY_TIMEOUT_USEC, &ready_usec);
+    CHECK_ZERO_TEXT(error, "sps30_wake_up_wait_ready");
+    printf("ready %u us after wake-up\n", (unsigned)ready_usec);
+
+    // The sensor must be responsive without further delay
+    error = sps30_start_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_start_measurement");
+    error = sps30_stop_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_stop_measurement");
+}
+
 TEST (SPS30_Test, SPS30_fan_auto_cleaning_interval) {
     int16_t error;
     uint32_t get_interval;
@@ -80,6 +178,10 @@ TEST (SPS30_Test, SPS30_fan_auto_cleaning_interval) {
     error = sps30_set_fan_auto_cleaning_interval(set_interval);
     CHECK_ZERO_TEXT(error, "sps30_set_fan_auto_cleaning_interval");
     sensirion_sleep_usec(CMD_DELAY_USEC);
+    // The sensor reports the new interval after a reset, which also
+    // invalidates the cache so the interval is read from the sensor
+    error = sps30_reset_wait_ready(READY_TIMEOUT_USEC, (uint32_t*)NULL);
+    CHECK_ZERO_TEXT(error, "sps30_reset_wait_ready");
     error = sps30_get_fan_auto_cleaning_interval(&get_interval);
     CHECK_ZERO_TEXT(error, "sps30_get_fan_auto_cleaning_interval");
     sensirion_sleep_usec(CMD_DELAY_USEC);
@@ -87,6 +189,39 @@ TEST (SPS30_Test, SPS30_fan_auto_cleaning_interval) {
                      "Fan auto cleaning intervals do not match");
 }
 
+TEST (SPS30_Test, SPS30_apply_config) {
+    int16_t error;
+    uint32_t interval;
+    uint8_t changed;
+    struct sps30_config config;
+
+    error = sps30_get_fan_auto_cleaning_interval(&interval);
+    CHECK_ZERO_TEXT(error, "sps30_get_fan_auto_cleaning_interval");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    config.fan_auto_cleaning_interval_seconds = interval;
+    error = sps30_apply_config(&config, &changed);
+    CHECK_ZERO_TEXT(error, "sps30_apply_config");
+    CHECK_EQUAL_TEXT(0, changed, "Unchanged configuration written");
+
+    config.fan_auto_cleaning_interval_seconds = interval + 60;
+    error = sps30_apply_config(&config, &changed);
+    CHECK_ZERO_TEXT(error, "sps30_apply_config");
+    CHECK_EQUAL_TEXT(SPS30_CONFIG_CHANGED_FAN_AUTO_CLEANING_INTERVAL, changed,
+                     "Changed configuration not written");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    error = sps30_apply_config(&config, &changed);
+    CHECK_ZERO_TEXT(error, "sps30_apply_config");
+    CHECK_EQUAL_TEXT(0, changed, "Configuration written twice");
+
+    // Restore the original interval
+    config.fan_auto_cleaning_interval_seconds = interval;
+    error = sps30_apply_config(&config, &changed);
+    CHECK_ZERO_TEXT(error, "sps30_apply_config");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+}
+
 TEST (SPS30_Test, SPS30_get_fan_auto_cleaning_interval_days) {
     int16_t error;
     uint8_t get_interval_days;
@@ -175,3 +310,260 @@ TEST (SPS30_Test, SPS30_measurement) {
     CHECK_ZERO_TEXT(error, "sps30_stop_measurement");
     sensirion_sleep_usec(CMD_DELAY_USEC);
 }
+
+TEST (SPS30_Test, SPS30_measurement_columns) {
+    int16_t error;
+    static float storage[SPS30_MEASUREMENT_COLUMNS_STORAGE_SIZE(8) / 4]
+        __attribute__((aligned(SPS30_COLUMNS_ALIGNMENT)));
+    struct sps30_measurement_columns columns;
+    struct sps30_measurement m;
+    const uint8_t port = 0;
+    int16_t port_error;
+
+    error = sps30_measurement_columns_init(&columns, 8, storage,
+                                           sizeof(storage));
+    CHECK_ZERO_TEXT(error, "sps30_measurement_columns_init");
+
+    error = sps30_start_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_start_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    sensirion_sleep_usec(1000000);  // wait 1 sec for measurement to be ready
+    error = sps30_read_measurement_columns(&columns, &port, 1, &port_error);
+    CHECK_ZERO_TEXT(error, "sps30_read_measurement_columns");
+    CHECK_ZERO_TEXT(port_error, "sps30_read_measurement_columns port error");
+
+    sensirion_sleep_usec(1000000);
+    error = sps30_read_measurement(&m);
+    CHECK_ZERO_TEXT(error, "sps30_read_measurement");
+    error = sps30_measurement_columns_append(&columns, &m, 1);
+    CHECK_ZERO_TEXT(error, "sps30_measurement_columns_append");
+    CHECK_EQUAL_TEXT(2, columns.count, "Unexpected number of rows");
+    CHECK_EQUAL_TEXT(m.mc_2p5, columns.fields[SPS30_FIELD_MC_2P5][1],
+                     "Column does not match the measurement");
+    CHECK_EQUAL_TEXT(m.typical_particle_size,
+                     columns.fields[SPS30_FIELD_TYPICAL_PARTICLE_SIZE][1],
+                     "Column does not match the measurement");
+
+    error = sps30_stop_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_stop_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+}
+
+#ifdef SENSIRION_SHDLC_INSTRUMENTATION
+TEST (SPS30_Test, SPS30_shdlc_instrumentation) {
+    int16_t error;
+    struct sensirion_shdlc_stats stats;
+    struct sensirion_shdlc_command_stats* c;
+    uint32_t interval;
+    uint8_t i;
+
+    sensirion_shdlc_reset_stats();
+    for (i = 0; i < 10; ++i) {
+        sps30_invalidate_cache();
+        error = sps30_get_fan_auto_cleaning_interval(&interval);
+        CHECK_ZERO_TEXT(error, "sps30_get_fan_auto_cleaning_interval");
+    }
+
+    sensirion_shdlc_get_stats(&stats);
+    CHECK_EQUAL_TEXT(10, stats.frames_tx, "Wrong number of sent frames");
+    CHECK_EQUAL_TEXT(10, stats.frames_rx, "Wrong number of received frames");
+    CHECK_EQUAL_TEXT(1, stats.num_commands, "Wrong number of commands");
+    c = &stats.commands[0];
+    CHECK_EQUAL_TEXT(10, c->transactions, "Wrong number of transactions");
+    CHECK_TRUE_TEXT(sensirion_shdlc_latency_percentile(c, 50) <=
+                        sensirion_shdlc_latency_percentile(c, 99),
+                    "Percentiles not monotonic");
+    CHECK_EQUAL_TEXT(c->max_latency_usec,
+                     sensirion_shdlc_latency_percentile(c, 100),
+                     "p100 differs from maximum latency");
+    printf("p99 latency: %u us\n",
+           (unsigned)sensirion_shdlc_latency_percentile(c, 99));
+#ifdef SENSIRION_UART_ERROR_COUNTERS
+    printf("UART frame errors: %u, overruns: %u\n",
+           (unsigned)c->uart_errors.frame_errors,
+           (unsigned)c->uart_errors.overruns);
+#endif
+
+    sensirion_shdlc_reset_stats();
+    sensirion_shdlc_get_stats(&stats);
+    CHECK_EQUAL_TEXT(0, stats.frames_tx, "Statistics not reset");
+}
+#endif /* SENSIRION_SHDLC_INSTRUMENTATION */
+
+TEST (SPS30_Test, SPS30_measurement_ts) {
+    int16_t error;
+    struct sps30_measurement m;
+    struct sensirion_shdlc_rx_timestamps ts;
+    uint64_t before;
+
+    error = sps30_start_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_start_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    sensirion_sleep_usec(1000000);  // wait 1 sec for measurement to be ready
+    before = sensirion_get_time_usec();
+    error = sps30_read_measurement_ts(&m, &ts);
+    CHECK_ZERO_TEXT(error, "sps30_read_measurement_ts");
+    CHECK_TRUE_TEXT(before <= ts.first_byte_usec,
+                    "Response arrived before the request was sent");
+    CHECK_TRUE_TEXT(ts.first_byte_usec <= ts.last_byte_usec,
+                    "Last byte arrived before the first byte");
+    printf("response arrival: %llu us after request, %llu us duration\n",
+           (unsigned long long)(ts.first_byte_usec - before),
+           (unsigned long long)(ts.last_byte_usec - ts.first_byte_usec));
+
+    error = sps30_stop_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_stop_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+}
+
+TEST (SPS30_Test, SPS30_session) {
+    int16_t error;
+    struct sps30_session session;
+    struct sps30_session_stats stats;
+    struct sps30_measurement m;
+    uint8_t warm_up = 1;
+    uint32_t i;
+
+    sps30_session_init(&session);
+    error = sps30_session_start(&session);
+    CHECK_ZERO_TEXT(error, "sps30_session_start");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    for (i = 0; warm_up && i < SPS30_WARM_UP_LOW_USEC / 1000000 + 2; ++i) {
+        sensirion_sleep_usec(1000000);
+        error = sps30_session_read_measurement(&session, &m, &warm_up);
+        CHECK_ZERO_TEXT(error, "sps30_session_read_measurement");
+    }
+    CHECK_TRUE_TEXT(!warm_up, "No stable sample after warm-up");
+    CHECK_EQUAL_TEXT(i, session.samples, "Wrong sample count");
+    CHECK_EQUAL_TEXT(i - 1, session.warm_up_samples,
+                     "Wrong warm-up sample count");
+    CHECK_TRUE_TEXT(session.time_to_stable_usec >= SPS30_WARM_UP_HIGH_USEC,
+                    "Stable before the shortest start-up time");
+    CHECK_TRUE_TEXT(session.time_to_stable_usec <=
+                        SPS30_WARM_UP_LOW_USEC + 2000000,
+                    "Stable too late");
+
+    error = sps30_session_stop(&session);
+    CHECK_ZERO_TEXT(error, "sps30_session_stop");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+
+    sps30_session_get_stats(&session, &stats);
+    CHECK_EQUAL_TEXT(1, stats.stable_sessions, "Wrong stable session count");
+    CHECK_EQUAL_TEXT(session.time_to_stable_usec,
+                     stats.mean_time_to_stable_usec,
+                     "Wrong mean time to stable");
+    printf("time to first stable sample: %u us\n",
+           (unsigned)stats.mean_time_to_stable_usec);
+}
+
+static int16_t read_sps30(void* measurement,
+                          struct sensirion_shdlc_rx_timestamps* ts) {
+    int16_t ret;
+
+    ret = sps30_read_measurement_ts((struct sps30_measurement*)measurement, ts);
+    return ret == SPS30_ERR_NOT_ENOUGH_DATA ? SPS_READER_NO_DATA : ret;
+}
+
+TEST (SPS30_Test, SPS30_reader_service) {
+    struct sps30_record {
+        struct sps_reader_record header;
+        struct sps30_measurement measurement;
+    } records[4], record;
+    struct sps_ring ring;
+    struct sps_reader reader;
+    struct sps_reader_config config;
+    struct sps_ring_stats ring_stats;
+    struct sps_reader_stats stats;
+    const uint8_t ports[] = {0};
+    int16_t error;
+
+    error = sps30_start_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_start_measurement");
+    sensirion_sleep_usec(1000000);  // wait 1 sec for measurement to be ready
+
+    error = sps_ring_init(&ring, records, sizeof(record), 4,
+                          SPS_RING_OVERWRITE_OLDEST);
+    CHECK_ZERO_TEXT(error, "sps_ring_init");
+
+    config.read = read_sps30;
+    config.select_port = sps30_select_port;
+    config.measurement_size = sizeof(struct sps30_measurement);
+    config.ports = ports;
+    config.num_ports = sizeof(ports);
+    config.interval_usec = 200000;
+    config.ring = &ring;
+    error = sps_reader_start(&reader, &config);
+    CHECK_ZERO_TEXT(error, "sps_reader_start");
+    // One new measurement per second, more than fit into the ring
+    sensirion_sleep_usec(6500000);
+    error = sps_reader_stop(&reader);
+    CHECK_ZERO_TEXT(error, "sps_reader_stop");
+
+    sps_reader_get_stats(&reader, &stats);
+    CHECK_ZERO_TEXT(stats.read_errors, "Read errors");
+    CHECK_TRUE_TEXT(stats.no_data > 0, "Polls without new data not counted");
+
+    sps_ring_get_stats(&ring, &ring_stats);
+    CHECK_TRUE_TEXT(ring_stats.overwritten > 0, "Oldest records not dropped");
+    CHECK_EQUAL_TEXT(4, sps_ring_count(&ring), "Ring not full");
+    error = sps_ring_pop(&ring, &record);
+    CHECK_ZERO_TEXT(error, "sps_ring_pop");
+    CHECK_EQUAL_TEXT(ring_stats.overwritten, record.header.sequence,
+                     "Record is not the oldest one retained");
+
+    error = sps30_stop_measurement();
+    CHECK_ZERO_TEXT(error, "sps30_stop_measurement");
+    sensirion_sleep_usec(CMD_DELAY_USEC);
+}
+
+#ifdef SENSIRION_SHDLC_CAPTURE
+TEST (SPS30_Test, SPS30_capture) {
+    static struct sps_capture_record records[16];
+    struct sps_capture capture;
+    struct sps_capture_stats stats;
+    struct sps_ring ring;
+    const char* path = "/tmp/sps30-test-capture.pcap";
+    uint8_t header[24];
+    uint8_t record[24];
+    uint32_t interval;
+    uint32_t value;
+    int16_t error;
+    FILE* file;
+    uint8_t i;
+
+    error = sps_ring_init(&ring, records, sizeof(records[0]), 16,
+                          SPS_RING_BACKPRESSURE);
+    CHECK_ZERO_TEXT(error, "sps_ring_init");
+    error = sps_capture_start(&capture, path, &ring);
+    CHECK_ZERO_TEXT(error, "sps_capture_start");
+    for (i = 0; i < 3; ++i) {
+        sps30_invalidate_cache();
+        error = sps30_get_fan_auto_cleaning_interval(&interval);
+        CHECK_ZERO_TEXT(error, "sps30_get_fan_auto_cleaning_interval");
+    }
+    error = sps_capture_stop(&capture);
+    CHECK_ZERO_TEXT(error, "sps_capture_stop");
+
+    sps_capture_get_stats(&capture, &stats);
+    CHECK_EQUAL_TEXT(6, stats.frames, "Wrong number of captured frames");
+    CHECK_EQUAL_TEXT(6, stats.written, "Wrong number of written records");
+    CHECK_EQUAL_TEXT(0, stats.dropped, "Frames dropped");
+
+    file = fopen(path, "rb");
+    CHECK_TRUE_TEXT(file != NULL, "Capture file missing");
+    CHECK_EQUAL_TEXT(1, fread(header, sizeof(header), 1, file),
+                     "pcap header missing");
+    memcpy(&value, &header[20], sizeof(value));
+    CHECK_EQUAL_TEXT(SPS_CAPTURE_DLT, value, "Wrong link type");
+    CHECK_EQUAL_TEXT(1, fread(record, sizeof(record), 1, file),
+                     "First record missing");
+    CHECK_EQUAL_TEXT(SENSIRION_SHDLC_CAPTURE_TX, record[16],
+                     "First frame not sent");
+    CHECK_EQUAL_TEXT(0x7e, record[20], "Frame does not start with 0x7e");
+    fclose(file);
+    remove(path);
+}
+#endif /* SENSIRION_SHDLC_CAPTURE */